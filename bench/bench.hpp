@@ -0,0 +1,36 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+namespace cyh::bench {
+	struct BenchResult {
+		std::string name;
+		std::vector<std::pair<std::string, double>> params;
+		std::vector<std::pair<std::string, double>> metrics;
+	};
+	using FnSuite = void(*)(std::vector<BenchResult>* pResults);
+	struct BenchSuite {
+		const char* name;
+		FnSuite fn;
+	};
+
+	// Register a suite during static initialization, the return value is unused
+	int RegisterSuite(const char* name, FnSuite fn);
+	std::vector<BenchSuite>& GetSuites();
+
+	// Monotonic clock shared by all processes on the host
+	inline uint64_t GetNanoseconds() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+	// The sample at ratio ( 0.5 for the median ) of the sorted samples, the samples are sorted in place
+	inline double GetPercentile(std::vector<uint64_t>* pSamples, double ratio) {
+		if (pSamples->empty()) { return 0.0; }
+		std::sort(pSamples->begin(), pSamples->end());
+		size_t index = static_cast<size_t>(ratio * static_cast<double>(pSamples->size() - 1) + 0.5);
+		return static_cast<double>((*pSamples)[index]);
+	}
+};
+#define CYHOS_BENCH_SUITE(name, fn) static int _cyhos_bench_suite_##fn = cyh::bench::RegisterSuite(name, fn)
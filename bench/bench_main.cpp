@@ -0,0 +1,104 @@
+#include "bench.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+namespace cyh::bench {
+	std::vector<BenchSuite>& GetSuites() {
+		static std::vector<BenchSuite> suites;
+		return suites;
+	}
+	int RegisterSuite(const char* name, FnSuite fn) {
+		GetSuites().push_back({ name, fn });
+		return 0;
+	}
+};
+using namespace cyh::bench;
+
+static bool is_suite_selected(const char* name, const std::vector<const char*>& selected) {
+	if (selected.empty()) { return true; }
+	for (auto pSelected : selected) {
+		if (strcmp(pSelected, name) == 0) { return true; }
+	}
+	return false;
+}
+static void print_text_result(const char* suite, const BenchResult& result) {
+	printf("%s/%s", suite, result.name.c_str());
+	for (auto& param : result.params) {
+		printf(" %s=%g", param.first.c_str(), param.second);
+	}
+	printf(" :");
+	for (auto& metric : result.metrics) {
+		printf(" %s=%g", metric.first.c_str(), metric.second);
+	}
+	printf("\n");
+}
+static void print_json_string(const std::string& value) {
+	putchar('"');
+	for (unsigned char c : value) {
+		if (c == '"' || c == '\\') {
+			printf("\\%c", c);
+		} else if (c < 0x20) {
+			printf("\\u%04x", c);
+		} else {
+			putchar(c);
+		}
+	}
+	putchar('"');
+}
+static void print_json_values(const std::vector<std::pair<std::string, double>>& values) {
+	putchar('{');
+	for (size_t i = 0; i < values.size(); ++i) {
+		if (i) { putchar(','); }
+		print_json_string(values[i].first);
+		// json has no literal for infinity and nan
+		if (std::isfinite(values[i].second)) {
+			printf(":%.10g", values[i].second);
+		} else {
+			printf(":null");
+		}
+	}
+	putchar('}');
+}
+static void print_json_result(const char* suite, const BenchResult& result, bool is_first) {
+	printf(is_first ? "\n" : ",\n");
+	printf("{\"suite\":");
+	print_json_string(suite);
+	printf(",\"name\":");
+	print_json_string(result.name);
+	printf(",\"params\":");
+	print_json_values(result.params);
+	printf(",\"metrics\":");
+	print_json_values(result.metrics);
+	putchar('}');
+}
+// Usage: cyhos_bench [--json] [suite...], run all suites if none is given
+// --json prints an array of objects {"suite", "name", "params", "metrics"} instead of one line per result
+int main(int argc, char** argv) {
+	bool json = false;
+	std::vector<const char*> selected;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--json") == 0) {
+			json = true;
+		} else {
+			selected.push_back(argv[i]);
+		}
+	}
+	bool is_first = true;
+	if (json) { printf("["); }
+	for (auto& suite : GetSuites()) {
+		if (!is_suite_selected(suite.name, selected)) { continue; }
+		std::vector<BenchResult> results;
+		suite.fn(&results);
+		for (auto& result : results) {
+			if (json) {
+				print_json_result(suite.name, result, is_first);
+			} else {
+				print_text_result(suite.name, result);
+			}
+			is_first = false;
+			fflush(stdout);
+		}
+	}
+	if (json) { printf("\n]\n"); }
+	return 0;
+}
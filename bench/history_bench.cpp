@@ -0,0 +1,88 @@
+#include "bench.hpp"
+#include "cyh/os/sample_history.hpp"
+#include <cstdio>
+#include <random>
+#include <sys/stat.h>
+using namespace cyh::os;
+namespace cyh::bench {
+	static constexpr nuint HISTORY_BENCH_PROCESSES = 1000;
+	static constexpr nuint HISTORY_BENCH_SAMPLES = 600;
+	static constexpr nuint HISTORY_BENCH_SEEKS = 200;
+	static constexpr uint HISTORY_BENCH_KEYFRAME_INTERVALS[] = { 1, 60 };
+	static constexpr const char* HISTORY_BENCH_PATH = "/tmp/cyhos_bench_history.bin";
+	static constexpr uint64_t HISTORY_BENCH_PERIOD = 1000000000ull;
+
+	// A host where a quarter of the processes run between two samples
+	static void advance_synthetic_sample(HistorySample* pSample, std::mt19937_64* pRandom, nuint index) {
+		pSample->timestamp = (index + 1) * HISTORY_BENCH_PERIOD;
+		for (auto& time : pSample->cpu_times) { time += (*pRandom)() % 100; }
+		for (auto& process : pSample->processes) {
+			if ((*pRandom)() % 4) { continue; }
+			process.user_time += (*pRandom)() % 20;
+			process.kernal_time += (*pRandom)() % 5;
+			process.run_delay += (*pRandom)() % 100000;
+			process.voluntary_ctxt_switches += (*pRandom)() % 50;
+		}
+	}
+	static void run_history_case(uint keyframe_interval, std::vector<BenchResult>* pResults) {
+		BenchResult result{};
+		result.name = "synthetic";
+		result.params = { { "processes", static_cast<double>(HISTORY_BENCH_PROCESSES) }, { "keyframe_interval", static_cast<double>(keyframe_interval) } };
+		std::mt19937_64 random(1);
+		HistorySample sample;
+		sample.processor_count = 16;
+		sample.cpu_times.assign(sample.processor_count * static_cast<nuint>(CpuState::Count), 100000);
+		sample.processes.resize(HISTORY_BENCH_PROCESSES);
+		for (nuint i = 0; i < HISTORY_BENCH_PROCESSES; ++i) {
+			auto& process = sample.processes[i];
+			process.pid = static_cast<uint>(i * 3 + 1);
+			process.start_time = i;
+			process.name = "worker-" + std::to_string(i % 97);
+			process.memory = (i + 1) * 40960;
+			process.has_sched = true;
+		}
+
+		HistoryWriter writer;
+		HistoryOptions options{};
+		options.keyframe_interval = keyframe_interval;
+		if (!writer.Create(HISTORY_BENCH_PATH, options)) {
+			result.metrics = { { "supported", 0.0 } };
+			pResults->push_back(result);
+			return;
+		}
+		std::vector<uint64_t> appends(HISTORY_BENCH_SAMPLES);
+		for (nuint i = 0; i < HISTORY_BENCH_SAMPLES; ++i) {
+			advance_synthetic_sample(&sample, &random, i);
+			uint64_t begin = GetNanoseconds();
+			writer.Append(sample);
+			appends[i] = GetNanoseconds() - begin;
+		}
+		writer.Close();
+		struct stat info {};
+		stat(HISTORY_BENCH_PATH, &info);
+
+		// a seek decodes from the keyframe before the timestamp
+		auto reader = HistoryReader::Open(HISTORY_BENCH_PATH);
+		std::vector<uint64_t> seeks(HISTORY_BENCH_SEEKS);
+		for (auto& seek : seeks) {
+			uint64_t timestamp = (random() % HISTORY_BENCH_SAMPLES + 1) * HISTORY_BENCH_PERIOD;
+			uint64_t begin = GetNanoseconds();
+			if (reader.Seek(timestamp)) { reader.Next(); }
+			seek = GetNanoseconds() - begin;
+		}
+		remove(HISTORY_BENCH_PATH);
+		result.metrics = {
+			{ "bytes_per_sample", static_cast<double>(info.st_size) / HISTORY_BENCH_SAMPLES },
+			{ "append_median_us", GetPercentile(&appends, 0.5) / 1e3 },
+			{ "seek_median_us", GetPercentile(&seeks, 0.5) / 1e3 },
+			{ "seek_max_us", GetPercentile(&seeks, 1.0) / 1e3 }
+		};
+		pResults->push_back(result);
+	}
+	static void run_history_suite(std::vector<BenchResult>* pResults) {
+		for (auto interval : HISTORY_BENCH_KEYFRAME_INTERVALS) {
+			run_history_case(interval, pResults);
+		}
+	}
+	CYHOS_BENCH_SUITE("history", run_history_suite);
+};
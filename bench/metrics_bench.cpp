@@ -0,0 +1,108 @@
+#include "bench.hpp"
+#include "cyh/os/metrics_export.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace cyh::os;
+namespace cyh::bench {
+	static constexpr nuint METRICS_BENCH_ITERATIONS = 50;
+	static constexpr nuint METRICS_BENCH_PROCESS_COUNTS[] = { 1000, 10000 };
+
+	// Records shaped like the ones of a busy host, every record has scheduling counters
+	static void fill_synthetic_table(ProcessTable* pTable, nuint count) {
+		pTable->clear();
+		ProcessInformation info{};
+		info.sched = ProcessSchedStat{};
+		for (nuint i = 0; i < count; ++i) {
+			info.pid = static_cast<uint>(i + 1);
+			info.name = "worker-" + std::to_string(i % 97);
+			info.memory = (i + 1) * 40961;
+			info.user_time = i * 13;
+			info.kernal_time = i * 7;
+			info.cpu_time_percentage = static_cast<double>(i % 100) / 7.0;
+			info.sched->run_delay = i * 1000003;
+			info.sched->voluntary_ctxt_switches = i * 11;
+			info.sched->nonvoluntary_ctxt_switches = i * 3;
+			pTable->push_back(info);
+		}
+	}
+	static void run_serialize_case(nuint process_count, std::vector<BenchResult>* pResults) {
+		BenchResult result{};
+		result.name = "serialize_processes";
+		result.params = { { "processes", static_cast<double>(process_count) } };
+		ProcessTable table;
+		fill_synthetic_table(&table, process_count);
+		MetricsWriter writer;
+		// the first scrape grows the buffers, the next ones reuse them
+		writer.WriteProcesses(table);
+		std::vector<uint64_t> samples(METRICS_BENCH_ITERATIONS);
+		for (auto& sample : samples) {
+			uint64_t begin = GetNanoseconds();
+			writer.Clear();
+			writer.WriteProcesses(table);
+			writer.WriteEof();
+			sample = GetNanoseconds() - begin;
+		}
+		result.metrics = {
+			{ "median_ms", GetPercentile(&samples, 0.5) / 1e6 },
+			{ "max_ms", GetPercentile(&samples, 1.0) / 1e6 },
+			{ "bytes", static_cast<double>(writer.size()) }
+		};
+		pResults->push_back(result);
+	}
+	// Return the bytes of the response, 0 if failed
+	static nuint scrape_once(uint16_t port, std::vector<char>* pBuffer) {
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0) { return 0; }
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		nuint size = 0;
+		const char request[] = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+		if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 && send(fd, request, sizeof(request) - 1, 0) > 0) {
+			while (true) {
+				if (pBuffer->size() - size < 65536) { pBuffer->resize(pBuffer->size() + 65536); }
+				auto count = recv(fd, pBuffer->data() + size, pBuffer->size() - size, 0);
+				if (count <= 0) { break; }
+				size += static_cast<nuint>(count);
+			}
+		}
+		close(fd);
+		return size;
+	}
+	static void run_scrape_case(std::vector<BenchResult>* pResults) {
+		BenchResult result{};
+		result.name = "scrape_live";
+		MetricsExporter exporter;
+		if (!exporter.ListenTcp(0) || !exporter.Start(1000u)) {
+			result.metrics = { { "supported", 0.0 } };
+			pResults->push_back(result);
+			return;
+		}
+		std::vector<char> buffer;
+		nuint bytes = scrape_once(exporter.port(), &buffer);
+		std::vector<uint64_t> samples(METRICS_BENCH_ITERATIONS);
+		for (auto& sample : samples) {
+			uint64_t begin = GetNanoseconds();
+			bytes = scrape_once(exporter.port(), &buffer);
+			sample = GetNanoseconds() - begin;
+		}
+		exporter.Stop();
+		result.metrics = {
+			// a scrape racing a sample waits for it
+			{ "median_ms", GetPercentile(&samples, 0.5) / 1e6 },
+			{ "max_ms", GetPercentile(&samples, 1.0) / 1e6 },
+			{ "bytes", static_cast<double>(bytes) }
+		};
+		pResults->push_back(result);
+	}
+	static void run_metrics_suite(std::vector<BenchResult>* pResults) {
+		for (auto count : METRICS_BENCH_PROCESS_COUNTS) {
+			run_serialize_case(count, pResults);
+		}
+		run_scrape_case(pResults);
+	}
+	CYHOS_BENCH_SUITE("metrics", run_metrics_suite);
+};
@@ -0,0 +1,108 @@
+#include "bench.hpp"
+#include "cyh/os/os_internal.hpp"
+#include "cyh/os/res_mon.hpp"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+using namespace cyh::os;
+namespace cyh::bench {
+	static constexpr nuint PARSE_BENCH_ITERATIONS = 200000;
+	static constexpr nuint PARSE_BENCH_FILE_ITERATIONS = 20000;
+	// Used if the host has no block device in /proc/diskstats, as in some containers
+	static const char* PARSE_BENCH_DISK_LINE = "   8       0 sda 193584 47498 11431674 65322 341276 298452 21402544 384917 0 295672 494028 0 0 0 0 23115 43788";
+
+	// The first line of the file starting with prefix, empty if none
+	static std::string read_first_line(const char* path, const char* prefix) {
+		std::string content;
+		if (!UnixInfoParser::read_file(path, &content)) { return {}; }
+		nuint begin = 0;
+		while (begin < content.size()) {
+			nuint end = content.find('\n', begin);
+			if (end == std::string::npos) { end = content.size(); }
+			if (content.compare(begin, strlen(prefix), prefix) == 0) {
+				return content.substr(begin, end - begin);
+			}
+			begin = end + 1;
+		}
+		return {};
+	}
+	template<class FnParse>
+	static void run_parse_case(const char* name, const std::string& line, bool synthetic, FnParse fn, std::vector<BenchResult>* pResults) {
+		BenchResult result{};
+		result.name = name;
+		result.params = { { "line_bytes", static_cast<double>(line.size()) }, { "synthetic", synthetic ? 1.0 : 0.0 } };
+		long checksum = 0;
+		uint64_t begin = GetNanoseconds();
+		for (nuint i = 0; i < PARSE_BENCH_ITERATIONS; ++i) {
+			checksum += fn(line);
+		}
+		double ns = static_cast<double>(GetNanoseconds() - begin);
+		result.metrics = {
+			{ "ns_per_parse", ns / PARSE_BENCH_ITERATIONS },
+			{ "mb_per_s", static_cast<double>(line.size() * PARSE_BENCH_ITERATIONS) / ns * 1e3 },
+			{ "checksum", static_cast<double>(checksum & 0xFF) }
+		};
+		pResults->push_back(result);
+	}
+	// Open, read and parse the file each time, as the monitors do
+	template<class FnRead>
+	static void run_file_case(const char* name, FnRead fn, std::vector<BenchResult>* pResults) {
+		BenchResult result{};
+		result.name = name;
+		result.params = { { "iterations", static_cast<double>(PARSE_BENCH_FILE_ITERATIONS) } };
+		std::vector<uint64_t> samples(PARSE_BENCH_FILE_ITERATIONS);
+		double checksum = 0;
+		for (auto& sample : samples) {
+			uint64_t begin = GetNanoseconds();
+			checksum += fn();
+			sample = GetNanoseconds() - begin;
+		}
+		result.metrics = {
+			{ "median_ns", GetPercentile(&samples, 0.5) },
+			{ "p99_ns", GetPercentile(&samples, 0.99) },
+			{ "checksum", checksum > 0 ? 1.0 : 0.0 }
+		};
+		pResults->push_back(result);
+	}
+	static void run_proc_parse_suite(std::vector<BenchResult>* pResults) {
+		std::string proc_line;
+		UnixInfoParser::read_file("/proc/self/stat", &proc_line);
+		run_parse_case("proc_stat", proc_line, false, [] (const std::string& line) {
+			_unixProcStat info{};
+			UnixInfoParser::read_unix_proc_info(&info, line);
+			return info.utime + info.num_threads;
+		}, pResults);
+
+		std::string cpu_line = read_first_line(ProcfsPath::get("stat").c_str(), "cpu ");
+		run_parse_case("cpu_stat", cpu_line, false, [] (const std::string& line) {
+			_unixCpuInfo info{};
+			UnixInfoParser::read_unix_cpu_info(&info, line);
+			return info.total_time();
+		}, pResults);
+
+		std::string disk_line = read_first_line(ProcfsPath::get("diskstats").c_str(), " ");
+		bool synthetic = disk_line.empty();
+		if (synthetic) { disk_line = PARSE_BENCH_DISK_LINE; }
+		run_parse_case("diskstats", disk_line, synthetic, [] (const std::string& line) {
+			_unixDiskInfo info{};
+			UnixInfoParser::read_unix_disk_info(&info, line);
+			return info.total_time();
+		}, pResults);
+
+		pid_t pid = getpid();
+		run_file_case("read_proc_stat", [pid] () {
+			return static_cast<double>(UnixInfoParser::read_proc_stat(static_cast<uint>(pid)).pid);
+		}, pResults);
+		run_file_case("read_total_cpu_info", [] () {
+			return static_cast<double>(UnixInfoParser::read_total_cpu_info().total_time());
+		}, pResults);
+		run_file_case("read_disks_info", [] () {
+			return static_cast<double>(UnixInfoParser::read_disks_info().size() + 1);
+		}, pResults);
+		// meminfo is parsed inside GetMemoryStatus only
+		run_file_case("meminfo", [] () {
+			return ResourceMonitor::GetMemoryStatus().Physical.total;
+		}, pResults);
+	}
+	CYHOS_BENCH_SUITE("proc_parse", run_proc_parse_suite);
+};
@@ -0,0 +1,108 @@
+#include "bench.hpp"
+#include "cyh/os/lib_stats.hpp"
+#include "cyh/os/proc_mon.hpp"
+#include "cyh/os/proc_root.hpp"
+#include "cyh/os/proc_sampler.hpp"
+#include <cstdio>
+#include <ctime>
+using namespace cyh::os;
+namespace cyh::bench {
+	static constexpr nuint SCAN_BENCH_ITERATIONS = 30;
+	// GetAllProcessInfo sleeps a second between its two reads of cpu times
+	static constexpr nuint SCAN_BENCH_SLEEPING_ITERATIONS = 5;
+
+	// Counters of system calls of this process in [/proc/self/io], including the threads already exited
+	struct _syscallCounters {
+		double read_calls;
+		double write_calls;
+		double read_bytes;
+	};
+	static _syscallCounters read_syscall_counters() {
+		_syscallCounters counters{};
+		FILE* fp = fopen("/proc/self/io", "r");
+		if (!fp) { return counters; }
+		char line[128];
+		unsigned long long value = 0;
+		while (fgets(line, sizeof(line), fp)) {
+			if (sscanf(line, "syscr: %llu", &value) == 1) {
+				counters.read_calls = static_cast<double>(value);
+			} else if (sscanf(line, "syscw: %llu", &value) == 1) {
+				counters.write_calls = static_cast<double>(value);
+			} else if (sscanf(line, "rchar: %llu", &value) == 1) {
+				counters.read_bytes = static_cast<double>(value);
+			}
+		}
+		fclose(fp);
+		return counters;
+	}
+	// Cpu time of this process in nanoseconds, including the threads already exited
+	static uint64_t get_process_cpu_nanoseconds() {
+		timespec now{};
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+		return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+	}
+	// fn returns the count of processes sampled
+	template<class FnSample>
+	static void run_scan_case(const char* name, bool with_details, nuint iterations, FnSample fn, std::vector<BenchResult>* pResults) {
+		BenchResult result{};
+		result.name = name;
+		// warm up the dentry cache and the capacities reused by fn
+		double process_count = static_cast<double>(fn());
+		// a recording set with CYHOS_PROC_ROOT gives the same dataset on every run
+		result.params = { { "details", with_details ? 1.0 : 0.0 }, { "processes", process_count }, { "live_proc", ProcfsRoot::IsLive() ? 1.0 : 0.0 } };
+
+		std::vector<uint64_t> samples(iterations);
+		// reading /proc/self/io costs a read itself, it is subtracted
+		_syscallCounters before = read_syscall_counters();
+		_syscallCounters overhead = read_syscall_counters();
+		overhead = { overhead.read_calls - before.read_calls, overhead.write_calls - before.write_calls, overhead.read_bytes - before.read_bytes };
+		before = read_syscall_counters();
+		LibraryStats::Reset();
+		uint64_t cpu_begin = get_process_cpu_nanoseconds();
+		for (auto& sample : samples) {
+			uint64_t begin = GetNanoseconds();
+			fn();
+			sample = GetNanoseconds() - begin;
+		}
+		uint64_t cpu_ns = get_process_cpu_nanoseconds() - cpu_begin;
+		_syscallCounters after = read_syscall_counters();
+		double read_calls = (after.read_calls - before.read_calls - overhead.read_calls) / iterations;
+		result.metrics = {
+			{ "median_ms", GetPercentile(&samples, 0.5) / 1e6 },
+			{ "max_ms", GetPercentile(&samples, 1.0) / 1e6 },
+			// the work done without the sleeps, in every thread
+			{ "cpu_ms_per_sample", static_cast<double>(cpu_ns) / iterations / 1e6 },
+			{ "read_syscalls_per_sample", read_calls },
+			{ "read_syscalls_per_process", process_count ? read_calls / process_count : 0.0 },
+			{ "write_syscalls_per_sample", (after.write_calls - before.write_calls - overhead.write_calls) / iterations },
+			{ "read_kb_per_sample", (after.read_bytes - before.read_bytes - overhead.read_bytes) / iterations / 1024.0 }
+		};
+		if (LibraryStats::IsEnabled()) {
+			// split of the cost counted by the library itself
+			auto stats = LibraryStats::GetSnapshot();
+			result.metrics.push_back({ "files_opened_per_sample", static_cast<double>(stats.files_opened) / iterations });
+			result.metrics.push_back({ "parse_ms_per_sample", static_cast<double>(stats.parse_nanoseconds) / iterations / 1e6 });
+			result.metrics.push_back({ "sleep_ms_per_sample", static_cast<double>(stats.sleep_nanoseconds) / iterations / 1e6 });
+		}
+		pResults->push_back(result);
+	}
+	static void run_proc_scan_suite(std::vector<BenchResult>* pResults) {
+		run_scan_case("get_all_process_info", false, SCAN_BENCH_SLEEPING_ITERATIONS, [] () {
+			return ProcessMonitor::GetAllProcessInfo(false).size();
+		}, pResults);
+		run_scan_case("get_all_process_info", true, SCAN_BENCH_SLEEPING_ITERATIONS, [] () {
+			return ProcessMonitor::GetAllProcessInfo(true).size();
+		}, pResults);
+		ProcessTable table;
+		run_scan_case("get_process_table", true, SCAN_BENCH_SLEEPING_ITERATIONS, [&table] () {
+			ProcessMonitor::GetProcessTable(&table, true);
+			return table.size();
+		}, pResults);
+		ProcessSampler sampler;
+		run_scan_case("process_sampler", true, SCAN_BENCH_ITERATIONS, [&sampler, &table] () {
+			sampler.Sample(&table);
+			return table.size();
+		}, pResults);
+	}
+	CYHOS_BENCH_SUITE("proc_scan", run_proc_scan_suite);
+};
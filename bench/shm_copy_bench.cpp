@@ -0,0 +1,97 @@
+#include "bench.hpp"
+#include "cyh/os/shmem_mgr.hpp"
+#include <cstring>
+#include <vector>
+using namespace cyh::os;
+namespace cyh::bench {
+	static constexpr nuint COPY_BENCH_MAX_SIZE = nuint(256) << 20;
+	// Bytes copied per measurement, small sizes are repeated
+	static constexpr nuint COPY_BENCH_VOLUME = nuint(1) << 30;
+	// Working set of another tenant, read again after each copy to see how much of it the copy evicted
+	static constexpr nuint COPY_BENCH_VICTIM_SIZE = nuint(1) << 20;
+
+	struct _copyBenchMode {
+		const char* name;
+		bool use_memcpy;
+		MemoryCopy::Isa isa;
+		uint max_threads;
+	};
+
+	static uint64_t read_victim(const std::vector<uint64_t>& victim) {
+		uint64_t sum = 0;
+		for (auto value : victim) { sum += value; }
+		return sum;
+	}
+	static void run_copy_mode(const _copyBenchMode& mode, SharedMemoryManager::SharedMemoryHolder* pHolder, const unsigned char* pSource, nuint size, std::vector<BenchResult>* pResults) {
+		MemoryCopy::CopyOptions options{};
+		options.isa = mode.isa;
+		options.max_threads = mode.max_threads;
+		// every copy of this sweep takes the path of the mode, whatever its size
+		options.non_temporal_threshold = mode.isa == MemoryCopy::Isa::None ? 0 : 1;
+		options.parallel_threshold = 0;
+		// a multi threaded mode is skipped for sizes copied by one thread, it would repeat the single threaded row
+		uint thread_count = mode.use_memcpy ? 1 : MemoryCopy::GetThreadCount(size, options);
+		if (mode.max_threads > 1 && thread_count <= 1) { return; }
+
+		BenchResult result{};
+		result.name = mode.name;
+		result.params = { { "size_kb", static_cast<double>(size >> 10) }, { "threads", static_cast<double>(thread_count) } };
+		if (!mode.use_memcpy && mode.isa > MemoryCopy::GetSupportedIsa()) {
+			result.metrics = { { "supported", 0.0 } };
+			pResults->push_back(result);
+			return;
+		}
+
+		std::vector<uint64_t> victim(COPY_BENCH_VICTIM_SIZE / sizeof(uint64_t), 1);
+		nuint repeat = COPY_BENCH_VOLUME / size;
+		uint64_t checksum = 0;
+		uint64_t copy_ns = 0;
+		uint64_t victim_ns = 0;
+		for (nuint i = 0; i < repeat; ++i) {
+			checksum += read_victim(victim);
+			uint64_t begin = GetNanoseconds();
+			if (mode.use_memcpy) {
+				memcpy(pHolder->data(), pSource, size);
+			} else {
+				pHolder->copy_in(0, pSource, size, options);
+			}
+			uint64_t copied = GetNanoseconds();
+			checksum += read_victim(victim);
+			uint64_t victim_read = GetNanoseconds();
+			copy_ns += copied - begin;
+			victim_ns += victim_read - copied;
+		}
+		checksum += pHolder->get<unsigned char>()[size - 1];
+		result.metrics = {
+			{ "supported", 1.0 },
+			{ "gb_per_s", static_cast<double>(size * repeat) / static_cast<double>(copy_ns) },
+			{ "victim_read_ns_per_kb", static_cast<double>(victim_ns) / repeat / (COPY_BENCH_VICTIM_SIZE >> 10) },
+			{ "checksum", static_cast<double>(checksum & 0xFF) }
+		};
+		pResults->push_back(result);
+	}
+	static void run_shm_copy_suite(std::vector<BenchResult>* pResults) {
+		auto holder = SharedMemoryManager::CreateSharedMemory("/cyhos_bench_copy", COPY_BENCH_MAX_SIZE);
+		if (!holder.data()) { return; }
+		std::vector<unsigned char> source(COPY_BENCH_MAX_SIZE);
+		for (nuint i = 0; i < source.size(); ++i) {
+			source[i] = static_cast<unsigned char>(i * 131);
+		}
+		// fault in the pages once, so the first mode does not pay for them
+		memcpy(holder.data(), source.data(), COPY_BENCH_MAX_SIZE);
+
+		const _copyBenchMode modes[] = {
+			{ "memcpy", true, MemoryCopy::Isa::None, 1 },
+			{ "sse2", false, MemoryCopy::Isa::Sse2, 1 },
+			{ "avx2", false, MemoryCopy::Isa::Avx2, 1 },
+			{ "avx2", false, MemoryCopy::Isa::Avx2, 4 },
+		};
+		const nuint sizes[] = { nuint(64) << 10, nuint(1) << 20, nuint(16) << 20, COPY_BENCH_MAX_SIZE };
+		for (auto size : sizes) {
+			for (auto& mode : modes) {
+				run_copy_mode(mode, &holder, source.data(), size, pResults);
+			}
+		}
+	}
+	CYHOS_BENCH_SUITE("shm_copy", run_shm_copy_suite);
+};
@@ -0,0 +1,102 @@
+#include "bench.hpp"
+#include "cyh/os/shm_ring.hpp"
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace cyh::os;
+namespace cyh::bench {
+	static constexpr nuint IPC_BENCH_LIFECYCLE_ITERATIONS = 2000;
+	static constexpr nuint IPC_BENCH_SEGMENT_SIZE = 4096;
+	static constexpr nuint IPC_BENCH_RING_CAPACITY = nuint(4) << 20;
+	static constexpr nuint IPC_BENCH_TRANSFER_BYTES = nuint(1) << 30;
+
+	static void run_lifecycle_case(std::vector<BenchResult>* pResults) {
+		std::vector<uint64_t> create_samples(IPC_BENCH_LIFECYCLE_ITERATIONS);
+		std::vector<uint64_t> open_samples(IPC_BENCH_LIFECYCLE_ITERATIONS);
+		for (nuint i = 0; i < IPC_BENCH_LIFECYCLE_ITERATIONS; ++i) {
+			uint64_t begin = GetNanoseconds();
+			auto holder = SharedMemoryManager::CreateSharedMemory("/cyhos_bench_ipc", IPC_BENCH_SEGMENT_SIZE);
+			uint64_t created = GetNanoseconds();
+			{
+				auto opened = SharedMemoryManager::OpenSharedMemory(SharedMemoryManager::ACCESS_READWRITE, "/cyhos_bench_ipc");
+			}
+			uint64_t closed = GetNanoseconds();
+			create_samples[i] = created - begin;
+			open_samples[i] = closed - created;
+		}
+		BenchResult result{};
+		result.name = "lifecycle";
+		result.params = { { "size_kb", static_cast<double>(IPC_BENCH_SEGMENT_SIZE >> 10) } };
+		result.metrics = {
+			{ "create_median_us", GetPercentile(&create_samples, 0.5) / 1e3 },
+			{ "create_p99_us", GetPercentile(&create_samples, 0.99) / 1e3 },
+			{ "open_close_median_us", GetPercentile(&open_samples, 0.5) / 1e3 },
+			{ "open_close_p99_us", GetPercentile(&open_samples, 0.99) / 1e3 }
+		};
+		pResults->push_back(result);
+	}
+	// A child process pops the records pushed by this process through a SharedRingBuffer
+	static void run_transfer_case(nuint record_size, std::vector<BenchResult>* pResults) {
+		BenchResult result{};
+		result.name = "ring_transfer";
+		nuint record_count = IPC_BENCH_TRANSFER_BYTES / record_size;
+		result.params = { { "record_bytes", static_cast<double>(record_size) }, { "records", static_cast<double>(record_count) } };
+		auto ring = SharedRingBuffer::Create("/cyhos_bench_ipc_ring", IPC_BENCH_RING_CAPACITY);
+		if (!ring.is_valid() || record_size > ring.max_record_size()) { return; }
+
+		uint64_t begin = GetNanoseconds();
+		pid_t pid = fork();
+		if (pid < 0) {
+			result.metrics = { { "ok", 0.0 } };
+			pResults->push_back(result);
+			return;
+		}
+		if (pid == 0) {
+			auto consumer = SharedRingBuffer::Open("/cyhos_bench_ipc_ring");
+			if (!consumer.is_valid()) { _exit(2); }
+			nuint received = 0;
+			uint64_t checksum = 0;
+			while (received < record_count) {
+				received += consumer.TryPopBatch([&checksum] (const void* data, nuint size) {
+					// touch the payload as a real consumer would
+					checksum += static_cast<const unsigned char*>(data)[size - 1];
+				});
+				if (received < record_count) { consumer.WaitForData(1000); }
+			}
+			_exit(checksum ? 0 : 1);
+		}
+		std::vector<unsigned char> record(record_size, 1);
+		int status = 0;
+		bool exited = false;
+		for (nuint i = 0; i < record_count && !exited; ++i) {
+			// a full ring with the consumer gone would never drain
+			while (!ring.TryPush(record.data(), record_size)) {
+				if (waitpid(pid, &status, WNOHANG) == pid) {
+					exited = true;
+					break;
+				}
+				std::this_thread::yield();
+			}
+		}
+		if (exited) {
+			result.metrics = { { "ok", 0.0 } };
+			pResults->push_back(result);
+			return;
+		}
+		waitpid(pid, &status, 0);
+		double seconds = static_cast<double>(GetNanoseconds() - begin) / 1e9;
+		result.metrics = {
+			{ "gb_per_s", static_cast<double>(record_count * record_size) / seconds / 1e9 },
+			{ "records_per_s", record_count / seconds },
+			{ "ok", WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 1.0 : 0.0 }
+		};
+		pResults->push_back(result);
+	}
+	static void run_shm_ipc_suite(std::vector<BenchResult>* pResults) {
+		run_lifecycle_case(pResults);
+		for (nuint record_size : { nuint(64), nuint(4096), nuint(65536) }) {
+			run_transfer_case(record_size, pResults);
+		}
+	}
+	CYHOS_BENCH_SUITE("shm_ipc", run_shm_ipc_suite);
+};
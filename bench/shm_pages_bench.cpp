@@ -0,0 +1,103 @@
+#include "bench.hpp"
+#include "cyh/os/shmem_mgr.hpp"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+using namespace cyh::os;
+namespace cyh::bench {
+	static constexpr nuint PAGES_BENCH_SIZE = nuint(128) << 20;
+	static constexpr nuint PAGES_BENCH_RANDOM_READS = nuint(1) << 22;
+
+	struct _pagesBenchMode {
+		const char* name;
+		SharedMemoryManager::PageMode page_mode;
+		bool prefault;
+	};
+
+	// Memory backed by huge pages in kB, ShmemHugePages plus used pages of the hugetlb pool
+	static double read_huge_kb() {
+		FILE* fp = fopen("/proc/meminfo", "r");
+		if (!fp) { return 0.0; }
+		char line[256];
+		unsigned long long shmem_huge = 0, pool_total = 0, pool_free = 0, pool_page = 0;
+		while (fgets(line, sizeof(line), fp)) {
+			sscanf(line, "ShmemHugePages: %llu kB", &shmem_huge);
+			sscanf(line, "HugePages_Total: %llu", &pool_total);
+			sscanf(line, "HugePages_Free: %llu", &pool_free);
+			sscanf(line, "Hugepagesize: %llu kB", &pool_page);
+		}
+		fclose(fp);
+		return static_cast<double>(shmem_huge + (pool_total - pool_free) * pool_page);
+	}
+	static void run_pages_mode(const _pagesBenchMode& mode, std::vector<BenchResult>* pResults) {
+		BenchResult result{};
+		result.name = mode.name;
+		SharedMemoryManager::SharedMemoryOptions options{};
+		options.page_mode = mode.page_mode;
+		options.prefault = mode.prefault;
+		nuint huge_page_size = SharedMemoryManager::GetHugePageSize(mode.page_mode, options.hugetlbfs_mount);
+		result.params = { { "size_mb", static_cast<double>(PAGES_BENCH_SIZE >> 20) }, { "prefault", mode.prefault ? 1.0 : 0.0 }, { "huge_page_kb", static_cast<double>(huge_page_size >> 10) } };
+		if (mode.page_mode != SharedMemoryManager::PageMode::Default && !huge_page_size) {
+			result.metrics = { { "supported", 0.0 } };
+			pResults->push_back(result);
+			return;
+		}
+
+		double huge_kb_before = read_huge_kb();
+		uint64_t begin = GetNanoseconds();
+		auto holder = SharedMemoryManager::CreateSharedMemory("/cyhos_bench_pages", PAGES_BENCH_SIZE, options);
+		uint64_t created = GetNanoseconds();
+		auto pBytes = holder.get<unsigned char>();
+		if (!pBytes) {
+			result.metrics = { { "supported", 0.0 } };
+			pResults->push_back(result);
+			return;
+		}
+
+		// first touch, write one byte of each small page
+		nuint page_size = static_cast<nuint>(sysconf(_SC_PAGESIZE));
+		nuint page_count = PAGES_BENCH_SIZE / page_size;
+		for (nuint offset = 0; offset < PAGES_BENCH_SIZE; offset += page_size) {
+			pBytes[offset] = 1;
+		}
+		uint64_t touched = GetNanoseconds();
+		double huge_kb = read_huge_kb() - huge_kb_before;
+
+		// random access, dependent loads so each one pays its own tlb miss
+		auto pWords = holder.get<uint64_t>();
+		nuint word_count = PAGES_BENCH_SIZE / sizeof(uint64_t);
+		uint64_t state = 0x9E3779B97F4A7C15ull;
+		uint64_t sum = 0;
+		for (nuint i = 0; i < PAGES_BENCH_RANDOM_READS; ++i) {
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			sum += pWords[(state + sum) % word_count];
+		}
+		uint64_t accessed = GetNanoseconds();
+
+		result.metrics = {
+			{ "supported", 1.0 },
+			{ "create_ms", static_cast<double>(created - begin) / 1e6 },
+			{ "first_touch_ns_per_page", static_cast<double>(touched - created) / page_count },
+			{ "random_read_ns", static_cast<double>(accessed - touched) / PAGES_BENCH_RANDOM_READS },
+			{ "huge_backed_mb", huge_kb / 1024.0 },
+			{ "checksum", static_cast<double>(sum & 0xFF) }
+		};
+		pResults->push_back(result);
+	}
+	static void run_shm_pages_suite(std::vector<BenchResult>* pResults) {
+		const _pagesBenchMode modes[] = {
+			{ "default", SharedMemoryManager::PageMode::Default, false },
+			{ "default", SharedMemoryManager::PageMode::Default, true },
+			{ "transparent", SharedMemoryManager::PageMode::Transparent, false },
+			{ "transparent", SharedMemoryManager::PageMode::Transparent, true },
+			{ "hugetlbfs", SharedMemoryManager::PageMode::HugeTlbFs, false },
+			{ "hugetlbfs", SharedMemoryManager::PageMode::HugeTlbFs, true },
+		};
+		for (auto& mode : modes) {
+			run_pages_mode(mode, pResults);
+		}
+	}
+	CYHOS_BENCH_SUITE("shm_pages", run_shm_pages_suite);
+};
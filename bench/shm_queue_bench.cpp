@@ -0,0 +1,104 @@
+#include "bench.hpp"
+#include "cyh/os/shm_queue.hpp"
+#include <atomic>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace cyh::os;
+namespace cyh::bench {
+	static constexpr nuint QUEUE_BENCH_MESSAGES = 200000;
+
+	struct _queueBenchMessage {
+		uint64_t timestamp;
+		uint64_t sequence;
+	};
+	// Shared by all processes of a run, counters are only touched once per process
+	struct _queueBenchControl {
+		std::atomic<uint32_t> start;
+		std::atomic<uint32_t> producers_done;
+		std::atomic<uint64_t> consumed;
+		std::atomic<uint64_t> latency_sum;
+		std::atomic<uint64_t> latency_max;
+	};
+
+	static void run_queue_producer(SharedMpmcQueue* pQueue, _queueBenchControl* pControl, nuint count) {
+		while (!pControl->start.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+		for (nuint i = 0; i < count; ++i) {
+			_queueBenchMessage message{ GetNanoseconds(), i };
+			while (!pQueue->TryPush(&message, sizeof(message))) { std::this_thread::yield(); }
+		}
+		pControl->producers_done.fetch_add(1, std::memory_order_release);
+	}
+	static void run_queue_consumer(SharedMpmcQueue* pQueue, _queueBenchControl* pControl, uint producer_count) {
+		while (!pControl->start.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+		uint64_t consumed = 0;
+		uint64_t latency_sum = 0;
+		uint64_t latency_max = 0;
+		_queueBenchMessage message{};
+		nuint size{};
+		while (true) {
+			if (pQueue->TryPop(&message, sizeof(message), &size)) {
+				uint64_t latency = GetNanoseconds() - message.timestamp;
+				latency_sum += latency;
+				latency_max = latency > latency_max ? latency : latency_max;
+				++consumed;
+			} else if (pControl->producers_done.load(std::memory_order_acquire) == producer_count && !pQueue->size()) {
+				break;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+		pControl->consumed.fetch_add(consumed);
+		pControl->latency_sum.fetch_add(latency_sum);
+		uint64_t current = pControl->latency_max.load();
+		while (current < latency_max && !pControl->latency_max.compare_exchange_weak(current, latency_max)) {}
+	}
+	static void run_queue_sweep(uint producer_count, uint consumer_count, std::vector<BenchResult>* pResults) {
+		auto queue = SharedMpmcQueue::Create("/cyhos_bench_mpmc", 1024, sizeof(_queueBenchMessage));
+		auto controlMemory = SharedMemoryManager::CreateSharedMemory("/cyhos_bench_mpmc_ctl", sizeof(_queueBenchControl));
+		if (!queue.is_valid() || !controlMemory.data()) { return; }
+		auto pControl = new (controlMemory.data()) _queueBenchControl{};
+
+		nuint per_producer = QUEUE_BENCH_MESSAGES / producer_count;
+		std::vector<pid_t> children;
+		for (uint i = 0; i < producer_count + consumer_count; ++i) {
+			pid_t pid = fork();
+			if (pid == 0) {
+				// children share the mapping of the parent
+				if (i < producer_count) {
+					run_queue_producer(&queue, pControl, per_producer);
+				} else {
+					run_queue_consumer(&queue, pControl, producer_count);
+				}
+				_exit(0);
+			}
+			children.push_back(pid);
+		}
+		uint64_t begin = GetNanoseconds();
+		pControl->start.store(1, std::memory_order_release);
+		for (auto pid : children) {
+			waitpid(pid, nullptr, 0);
+		}
+		double seconds = static_cast<double>(GetNanoseconds() - begin) / 1e9;
+		uint64_t consumed = pControl->consumed.load();
+
+		BenchResult result{};
+		result.name = "mpmc_queue";
+		result.params = { { "producers", producer_count }, { "consumers", consumer_count }, { "messages", static_cast<double>(per_producer * producer_count) } };
+		result.metrics = {
+			{ "msgs_per_sec", consumed / seconds },
+			{ "latency_mean_ns", consumed ? static_cast<double>(pControl->latency_sum.load()) / consumed : 0.0 },
+			{ "latency_max_ns", static_cast<double>(pControl->latency_max.load()) },
+			{ "lost", static_cast<double>(per_producer * producer_count - consumed) }
+		};
+		pResults->push_back(result);
+	}
+	static void run_shm_queue_suite(std::vector<BenchResult>* pResults) {
+		for (uint producers : { 1u, 2u, 4u }) {
+			for (uint consumers : { 1u, 2u, 4u }) {
+				run_queue_sweep(producers, consumers, pResults);
+			}
+		}
+	}
+	CYHOS_BENCH_SUITE("shm_queue", run_shm_queue_suite);
+};
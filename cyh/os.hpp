@@ -1,4 +1,20 @@
 #pragma once
+#include "os/lib_stats.hpp"
+#include "os/mem_copy.hpp"
+#include "os/metrics_export.hpp"
 #include "os/proc_mon.hpp"
+#include "os/proc_root.hpp"
+#include "os/proc_sampler.hpp"
+#include "os/proc_scan.hpp"
+#include "os/proc_table.hpp"
 #include "os/res_mon.hpp"
-#include "os/shmem_mgr.hpp"
\ No newline at end of file
+#include "os/sample_history.hpp"
+#include "os/shmem_mgr.hpp"
+#include "os/shm_arena.hpp"
+#include "os/shm_broadcast.hpp"
+#include "os/shm_hashmap.hpp"
+#include "os/shm_queue.hpp"
+#include "os/shm_ring.hpp"
+#include "os/shm_slab.hpp"
+#include "os/shm_sync.hpp"
+#include "os/sys_snapshot.hpp"
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "lib_stats.hpp"
+#include "os_internal.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+namespace cyh::os {
+	static constexpr nuint STATS_COUNTER_COUNT = StatsInternal::COUNTER_COUNT;
+
+#ifdef CYHOS_ENABLE_STATS
+	// Counters of a thread, only written by the thread so an increment is a plain load and store
+	struct alignas(64) _threadStats {
+		std::atomic<uint64_t> m_values[STATS_COUNTER_COUNT]{};
+		_threadStats();
+		~_threadStats();
+	};
+	struct _statsRegistry {
+		std::mutex m_lock;
+		std::vector<_threadStats*> m_threads;
+		// counts of the threads already exited
+		uint64_t m_retired[STATS_COUNTER_COUNT]{};
+		// counts at the last Reset
+		uint64_t m_baseline[STATS_COUNTER_COUNT]{};
+	};
+	// Never destroyed, threads may exit after the static objects are destroyed
+	static _statsRegistry& get_stats_registry() {
+		static _statsRegistry* pRegistry = new _statsRegistry();
+		return *pRegistry;
+	}
+	_threadStats::_threadStats() {
+		auto& registry = get_stats_registry();
+		std::lock_guard<std::mutex> lock(registry.m_lock);
+		registry.m_threads.push_back(this);
+	}
+	_threadStats::~_threadStats() {
+		auto& registry = get_stats_registry();
+		std::lock_guard<std::mutex> lock(registry.m_lock);
+		for (nuint i = 0; i < STATS_COUNTER_COUNT; ++i) {
+			registry.m_retired[i] += this->m_values[i].load(std::memory_order_relaxed);
+		}
+		registry.m_threads.erase(std::find(registry.m_threads.begin(), registry.m_threads.end(), this));
+	}
+	static thread_local _threadStats t_stats;
+
+	// Called with the lock of registry held
+	static void sum_thread_stats(_statsRegistry* pRegistry, uint64_t* pTotals) {
+		for (nuint i = 0; i < STATS_COUNTER_COUNT; ++i) {
+			pTotals[i] = pRegistry->m_retired[i];
+		}
+		for (auto pThread : pRegistry->m_threads) {
+			for (nuint i = 0; i < STATS_COUNTER_COUNT; ++i) {
+				pTotals[i] += pThread->m_values[i].load(std::memory_order_relaxed);
+			}
+		}
+	}
+#endif
+
+	void StatsInternal::Add([[maybe_unused]] Counter counter, [[maybe_unused]] nuint value) {
+#ifdef CYHOS_ENABLE_STATS
+		auto& slot = t_stats.m_values[counter];
+		slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+#endif
+	}
+	uint64_t StatsInternal::GetNanoseconds() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	LibraryStats::Snapshot LibraryStats::GetSnapshot() {
+		Snapshot snapshot{};
+#ifdef CYHOS_ENABLE_STATS
+		uint64_t totals[STATS_COUNTER_COUNT]{};
+		auto& registry = get_stats_registry();
+		{
+			std::lock_guard<std::mutex> lock(registry.m_lock);
+			sum_thread_stats(&registry, totals);
+			for (nuint i = 0; i < STATS_COUNTER_COUNT; ++i) {
+				totals[i] -= registry.m_baseline[i];
+			}
+		}
+		snapshot.enabled = true;
+		snapshot.pids_scanned = static_cast<nuint>(totals[StatsInternal::PidsScanned]);
+		snapshot.files_opened = static_cast<nuint>(totals[StatsInternal::FilesOpened]);
+		snapshot.bytes_read = static_cast<nuint>(totals[StatsInternal::BytesRead]);
+		snapshot.parse_nanoseconds = static_cast<nuint>(totals[StatsInternal::ParseNanoseconds]);
+		snapshot.sleep_nanoseconds = static_cast<nuint>(totals[StatsInternal::SleepNanoseconds]);
+		snapshot.scans = static_cast<nuint>(totals[StatsInternal::Scans]);
+		snapshot.scan_nanoseconds = static_cast<nuint>(totals[StatsInternal::ScanNanoseconds]);
+#endif
+		return snapshot;
+	}
+	void LibraryStats::Reset() {
+#ifdef CYHOS_ENABLE_STATS
+		// the counters are only written by their threads, so the current totals become the baseline instead
+		auto& registry = get_stats_registry();
+		std::lock_guard<std::mutex> lock(registry.m_lock);
+		sum_thread_stats(&registry, registry.m_baseline);
+#endif
+	}
+};
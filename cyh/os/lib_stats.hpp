@@ -0,0 +1,38 @@
+#pragma once
+#include "os_.hpp"
+namespace cyh::os {
+	// Counters and timers of the sampling done by the library itself, to tell how much the monitors cost
+	// They are compiled in only with CYHOS_ENABLE_STATS ( the cmake option of the same name ),
+	// otherwise the hooks are empty and the snapshot is all zero
+	// Each thread counts into its own cache line without atomic read-modify-writes, the lines are summed on demand
+	struct LibraryStats {
+		struct Snapshot {
+			// false if compiled without CYHOS_ENABLE_STATS
+			bool enabled{};
+			// Processes read by GetProcessInfo, GetAllProcessInfo, GetProcessTable and ProcessSampler
+			nuint pids_scanned{};
+			// Files of procfs opened and the bytes read from them
+			nuint files_opened{};
+			nuint bytes_read{};
+			// Time parsing /proc/stat for the processor usages, not reading it
+			// It is timed per file only, the parsing of the files of each process is part of scan_nanoseconds
+			nuint parse_nanoseconds{};
+			// Time the monitors slept between two reads to measure a rate
+			nuint sleep_nanoseconds{};
+			// Count and total time of full scans of all processes, including their sleeps
+			nuint scans{};
+			nuint scan_nanoseconds{};
+		};
+		static constexpr bool IsEnabled() {
+#ifdef CYHOS_ENABLE_STATS
+			return true;
+#else
+			return false;
+#endif
+		}
+		// Sum of the counts of all threads, including the threads already exited
+		static Snapshot GetSnapshot();
+		// Start counting from 0 again
+		static void Reset();
+	};
+};
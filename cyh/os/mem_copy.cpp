@@ -0,0 +1,174 @@
+#include "mem_copy.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CYHOS_COPY_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CYHOS_TARGET_SSE2
+#define CYHOS_TARGET_AVX2
+#else
+// sse2 is not in the baseline of a 32 bit build
+#define CYHOS_TARGET_SSE2 __attribute__((target("sse2")))
+#define CYHOS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+namespace cyh::os {
+	using Isa = MemoryCopy::Isa;
+
+	// Whole cache lines are streamed, so the write combining buffers are flushed full
+	static constexpr nuint COPY_LINE_SIZE = 64;
+	// Bytes streamed per loop iteration
+	static constexpr nuint COPY_BLOCK_SIZE = 128;
+	// Each thread copies at least this many bytes, and the parts start on page boundaries
+	static constexpr nuint COPY_MIN_PART_SIZE = nuint(8) << 20;
+	static constexpr nuint COPY_PART_ALIGNMENT = 4096;
+	static constexpr uint COPY_DEFAULT_MAX_THREADS = 8;
+
+#ifdef CYHOS_COPY_X86
+	static Isa detect_copy_isa() {
+#ifdef _MSC_VER
+		int info[4]{};
+		__cpuid(info, 0);
+		int max_leaf = info[0];
+		__cpuid(info, 1);
+		bool has_sse2 = (info[3] & (1 << 26)) != 0;
+		// the os must save the ymm registers
+		bool has_avx = (info[2] & (1 << 28)) != 0 && (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+		bool has_avx2 = false;
+		if (has_avx && max_leaf >= 7) {
+			__cpuidex(info, 7, 0);
+			has_avx2 = (info[1] & (1 << 5)) != 0;
+		}
+#else
+		__builtin_cpu_init();
+		bool has_sse2 = __builtin_cpu_supports("sse2");
+		bool has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+		if (has_avx2) { return Isa::Avx2; }
+		if (has_sse2) { return Isa::Sse2; }
+		return Isa::None;
+	}
+	// dst is aligned to COPY_LINE_SIZE and size is a multiple of COPY_BLOCK_SIZE
+	CYHOS_TARGET_SSE2 static void stream_copy_sse2(unsigned char* dst, const unsigned char* src, nuint size) {
+		for (nuint offset = 0; offset < size; offset += COPY_BLOCK_SIZE) {
+			auto s = reinterpret_cast<const __m128i*>(src + offset);
+			auto d = reinterpret_cast<__m128i*>(dst + offset);
+			__m128i v0 = _mm_loadu_si128(s + 0);
+			__m128i v1 = _mm_loadu_si128(s + 1);
+			__m128i v2 = _mm_loadu_si128(s + 2);
+			__m128i v3 = _mm_loadu_si128(s + 3);
+			__m128i v4 = _mm_loadu_si128(s + 4);
+			__m128i v5 = _mm_loadu_si128(s + 5);
+			__m128i v6 = _mm_loadu_si128(s + 6);
+			__m128i v7 = _mm_loadu_si128(s + 7);
+			_mm_stream_si128(d + 0, v0);
+			_mm_stream_si128(d + 1, v1);
+			_mm_stream_si128(d + 2, v2);
+			_mm_stream_si128(d + 3, v3);
+			_mm_stream_si128(d + 4, v4);
+			_mm_stream_si128(d + 5, v5);
+			_mm_stream_si128(d + 6, v6);
+			_mm_stream_si128(d + 7, v7);
+		}
+	}
+	CYHOS_TARGET_AVX2 static void stream_copy_avx2(unsigned char* dst, const unsigned char* src, nuint size) {
+		for (nuint offset = 0; offset < size; offset += COPY_BLOCK_SIZE) {
+			auto s = reinterpret_cast<const __m256i*>(src + offset);
+			auto d = reinterpret_cast<__m256i*>(dst + offset);
+			__m256i v0 = _mm256_loadu_si256(s + 0);
+			__m256i v1 = _mm256_loadu_si256(s + 1);
+			__m256i v2 = _mm256_loadu_si256(s + 2);
+			__m256i v3 = _mm256_loadu_si256(s + 3);
+			_mm256_stream_si256(d + 0, v0);
+			_mm256_stream_si256(d + 1, v1);
+			_mm256_stream_si256(d + 2, v2);
+			_mm256_stream_si256(d + 3, v3);
+		}
+		// avoid the penalty of switching to sse code with dirty upper halves
+		_mm256_zeroupper();
+	}
+#endif
+	static void copy_non_temporal(unsigned char* dst, const unsigned char* src, nuint size, Isa isa) {
+#ifdef CYHOS_COPY_X86
+		// the unaligned head and tail are copied through the caches
+		nuint head = std::min(size, (COPY_LINE_SIZE - (reinterpret_cast<uintptr_t>(dst) & (COPY_LINE_SIZE - 1))) & (COPY_LINE_SIZE - 1));
+		memcpy(dst, src, head);
+		nuint body = (size - head) & ~(COPY_BLOCK_SIZE - 1);
+		if (isa == Isa::Avx2) {
+			stream_copy_avx2(dst + head, src + head, body);
+		} else {
+			stream_copy_sse2(dst + head, src + head, body);
+		}
+		// streamed stores are weakly ordered, make them visible before the copy is reported done
+		_mm_sfence();
+		memcpy(dst + head + body, src + head + body, size - head - body);
+#else
+		memcpy(dst, src, size);
+#endif
+	}
+	static void copy_part(unsigned char* dst, const unsigned char* src, nuint size, Isa isa) {
+		if (isa == Isa::None) {
+			memcpy(dst, src, size);
+		} else {
+			copy_non_temporal(dst, src, size, isa);
+		}
+	}
+
+	MemoryCopy::Isa MemoryCopy::GetSupportedIsa() {
+#ifdef CYHOS_COPY_X86
+		static const Isa isa = detect_copy_isa();
+		return isa;
+#else
+		return Isa::None;
+#endif
+	}
+	void MemoryCopy::Copy(void* dst, const void* src, nuint size) {
+		Copy(dst, src, size, CopyOptions{});
+	}
+	uint MemoryCopy::GetThreadCount(nuint size, const CopyOptions& options) {
+		if (options.max_threads == 1 || size < options.parallel_threshold) { return 1; }
+		uint max_threads = options.max_threads;
+		if (!max_threads) {
+			max_threads = std::min(std::thread::hardware_concurrency(), COPY_DEFAULT_MAX_THREADS);
+		}
+		// a thread costs tens of microseconds to start, so each part must be large
+		nuint thread_count = std::min<nuint>(std::max(max_threads, 1u), size / COPY_MIN_PART_SIZE);
+		return thread_count ? static_cast<uint>(thread_count) : 1;
+	}
+	void MemoryCopy::Copy(void* dst, const void* src, nuint size, const CopyOptions& options) {
+		if (!dst || !src || !size) { return; }
+		auto pDst = static_cast<unsigned char*>(dst);
+		auto pSrc = static_cast<const unsigned char*>(src);
+		Isa isa = Isa::None;
+		if (options.non_temporal_threshold && size >= options.non_temporal_threshold) {
+			isa = std::min(options.isa, GetSupportedIsa());
+		}
+
+		uint thread_count = GetThreadCount(size, options);
+		if (thread_count <= 1) {
+			copy_part(pDst, pSrc, size, isa);
+			return;
+		}
+
+		// parts end on page boundaries of dst, so no cache line is written by two threads, the last part takes the rest
+		nuint part_size = (size / thread_count + COPY_PART_ALIGNMENT - 1) & ~(COPY_PART_ALIGNMENT - 1);
+		nuint first_size = part_size - (reinterpret_cast<uintptr_t>(pDst) & (COPY_PART_ALIGNMENT - 1));
+		std::vector<std::thread> workers;
+		workers.reserve(thread_count - 1);
+		nuint begin = first_size;
+		for (uint i = 1; i < thread_count && begin < size; ++i) {
+			nuint length = i + 1 == thread_count ? size - begin : std::min(part_size, size - begin);
+			workers.emplace_back(copy_part, pDst + begin, pSrc + begin, length, isa);
+			begin += length;
+		}
+		copy_part(pDst, pSrc, first_size, isa);
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+};
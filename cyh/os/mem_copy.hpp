@@ -0,0 +1,39 @@
+#pragma once
+#include "os_.hpp"
+namespace cyh::os {
+	// Bulk copy for large buffers, such as moving payloads into or out of a shared memory
+	// A large copy is written with non temporal stores, which bypass the caches so it does not evict
+	// the working sets of other processes, and a very large copy can be split over several threads
+	// The instruction set is chosen at run time from the ones supported by the cpu
+	struct MemoryCopy {
+		// Instruction set of the non temporal stores
+		enum class Isa : uint {
+			// memcpy only, also used on cpus other than x86
+			None,
+			Sse2,
+			Avx2,
+			// The best one supported by the cpu
+			Auto
+		};
+		static constexpr nuint DEFAULT_NON_TEMPORAL_THRESHOLD = nuint(4) << 20;
+		static constexpr nuint DEFAULT_PARALLEL_THRESHOLD = nuint(64) << 20;
+		struct CopyOptions {
+			// Copies of at least this many bytes use non temporal stores, 0 never uses them
+			nuint non_temporal_threshold{ DEFAULT_NON_TEMPORAL_THRESHOLD };
+			// Copies of at least this many bytes are split over up to max_threads threads
+			nuint parallel_threshold{ DEFAULT_PARALLEL_THRESHOLD };
+			// 1 copies in the calling thread only, 0 uses the hardware concurrency
+			uint max_threads{ 1 };
+			// Lowered to the best one supported by the cpu
+			Isa isa{ Isa::Auto };
+		};
+
+		// The best instruction set supported by the cpu, detected once
+		static Isa GetSupportedIsa();
+		// Count of threads a copy of size bytes uses, a thread copies at least 8 MiB
+		static uint GetThreadCount(nuint size, const CopyOptions& options);
+		// Copy size bytes like memcpy, the buffers must not overlap
+		static void Copy(void* dst, const void* src, nuint size);
+		static void Copy(void* dst, const void* src, nuint size, const CopyOptions& options);
+	};
+};
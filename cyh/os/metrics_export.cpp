@@ -0,0 +1,483 @@
+#include "metrics_export.hpp"
+#include "os_internal.hpp"
+#include "proc_sampler.hpp"
+#include "res_mon.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#ifndef __WINDOWS_PLATFORM__
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+namespace cyh::os {
+	// Enough for any uint64_t and the shortest representation of any double
+	static constexpr nuint METRICS_NUMBER_SIZE = 32;
+	static constexpr const char* const METRICS_STATE_NAMES[] = { "user", "nice", "system", "idle", "iowait", "irq", "softirq", "steal" };
+	static_assert(std::size(METRICS_STATE_NAMES) == static_cast<nuint>(CpuState::Count), "a name is needed for each cpu state");
+
+	static void append_chars(std::vector<char>* pOut, std::string_view str) {
+		pOut->insert(pOut->end(), str.begin(), str.end());
+	}
+	// Label values escape backslash, double quote and line feed
+	static void append_label_value(std::vector<char>* pOut, std::string_view value) {
+		for (char c : value) {
+			switch (c) {
+			case '\\': append_chars(pOut, "\\\\"); break;
+			case '"': append_chars(pOut, "\\\""); break;
+			case '\n': append_chars(pOut, "\\n"); break;
+			default: pOut->push_back(c); break;
+			}
+		}
+	}
+	static void append_uint(std::vector<char>* pOut, uint64_t value) {
+		char number[METRICS_NUMBER_SIZE];
+		auto result = std::to_chars(number, number + sizeof(number), value);
+		pOut->insert(pOut->end(), number, result.ptr);
+	}
+
+	void MetricsWriter::append(std::string_view str) {
+		append_chars(&this->m_buffer, str);
+	}
+	void MetricsWriter::append_number(uint64_t value) {
+		append_uint(&this->m_buffer, value);
+	}
+	void MetricsWriter::append_number(double value) {
+		if (std::isnan(value)) {
+			this->append("NaN");
+			return;
+		}
+		if (std::isinf(value)) {
+			this->append(value > 0 ? "+Inf" : "-Inf");
+			return;
+		}
+		char number[METRICS_NUMBER_SIZE];
+		auto result = std::to_chars(number, number + sizeof(number), value);
+		this->m_buffer.insert(this->m_buffer.end(), number, result.ptr);
+	}
+	void MetricsWriter::append_family(const char* name, const char* type, const char* unit, const char* help) {
+		this->append("# TYPE ");
+		this->append(name);
+		this->append(" ");
+		this->append(type);
+		this->append("\n");
+		if (unit) {
+			this->append("# UNIT ");
+			this->append(name);
+			this->append(" ");
+			this->append(unit);
+			this->append("\n");
+		}
+		this->append("# HELP ");
+		this->append(name);
+		this->append(" ");
+		this->append(help);
+		this->append("\n");
+	}
+	template<class Fn>
+	void MetricsWriter::append_process_samples(const ProcessTable& table, std::string_view prefix, std::string_view suffix, bool sched_only, Fn fn) {
+		const char* pLabels = this->m_labels.data();
+		for (nuint i = 0; i < table.size(); ++i) {
+			auto view = table[i];
+			if (view.pid() == ~uint() || (sched_only && !view.sched())) { continue; }
+			this->append(prefix);
+			this->append(std::string_view(pLabels + this->m_label_offsets[i], this->m_label_offsets[i + 1] - this->m_label_offsets[i]));
+			this->append(suffix);
+			this->append_number(static_cast<double>(fn(view)));
+			this->append("\n");
+		}
+	}
+
+	void MetricsWriter::Clear() {
+		this->m_buffer.clear();
+	}
+	void MetricsWriter::WriteProcesses(const ProcessTable& table) {
+		// the label set of a process is escaped once and copied into each family
+		this->m_labels.clear();
+		this->m_label_offsets.clear();
+		this->m_label_offsets.push_back(0);
+		bool has_sched = false;
+		nuint live_count = 0;
+		for (nuint i = 0; i < table.size(); ++i) {
+			auto view = table[i];
+			// the process exited during the scan, an empty label set keeps the offsets indexed by record
+			if (view.pid() == ~uint()) {
+				this->m_label_offsets.push_back(this->m_labels.size());
+				continue;
+			}
+			++live_count;
+			append_chars(&this->m_labels, "pid=\"");
+			append_uint(&this->m_labels, view.pid());
+			append_chars(&this->m_labels, "\",name=\"");
+			append_label_value(&this->m_labels, view.name());
+			this->m_labels.push_back('"');
+			this->m_label_offsets.push_back(this->m_labels.size());
+			has_sched = has_sched || view.sched();
+		}
+		double seconds_per_unit = 1.0 / UnitConvert::GetCpuTimeUnitsPerSecond();
+
+		this->append_family("cyhos_processes", "gauge", nullptr, "Count of processes sampled.");
+		this->append("cyhos_processes ");
+		this->append_number(static_cast<uint64_t>(live_count));
+		this->append("\n");
+
+		this->append_family("cyhos_process_cpu_percent", "gauge", nullptr, "Cpu time of the process in percent of all processors since the previous sample.");
+		this->append_process_samples(table, "cyhos_process_cpu_percent{", "} ", false, [] (const ProcessTable::ProcessView& view) {
+			return view.cpu_time_percentage();
+		});
+		this->append_family("cyhos_process_memory_bytes", "gauge", "bytes", "Resident memory of the process.");
+		this->append_process_samples(table, "cyhos_process_memory_bytes{", "} ", false, [] (const ProcessTable::ProcessView& view) {
+			return view.memory();
+		});
+		this->append_family("cyhos_process_cpu_seconds", "counter", "seconds", "Cpu time of the process and its waited children.");
+		this->append_process_samples(table, "cyhos_process_cpu_seconds_total{", ",mode=\"user\"} ", false, [seconds_per_unit] (const ProcessTable::ProcessView& view) {
+			return static_cast<double>(view.user_time()) * seconds_per_unit;
+		});
+		this->append_process_samples(table, "cyhos_process_cpu_seconds_total{", ",mode=\"system\"} ", false, [seconds_per_unit] (const ProcessTable::ProcessView& view) {
+			return static_cast<double>(view.kernal_time()) * seconds_per_unit;
+		});
+		if (!has_sched) { return; }
+		this->append_family("cyhos_process_run_delay_seconds", "counter", "seconds", "Time the process spent runnable but waiting on a run queue.");
+		this->append_process_samples(table, "cyhos_process_run_delay_seconds_total{", "} ", true, [] (const ProcessTable::ProcessView& view) {
+			return static_cast<double>(view.sched()->run_delay) / 1e9;
+		});
+		this->append_family("cyhos_process_context_switches", "counter", nullptr, "Context switches of the process.");
+		this->append_process_samples(table, "cyhos_process_context_switches_total{", ",kind=\"voluntary\"} ", true, [] (const ProcessTable::ProcessView& view) {
+			return view.sched()->voluntary_ctxt_switches;
+		});
+		this->append_process_samples(table, "cyhos_process_context_switches_total{", ",kind=\"involuntary\"} ", true, [] (const ProcessTable::ProcessView& view) {
+			return view.sched()->nonvoluntary_ctxt_switches;
+		});
+	}
+	void MetricsWriter::WriteProcessorUsages(const double* pUsages, nuint count, const double* pStateUsages) {
+		this->append_family("cyhos_cpu_usage_percent", "gauge", nullptr, "Usage of the processor since the previous sample.");
+		for (nuint i = 0; i < count; ++i) {
+			this->append("cyhos_cpu_usage_percent{cpu=\"");
+			this->append_number(static_cast<uint64_t>(i));
+			this->append("\"} ");
+			this->append_number(pUsages[i]);
+			this->append("\n");
+		}
+		if (!pStateUsages) { return; }
+		this->append_family("cyhos_cpu_state_percent", "gauge", nullptr, "Time of the processor in each state since the previous sample.");
+		for (nuint i = 0; i < count; ++i) {
+			for (nuint s = 0; s < std::size(METRICS_STATE_NAMES); ++s) {
+				this->append("cyhos_cpu_state_percent{cpu=\"");
+				this->append_number(static_cast<uint64_t>(i));
+				this->append("\",state=\"");
+				this->append(METRICS_STATE_NAMES[s]);
+				this->append("\"} ");
+				this->append_number(pStateUsages[s * count + i]);
+				this->append("\n");
+			}
+		}
+	}
+	void MetricsWriter::WriteLogicDisks(const std::vector<LogicDiskInformation>& disks) {
+		this->append_family("cyhos_disk_io_time_percent", "gauge", nullptr, "Time the disk was busy with io since the previous sample.");
+		for (auto& disk : disks) {
+			this->append("cyhos_disk_io_time_percent{disk=\"");
+			append_label_value(&this->m_buffer, disk.mount_or_label);
+			this->append("\"} ");
+			this->append_number(disk.io_time_percentage);
+			this->append("\n");
+		}
+	}
+	void MetricsWriter::WriteMemoryStatus(const MemoryStatus& status) {
+		this->append_family("cyhos_memory_total_bytes", "gauge", "bytes", "Total memory, the pagefile includes the physical memory on unix.");
+		this->append("cyhos_memory_total_bytes{type=\"physical\"} ");
+		this->append_number(status.Physical.total);
+		this->append("\ncyhos_memory_total_bytes{type=\"pagefile\"} ");
+		this->append_number(status.Pagefile.total);
+		this->append("\n");
+		this->append_family("cyhos_memory_available_bytes", "gauge", "bytes", "Memory available without swapping.");
+		this->append("cyhos_memory_available_bytes{type=\"physical\"} ");
+		this->append_number(status.Physical.avail);
+		this->append("\ncyhos_memory_available_bytes{type=\"pagefile\"} ");
+		this->append_number(status.Pagefile.avail);
+		this->append("\n");
+	}
+	void MetricsWriter::WriteEof() {
+		this->append("# EOF\n");
+	}
+
+#ifndef __WINDOWS_PLATFORM__
+	// A scraper taking longer than this for its request and response together is dropped, the sampling waits for it meanwhile
+	static constexpr int METRICS_SERVE_TIMEOUT_MILLIS = 1000;
+	static constexpr nuint METRICS_REQUEST_SIZE = 4096;
+#endif
+
+	struct MetricsExporter::_exporterState {
+		MetricsWriter m_writer;
+		ProcessSampler m_sampler;
+		ProcessTable m_table;
+		std::vector<LogicDiskInformation> m_disks;
+		uint16_t m_port{};
+#ifndef __WINDOWS_PLATFORM__
+		_unixCpuSnapshot m_cpus[2];
+		nuint m_cpu_index{};
+		bool m_has_cpus{};
+		std::vector<_unixDiskInfo> m_disk_infos;
+		std::vector<double> m_usages;
+		std::vector<double> m_state_usages;
+		int m_listener{ -1 };
+		// Stop writes to m_wake[1] to wake the thread
+		int m_wake[2]{ -1, -1 };
+		std::string m_unix_path;
+		char m_request[METRICS_REQUEST_SIZE];
+#endif
+	};
+
+	MetricsExporter::MetricsExporter() : m_state(std::make_unique<_exporterState>()) {}
+	MetricsExporter::~MetricsExporter() {
+		this->Stop();
+#ifndef __WINDOWS_PLATFORM__
+		auto& state = *this->m_state;
+		if (state.m_listener >= 0) {
+			close(state.m_listener);
+			if (!state.m_unix_path.empty()) { unlink(state.m_unix_path.c_str()); }
+		}
+#endif
+	}
+	void MetricsExporter::sample() {
+		auto& state = *this->m_state;
+		auto& writer = state.m_writer;
+		writer.Clear();
+
+		// processors
+#ifdef __WINDOWS_PLATFORM__
+		auto usages = ResourceMonitor::GetAllProcessorUsage();
+		writer.WriteProcessorUsages(usages.data(), usages.size());
+#else
+		auto& previous = state.m_cpus[state.m_cpu_index];
+		auto& current = state.m_cpus[state.m_cpu_index ^ 1];
+		nuint cpu_count{};
+		if (UnixInfoParser::read_cpus_snapshot(&current)) {
+			if (state.m_has_cpus) {
+				state.m_usages.resize(current.size());
+				state.m_state_usages.resize(current.size() * static_cast<nuint>(CpuState::Count));
+				cpu_count = UnixInfoParser::calculate_cpus_usage(&previous, &current, state.m_usages.data(), state.m_state_usages.data(), current.size());
+			}
+			state.m_cpu_index ^= 1;
+			state.m_has_cpus = true;
+		}
+		writer.WriteProcessorUsages(state.m_usages.data(), cpu_count, state.m_state_usages.data());
+#endif
+
+		// memory
+		writer.WriteMemoryStatus(ResourceMonitor::GetMemoryStatus());
+
+		// disks
+#ifdef __WINDOWS_PLATFORM__
+		state.m_disks = ResourceMonitor::GetAllLogicDiskInfo();
+#else
+		auto disks = UnixInfoParser::read_disks_info();
+		nuint disk_count = disks.size() == state.m_disk_infos.size() ? disks.size() : 0;
+		// the strings of the previous sample keep their capacity
+		state.m_disks.resize(disk_count);
+		for (nuint i = 0; i < disk_count; ++i) {
+			state.m_disks[i].mount_or_label = disks[i].device;
+			state.m_disks[i].io_time_percentage = UnixInfoParser::calculate_disk_usage(&state.m_disk_infos[i], &disks[i]);
+		}
+		state.m_disk_infos = std::move(disks);
+#endif
+		writer.WriteLogicDisks(state.m_disks);
+
+		// processes
+		state.m_sampler.Sample(&state.m_table);
+		writer.WriteProcesses(state.m_table);
+		writer.WriteEof();
+	}
+	void MetricsExporter::Collect() {
+		if (this->m_thread.joinable()) { return; }
+		this->sample();
+	}
+	std::string_view MetricsExporter::view() const {
+		return this->m_state->m_writer.view();
+	}
+	uint16_t MetricsExporter::port() const {
+		return this->m_state->m_port;
+	}
+
+#ifdef __WINDOWS_PLATFORM__
+	bool MetricsExporter::ListenTcp(uint16_t, const char*) {
+		return false;
+	}
+	bool MetricsExporter::ListenUnix(const std::string&) {
+		return false;
+	}
+	bool MetricsExporter::is_listening() const {
+		return false;
+	}
+	bool MetricsExporter::Start(uint) {
+		return false;
+	}
+	void MetricsExporter::Stop() {}
+#else
+	bool MetricsExporter::ListenTcp(uint16_t port, const char* address) {
+		auto& state = *this->m_state;
+		if (state.m_listener >= 0 || !address) { return false; }
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) { return false; }
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) { return false; }
+		int reuse = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		socklen_t length = sizeof(addr);
+		if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0
+			|| getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+			close(fd);
+			return false;
+		}
+		state.m_listener = fd;
+		state.m_port = ntohs(addr.sin_port);
+		return true;
+	}
+	bool MetricsExporter::ListenUnix(const std::string& path) {
+		auto& state = *this->m_state;
+		sockaddr_un addr{};
+		if (state.m_listener >= 0 || path.empty() || path.size() >= sizeof(addr.sun_path)) { return false; }
+		addr.sun_family = AF_UNIX;
+		memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+		// a socket left by a previous run refuses the bind, anything else at path is kept
+		struct stat info {};
+		if (lstat(path.c_str(), &info) == 0) {
+			if (!S_ISSOCK(info.st_mode)) { return false; }
+			unlink(path.c_str());
+		}
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) { return false; }
+		if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+			close(fd);
+			return false;
+		}
+		state.m_listener = fd;
+		state.m_unix_path = path;
+		return true;
+	}
+	bool MetricsExporter::is_listening() const {
+		return this->m_state->m_listener >= 0;
+	}
+	// Wait for events on the connection until the deadline, return false if it passed
+	static bool wait_connection(int connection, short events, std::chrono::steady_clock::time_point deadline) {
+		while (true) {
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (remaining <= 0) { return false; }
+			pollfd fd{ connection, events, 0 };
+			int result = poll(&fd, 1, static_cast<int>(remaining));
+			if (result < 0 && errno == EINTR) { continue; }
+			return result > 0;
+		}
+	}
+	void MetricsExporter::serve(int connection) {
+		auto& state = *this->m_state;
+		// the whole connection shares one deadline, a client trickling bytes cannot extend it
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(METRICS_SERVE_TIMEOUT_MILLIS);
+
+		// read up to the end of the request head, a GET has no body
+		nuint size = 0;
+		while (size < METRICS_REQUEST_SIZE) {
+			if (!wait_connection(connection, POLLIN, deadline)) { break; }
+			auto count = recv(connection, state.m_request + size, METRICS_REQUEST_SIZE - size, MSG_DONTWAIT);
+			if (count < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) { continue; }
+			if (count <= 0) { break; }
+			size += static_cast<nuint>(count);
+			if (std::string_view(state.m_request, size).find("\r\n\r\n") != std::string_view::npos) { break; }
+		}
+		std::string_view request(state.m_request, size);
+		std::string_view body = state.m_writer.view();
+		const char* status = "200 OK";
+		bool is_head = request.substr(0, 5) == "HEAD ";
+		if (request.substr(0, 4) != "GET " && !is_head) {
+			status = "405 Method Not Allowed";
+			body = {};
+		} else {
+			auto begin = request.find(' ') + 1;
+			auto target = request.substr(begin, request.find_first_of(" ?", begin) - begin);
+			if (target != "/metrics" && target != "/") {
+				status = "404 Not Found";
+				body = {};
+			}
+		}
+		char head[256];
+		int head_size = snprintf(head, sizeof(head),
+			"HTTP/1.1 %s\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+			status, body.size());
+		if (is_head) { body = {}; }
+
+		// the head and the buffer are sent together without copying the buffer
+		iovec parts[2] = { { head, static_cast<nuint>(head_size) }, { const_cast<char*>(body.data()), body.size() } };
+		msghdr message{};
+		message.msg_iov = parts;
+		message.msg_iovlen = 2;
+		while (parts[0].iov_len + parts[1].iov_len > 0) {
+			auto sent = sendmsg(connection, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (sent < 0 && errno == EINTR) { continue; }
+			if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				if (!wait_connection(connection, POLLOUT, deadline)) { break; }
+				continue;
+			}
+			if (sent <= 0) { break; }
+			nuint remaining = static_cast<nuint>(sent);
+			for (auto& part : parts) {
+				nuint count = std::min(remaining, part.iov_len);
+				part.iov_base = static_cast<char*>(part.iov_base) + count;
+				part.iov_len -= count;
+				remaining -= count;
+			}
+			if (parts[0].iov_len == 0) {
+				message.msg_iov = parts + 1;
+				message.msg_iovlen = 1;
+			}
+		}
+		shutdown(connection, SHUT_WR);
+		close(connection);
+	}
+	void MetricsExporter::run(uint interval_millis) {
+		auto& state = *this->m_state;
+		auto next_sample = std::chrono::steady_clock::now();
+		while (true) {
+			auto now = std::chrono::steady_clock::now();
+			if (now >= next_sample) {
+				this->sample();
+				now = std::chrono::steady_clock::now();
+				next_sample = now + std::chrono::milliseconds(interval_millis);
+			}
+			int timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next_sample - now).count()) + 1;
+			pollfd fds[2] = { { state.m_listener, POLLIN, 0 }, { state.m_wake[0], POLLIN, 0 } };
+			if (poll(fds, 2, timeout) < 0 && errno != EINTR) { break; }
+			if (fds[1].revents) { break; }
+			if (fds[0].revents & POLLIN) {
+				int connection = accept4(state.m_listener, nullptr, nullptr, SOCK_CLOEXEC);
+				if (connection >= 0) { this->serve(connection); }
+			}
+		}
+	}
+	bool MetricsExporter::Start(uint interval_millis) {
+		auto& state = *this->m_state;
+		if (state.m_listener < 0 || this->m_thread.joinable()) { return false; }
+		if (pipe2(state.m_wake, O_CLOEXEC) != 0) { return false; }
+		this->m_thread = std::thread(&MetricsExporter::run, this, interval_millis);
+		return true;
+	}
+	void MetricsExporter::Stop() {
+		if (!this->m_thread.joinable()) { return; }
+		auto& state = *this->m_state;
+		char signal = 1;
+		while (write(state.m_wake[1], &signal, 1) < 0 && errno == EINTR) {}
+		this->m_thread.join();
+		close(state.m_wake[0]);
+		close(state.m_wake[1]);
+		state.m_wake[0] = state.m_wake[1] = -1;
+	}
+#endif
+};
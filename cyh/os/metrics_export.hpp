@@ -0,0 +1,79 @@
+#pragma once
+#include "os_.hpp"
+#include "proc_table.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+namespace cyh::os {
+	// Serialize samples in the OpenMetrics text format into a buffer reused across scrapes
+	// Numbers are written with std::to_chars and every sample line starts with a precomputed prefix,
+	// so once the buffer has grown to the size of a scrape, writing the next one allocates nothing
+	class MetricsWriter {
+		std::vector<char> m_buffer;
+		// label sets pid="..",name=".." of the processes without braces, record i is [m_label_offsets[i], m_label_offsets[i + 1])
+		std::vector<char> m_labels;
+		std::vector<nuint> m_label_offsets;
+
+		void append(std::string_view str);
+		void append_number(uint64_t value);
+		void append_number(double value);
+		// unit is nullptr for a family without unit
+		void append_family(const char* name, const char* type, const char* unit, const char* help);
+		// Append "prefix<labels of the process>suffix<value>" for each process, fn(ProcessView) returns the value
+		template<class Fn>
+		void append_process_samples(const ProcessTable& table, std::string_view prefix, std::string_view suffix, bool sched_only, Fn fn);
+	public:
+		// Remove the metrics written but keep the capacity
+		void Clear();
+		// Per process cpu percentage, memory, cpu seconds and the scheduling counters of the records having them
+		// Records of processes which exited during the scan ( pid ~uint() ) are skipped
+		void WriteProcesses(const ProcessTable& table);
+		// Usage of each processor in percent, pStateUsages is laid out as ResourceMonitor::GetAllProcessorUsage fills it with capacity count
+		void WriteProcessorUsages(const double* pUsages, nuint count, const double* pStateUsages = nullptr);
+		void WriteLogicDisks(const std::vector<LogicDiskInformation>& disks);
+		void WriteMemoryStatus(const MemoryStatus& status);
+		// Terminate the exposition, nothing should be written after it
+		void WriteEof();
+
+		std::string_view view() const { return std::string_view(this->m_buffer.data(), this->m_buffer.size()); }
+		nuint size() const { return this->m_buffer.size(); }
+	};
+
+	// Serve the metrics of the host to scrapers over a local http listener or a unix socket ( unix only )
+	// A background thread samples every interval and serializes the sample into a MetricsWriter,
+	// a scrape is answered with that buffer as it is, so the cost of a scrape does not grow with the sampling
+	class MetricsExporter {
+		struct _exporterState;
+		std::unique_ptr<_exporterState> m_state;
+		std::thread m_thread;
+
+		void sample();
+		// Answer a connection accepted from the listener, then close it
+		void serve(int connection);
+		void run(uint interval_millis);
+	public:
+		MetricsExporter();
+		MetricsExporter(const MetricsExporter&) = delete;
+		MetricsExporter& operator=(const MetricsExporter&) = delete;
+		~MetricsExporter();
+
+		// Listen for http on address:port, port 0 picks a free port reported by port(), return false if failed
+		bool ListenTcp(uint16_t port, const char* address = "127.0.0.1");
+		// Listen for http on a unix socket at path, a socket already at path is replaced, return false if failed or another file is at path
+		bool ListenUnix(const std::string& path);
+		bool is_listening() const;
+		// The port listened by ListenTcp, 0 for a unix socket
+		uint16_t port() const;
+
+		// Sample and serialize once on the calling thread, must not be called after Start
+		// Usages and rates are computed against the previous sample, so the first one has none
+		void Collect();
+		// The metrics serialized by the last Collect, must not be called after Start
+		std::string_view view() const;
+		// Sample every interval_millis and serve scrapes on a background thread until Stop
+		bool Start(uint interval_millis = 1000u);
+		void Stop();
+	};
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include <iostream>
+#include <optional>
 #include <vector>
 #include <type_traits>
 #if defined(_WIN32) || defined(_WIN64)
@@ -14,12 +15,31 @@ namespace cyh::os {
 	using nint = std::make_signed_t<size_t>;
 	using nuint = size_t;
 
+	// Index of the cpu state in the breakdown of processor usage
+	enum class CpuState : uint {
+		User, Nice, System, Idle, IOWait, Irq, SoftIrq, Steal, Count
+	};
 	struct MemoryStatus {
 		struct _details {
 			double total{};
 			double avail{};
 		} Physical, Pagefile;
 	};
+	// Scheduling counters of a process ( unix only )
+	struct ProcessSchedStat {
+		// Time spent runnable but waiting on a run queue in nanoseconds
+		nuint run_delay{};
+		nuint voluntary_ctxt_switches{};
+		nuint nonvoluntary_ctxt_switches{};
+		// The cpu the process last ran on
+		int processor{ -1 };
+		// The rates per second below are computed by ProcessSampler against its previous sample
+		bool has_rates{};
+		// Nanoseconds of run queue wait per second
+		double run_delay_rate{};
+		double voluntary_ctxt_switch_rate{};
+		double nonvoluntary_ctxt_switch_rate{};
+	};
 	struct ProcessInformation {
 		uint pid{};
 		std::string name;
@@ -27,12 +47,30 @@ namespace cyh::os {
 		nuint memory{};
 		nuint kernal_time{};
 		nuint user_time{};
+		// Cpu time of the process itself, kernal_time and user_time include the waited children on unix
+		// The cpu percentage is computed from it, so reaping a child does not show as a spike
+		nuint own_cpu_time{};
 		double cpu_time_percentage{};
+		// The time the process started, clock ticks after boot on unix and FILETIME on windows
+		nuint start_time{};
+		// Filled with details on unix
+		std::optional<ProcessSchedStat> sched;
+		// Full command line, filled with details on unix if ProcessMonitor::CollectArgv is set
+		std::optional<std::vector<std::string>> argv;
 	};
 	struct LogicDiskInformation {
 		std::string mount_or_label;
 		double io_time_percentage{};
 	};
+	// The key to group processes by
+	enum class ProcessGroupKey : uint {
+		// Name of the process
+		Comm,
+		// Resolved path of the executable, falls back to the name for kernel threads
+		Exe,
+		// Leading arguments of the command line, falls back to the name if the command line is empty
+		ArgvPrefix
+	};
 	struct ProcessGroup {
 		std::string name;
 		std::string path;
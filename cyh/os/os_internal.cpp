@@ -175,7 +175,48 @@ namespace cyh::os {
 #else
 #include "res_mon.hpp"
 #include "proc_mon.hpp"
+#include "proc_scan.hpp"
+#include <cstring>
 namespace cyh::os {
+	// Skip the first n fields separated by spaces
+	static const char* skip_fields(const char* cursor, nuint n) {
+		for (nuint i = 0; i < n && *cursor; ++i) {
+			while (*cursor == ' ') { ++cursor; }
+			while (*cursor && *cursor != ' ') { ++cursor; }
+		}
+		return cursor;
+	}
+	// Get the address of field (3) of [/proc/pid/stat], the comm in field (2) may contain spaces
+	static const char* skip_proc_stat_comm(const char* line) {
+		const char* comm_end = strrchr(line, ')');
+		if (!comm_end) { return nullptr; }
+		++comm_end;
+		while (*comm_end == ' ') { ++comm_end; }
+		return comm_end;
+	}
+
+	bool UnixInfoParser::read_file(const char* path, std::string* pOut) {
+		if (!path || !pOut) { return false; }
+		pOut->clear();
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0) { return false; }
+		CYHOS_STATS_ADD(FilesOpened, 1);
+		// files in procfs report size 0, so read by chunks until eof
+		constexpr nuint CHUNK_SIZE = 4096;
+		nuint length = 0;
+		while (true) {
+			if (pOut->size() < length + CHUNK_SIZE) {
+				pOut->resize(length + CHUNK_SIZE);
+			}
+			auto count = read(fd, pOut->data() + length, pOut->size() - length);
+			if (count <= 0) { break; }
+			length += static_cast<nuint>(count);
+		}
+		close(fd);
+		pOut->resize(length);
+		CYHOS_STATS_ADD(BytesRead, length);
+		return true;
+	}
 
 	void UnixInfoParser::read_unix_disk_info(_unixDiskInfo* pInfo, const std::string& rawStr) {
 		if (!pInfo) { return; }
@@ -193,20 +234,52 @@ namespace cyh::os {
 	void UnixInfoParser::read_unix_proc_info(_unixProcStat* pInfo, const std::string& rawStr) {
 		if (!pInfo) { return; }
 		_unixProcStat& info = *pInfo;
-		std::istringstream ss(rawStr);
-		std::string _proc;
-		ss >> info.pid >> _proc >> _proc >> info.ppid >> info.pgid
-			>> info.sid >> info.tty_nr >> info.tty_pgrp >> info.flags >> info.min_flt
-			>> info.cmin_flt >> info.maj_flt >> info.cmaj_flt >> info.utime >> info.stime
-			>> info.cutime >> info.cstime;
+		char* cursor{};
+		info.pid = strtol(rawStr.c_str(), &cursor, 10);
+		// the comm may contain spaces, continue from the state after it
+		const char* fields = skip_proc_stat_comm(rawStr.c_str());
+		if (!fields) { return; }
+		cursor = (char*)skip_fields(fields, 1);
+		long* pFields[] = {
+			&info.ppid, &info.pgid, &info.sid, &info.tty_nr, &info.tty_pgrp, &info.flags,
+			&info.min_flt, &info.cmin_flt, &info.maj_flt, &info.cmaj_flt,
+			&info.utime, &info.stime, &info.cutime, &info.cstime,
+			&info.priority, &info.nice, &info.num_threads, &info.it_real_value,
+			&info.start_time, &info.vsize, &info.rss, &info.rsslim,
+			&info.start_code, &info.end_code, &info.start_stack, &info.kstk_esp, &info.kstk_eip,
+			&info.signal, &info.blocked, &info.sig_ignore, &info.sig_catch, &info.wchan,
+			&info.nswap, &info.cnswap, &info.exit_signal, &info.processor
+		};
+		for (long* pField : pFields) {
+			*pField = strtol(cursor, &cursor, 10);
+		}
+	}
+	void UnixInfoParser::read_unix_proc_schedstat(_unixProcSchedStat* pInfo, const std::string& rawStr) {
+		if (!pInfo) { return; }
+		char* cursor{};
+		pInfo->run_time = strtol(rawStr.c_str(), &cursor, 10);
+		pInfo->run_delay = strtol(cursor, &cursor, 10);
+		pInfo->timeslices = strtol(cursor, &cursor, 10);
+	}
+	void UnixInfoParser::read_unix_proc_status_line(_unixProcSchedStat* pInfo, const std::string& line) {
+		if (!pInfo) { return; }
+		static constexpr char VOLUNTARY_KEY[] = "voluntary_ctxt_switches:";
+		static constexpr char NONVOLUNTARY_KEY[] = "nonvoluntary_ctxt_switches:";
+		if (line.compare(0, sizeof(VOLUNTARY_KEY) - 1, VOLUNTARY_KEY) == 0) {
+			pInfo->voluntary_ctxt_switches = strtol(line.c_str() + sizeof(VOLUNTARY_KEY) - 1, nullptr, 10);
+		} else if (line.compare(0, sizeof(NONVOLUNTARY_KEY) - 1, NONVOLUNTARY_KEY) == 0) {
+			pInfo->nonvoluntary_ctxt_switches = strtol(line.c_str() + sizeof(NONVOLUNTARY_KEY) - 1, nullptr, 10);
+		}
 	}
 
 	_unixDiskInfo UnixInfoParser::read_disk_info(const std::string& disk_label) {
 		_unixDiskInfo result{};
-		std::ifstream diskstats("/proc/diskstats");
+		std::ifstream diskstats(ProcfsPath::get("diskstats"));
 		std::string line;
 		if (diskstats.is_open()) {
+			CYHOS_STATS_ADD(FilesOpened, 1);
 			while (std::getline(diskstats, line)) {
+				CYHOS_STATS_ADD(BytesRead, line.size() + 1);
 				if (line.find(disk_label) != std::string::npos) {
 					read_unix_disk_info(&result, line);
 					break;
@@ -219,10 +292,12 @@ namespace cyh::os {
 	std::vector<_unixDiskInfo> UnixInfoParser::read_disks_info() {
 		std::vector<_unixDiskInfo> result{};
 
-		std::ifstream diskstats("/proc/diskstats");
+		std::ifstream diskstats(ProcfsPath::get("diskstats"));
 		std::string line;
 		if (diskstats.is_open()) {
+			CYHOS_STATS_ADD(FilesOpened, 1);
 			while (std::getline(diskstats, line)) {
+				CYHOS_STATS_ADD(BytesRead, line.size() + 1);
 				_unixDiskInfo diskUsage{};
 				read_unix_disk_info(&diskUsage, line);
 				result.push_back(diskUsage);
@@ -239,10 +314,12 @@ namespace cyh::os {
 
 	_unixCpuInfo UnixInfoParser::read_total_cpu_info() {
 		_unixCpuInfo info{};
-		std::ifstream file("/proc/stat");
+		std::ifstream file(ProcfsPath::get("stat"));
 		std::string line;
 		if (file.is_open()) {
+			CYHOS_STATS_ADD(FilesOpened, 1);
 			while (std::getline(file, line)) {
+				CYHOS_STATS_ADD(BytesRead, line.size() + 1);
 				if (line.find("cpu ") == 0) {
 					read_unix_cpu_info(&info, line);
 				} else {
@@ -257,13 +334,15 @@ namespace cyh::os {
 		auto cpu_count = ResourceMonitor::GetProcessorCount();
 
 		_unixCpuInfo result{};
-		std::ifstream file("/proc/stat");
+		std::ifstream file(ProcfsPath::get("stat"));
 		std::string line;
 
 		if (file.is_open()) {
+			CYHOS_STATS_ADD(FilesOpened, 1);
 			std::string key = "cpu";
 			key += std::to_string(cpu_no);
 			while (getline(file, line)) {
+				CYHOS_STATS_ADD(BytesRead, line.size() + 1);
 				auto begin_index = line.find("cpu");
 				// break if line is not start with cpu
 				if (begin_index == std::string::npos) {
@@ -284,14 +363,16 @@ namespace cyh::os {
 		auto cpu_count = ResourceMonitor::GetProcessorCount();
 
 		std::vector<_unixCpuInfo> result{};
-		std::ifstream file("/proc/stat");
+		std::ifstream file(ProcfsPath::get("stat"));
 		std::string line;
 		uint cpu_no = 0;
 
 		if (file.is_open()) {
+			CYHOS_STATS_ADD(FilesOpened, 1);
 			std::string key = "cpu";
 			key += std::to_string(cpu_no);
 			while (getline(file, line)) {
+				CYHOS_STATS_ADD(BytesRead, line.size() + 1);
 				auto begin_index = line.find("cpu");
 				// break if line is not start with cpu
 				if (begin_index == std::string::npos) {
@@ -316,19 +397,107 @@ namespace cyh::os {
 	}
 
 
+	bool UnixInfoParser::read_cpus_snapshot(_unixCpuSnapshot* pSnap) {
+		if (!pSnap) { return false; }
+		thread_local std::string buffer;
+		if (!read_file(ProcfsPath::get("stat").c_str(), &buffer)) { return false; }
+		CYHOS_STATS_SCOPE(ParseNanoseconds);
+		const char* begin = buffer.c_str();
+		const char* end = begin + buffer.size();
+
+		// count the cpus first, so the columns are laid out only once
+		nuint count = 0;
+		for (const char* line = begin; line < end;) {
+			// break if line is not start with cpu
+			if (strncmp(line, "cpu", 3) != 0) { break; }
+			if (isdigit(line[3])) { ++count; }
+			const char* next = (const char*)memchr(line, '\n', end - line);
+			if (!next) { break; }
+			line = next + 1;
+		}
+		pSnap->resize(count);
+
+		long* columns[_unixCpuSnapshot::COLUMN_COUNT];
+		for (nuint c = 0; c < _unixCpuSnapshot::COLUMN_COUNT; ++c) {
+			columns[c] = pSnap->column(static_cast<CpuState>(c));
+		}
+		nuint cpu_no = 0;
+		for (const char* line = begin; line < end && cpu_no < count;) {
+			if (strncmp(line, "cpu", 3) != 0) { break; }
+			if (isdigit(line[3])) {
+				char* cursor{};
+				strtol(line + 3, &cursor, 10);
+				for (nuint c = 0; c < _unixCpuSnapshot::COLUMN_COUNT; ++c) {
+					columns[c][cpu_no] = strtol(cursor, &cursor, 10);
+				}
+				++cpu_no;
+			}
+			const char* next = (const char*)memchr(line, '\n', end - line);
+			if (!next) { break; }
+			line = next + 1;
+		}
+		return true;
+	}
+	nuint UnixInfoParser::calculate_cpus_usage(const _unixCpuSnapshot* pSnap1, const _unixCpuSnapshot* pSnap2, double* pUsages, double* pStateUsages, nuint state_stride) {
+		if (!pSnap1 || !pSnap2 || !pUsages) { return 0; }
+		nuint count = pSnap1->size();
+		if (!count || count != pSnap2->size()) { return 0; }
+		if (state_stride < count) { state_stride = count; }
+
+		// accumulate delta total time of each cpu in the output buffer first
+		for (nuint i = 0; i < count; ++i) {
+			pUsages[i] = 0.0;
+		}
+		for (nuint c = 0; c < _unixCpuSnapshot::COLUMN_COUNT; ++c) {
+			const long* col1 = pSnap1->column(static_cast<CpuState>(c));
+			const long* col2 = pSnap2->column(static_cast<CpuState>(c));
+			for (nuint i = 0; i < count; ++i) {
+				pUsages[i] += static_cast<double>(col2[i] - col1[i]);
+			}
+		}
+		if (pStateUsages) {
+			for (nuint c = 0; c < _unixCpuSnapshot::COLUMN_COUNT; ++c) {
+				const long* col1 = pSnap1->column(static_cast<CpuState>(c));
+				const long* col2 = pSnap2->column(static_cast<CpuState>(c));
+				double* pStates = pStateUsages + c * state_stride;
+				for (nuint i = 0; i < count; ++i) {
+					double total = pUsages[i];
+					pStates[i] = total > 0.0 ? static_cast<double>(col2[i] - col1[i]) / total * 100.0 : 0.0;
+				}
+			}
+		}
+		const long* idle1 = pSnap1->column(CpuState::Idle);
+		const long* idle2 = pSnap2->column(CpuState::Idle);
+		for (nuint i = 0; i < count; ++i) {
+			double total = pUsages[i];
+			double idle = static_cast<double>(idle2[i] - idle1[i]);
+			pUsages[i] = total > 0.0 ? (total - idle) / total * 100.0 : 0.0;
+		}
+		return count;
+	}
+
 	_unixProcStat UnixInfoParser::read_proc_stat(uint pid) {
 		_unixProcStat procInfo{};
-		std::string basePath = "/proc/";
-		basePath += std::to_string(pid);
-		std::ifstream stat_file(basePath + "/stat");
+		thread_local std::string path;
+		std::ifstream stat_file(ProcfsPath::get(pid, "stat", &path));
 		std::string line;
 		if (stat_file.is_open()) {
+			CYHOS_STATS_ADD(FilesOpened, 1);
 			std::getline(stat_file, line);
+			CYHOS_STATS_ADD(BytesRead, line.size() + 1);
 			read_unix_proc_info(&procInfo, line);
 			stat_file.close();
 		}
 		return procInfo;
 	}
+	bool UnixInfoParser::read_proc_schedstat(uint pid, _unixProcSchedStat* pInfo) {
+		if (!pInfo) { return false; }
+		thread_local std::string buffer;
+		thread_local std::string path;
+		if (!read_file(ProcfsPath::get(pid, "schedstat", &path), &buffer) || buffer.empty()) { return false; }
+		read_unix_proc_schedstat(pInfo, buffer);
+		return true;
+	}
 	std::vector<_unixProcStat> UnixInfoParser::read_procs_stat() {
 		std::vector<_unixProcStat> result;
 		auto pids = ProcessMonitor::GetProcessIDs();
@@ -343,6 +512,49 @@ namespace cyh::os {
 		long total_proc_delta = pInfo1->total_cpu_time() - pInfo1->total_cpu_time();
 		return static_cast<double>(total_proc_delta) / static_cast<double>(total_cpu_delta);
 	}
+	bool UnixInfoParser::read_proc_time(uint pid, long* pUtime, long* pStime) {
+		if (!pUtime || !pStime) { return false; }
+		*pUtime = 0;
+		*pStime = 0;
+		thread_local std::string buffer;
+		thread_local std::string path;
+		if (!read_file(ProcfsPath::get(pid, "stat", &path), &buffer)) { return false; }
+		const char* cursor = skip_proc_stat_comm(buffer.c_str());
+		if (!cursor) { return false; }
+		// field (3) to (13)
+		cursor = skip_fields(cursor, 11);
+		char* next{};
+		*pUtime = strtol(cursor, &next, 10);
+		*pStime = strtol(next, &next, 10);
+		return true;
+	}
+	void UnixInfoParser::read_procs_time(const uint* ppids, nuint count, _unixProcTimeSnapshot* pSnap) {
+		if (!pSnap) { return; }
+		if (!ppids) { count = 0; }
+		pSnap->resize(count);
+		long* pUtime = pSnap->utime.data();
+		long* pStime = pSnap->stime.data();
+		ProcessScanner::ParallelFor(count, [=] (nuint begin, nuint end, uint) {
+			for (nuint i = begin; i < end; ++i) {
+				read_proc_time(ppids[i], pUtime + i, pStime + i);
+			}
+		});
+	}
+	void UnixInfoParser::calculate_procs_cpu_usage(const _unixProcTimeSnapshot* pSnap1, const _unixProcTimeSnapshot* pSnap2, double cpu_delta_time, double* pUsages) {
+		if (!pSnap1 || !pSnap2 || !pUsages) { return; }
+		nuint count = pSnap1->size() < pSnap2->size() ? pSnap1->size() : pSnap2->size();
+		const long* pUtime1 = pSnap1->utime.data();
+		const long* pStime1 = pSnap1->stime.data();
+		const long* pUtime2 = pSnap2->utime.data();
+		const long* pStime2 = pSnap2->stime.data();
+		double ratio = cpu_delta_time > 0.0 ? 100.0 / cpu_delta_time : 0.0;
+		for (nuint i = 0; i < count; ++i) {
+			long delta = (pUtime2[i] - pUtime1[i]) + (pStime2[i] - pStime1[i]);
+			// the process vanished between the snapshots
+			delta = delta < 0 ? 0 : delta;
+			pUsages[i] = static_cast<double>(delta) * ratio;
+		}
+	}
 };
 #endif
 namespace cyh::os {
@@ -369,4 +581,44 @@ namespace cyh::os {
 		}
 		return result;
 	}
+	double UnitConvert::GetCpuTimeUnitsPerSecond() {
+#ifdef __WINDOWS_PLATFORM__
+		// FILETIME is in 100 nanoseconds
+		return 10000000.0;
+#else
+		static double result = static_cast<double>(sysconf(_SC_CLK_TCK));
+		return result;
+#endif
+	}
+};
+namespace cyh::os {
+	void CmdlineConvert::Split(std::string_view cmdline, std::vector<std::string>* pArgv) {
+		if (!pArgv) { return; }
+		pArgv->clear();
+		while (!cmdline.empty()) {
+			auto end = cmdline.find('\0');
+			pArgv->emplace_back(cmdline.substr(0, end));
+			if (end == std::string_view::npos) { break; }
+			cmdline.remove_prefix(end + 1);
+		}
+	}
+	void CmdlineConvert::Join(const std::vector<std::string>& argv, std::string* pCmdline) {
+		if (!pCmdline) { return; }
+		pCmdline->clear();
+		for (nuint i = 0; i < argv.size(); ++i) {
+			if (i) { pCmdline->push_back('\0'); }
+			pCmdline->append(argv[i]);
+		}
+	}
+	void CmdlineConvert::JoinPrefix(std::string_view cmdline, uint count, std::string* pOut) {
+		if (!pOut) { return; }
+		pOut->clear();
+		for (uint i = 0; i < count && !cmdline.empty(); ++i) {
+			auto end = cmdline.find('\0');
+			if (i) { pOut->push_back(' '); }
+			pOut->append(cmdline.substr(0, end));
+			if (end == std::string_view::npos) { break; }
+			cmdline.remove_prefix(end + 1);
+		}
+	}
 };
@@ -1,5 +1,7 @@
 #pragma once
 #include "os_.hpp"
+#include <cstdint>
+#include <string_view>
 #ifdef __WINDOWS_PLATFORM__
 #include <Windows.h>
 #include <pdh.h>
@@ -19,6 +21,32 @@ namespace cyh::os {
 	struct GlobalVariables {
 		static uint ProbingTime;
 	};
+	// Hooks counting into LibraryStats, used through the macros below which are empty without CYHOS_ENABLE_STATS
+	struct StatsInternal {
+		enum Counter : uint {
+			PidsScanned, FilesOpened, BytesRead, ParseNanoseconds, SleepNanoseconds, Scans, ScanNanoseconds, COUNTER_COUNT
+		};
+		// Add to the counter of the calling thread
+		static void Add(Counter counter, nuint value);
+		static uint64_t GetNanoseconds();
+		// Add the time spent in its scope to the counter
+		class ScopedTimer {
+			Counter m_counter;
+			uint64_t m_begin;
+		public:
+			explicit ScopedTimer(Counter counter) : m_counter(counter), m_begin(GetNanoseconds()) {}
+			~ScopedTimer() { Add(this->m_counter, GetNanoseconds() - this->m_begin); }
+		};
+	};
+#ifdef CYHOS_ENABLE_STATS
+#define CYHOS_STATS_CONCAT_(a, b) a##b
+#define CYHOS_STATS_CONCAT(a, b) CYHOS_STATS_CONCAT_(a, b)
+#define CYHOS_STATS_ADD(counter, value) ::cyh::os::StatsInternal::Add(::cyh::os::StatsInternal::counter, value)
+#define CYHOS_STATS_SCOPE(counter) ::cyh::os::StatsInternal::ScopedTimer CYHOS_STATS_CONCAT(_cyhos_stats_scope_, __LINE__)(::cyh::os::StatsInternal::counter)
+#else
+#define CYHOS_STATS_ADD(counter, value) ((void)0)
+#define CYHOS_STATS_SCOPE(counter) ((void)0)
+#endif
 #ifdef __WINDOWS_PLATFORM__
 	class WinPerfmonQuery {
 	protected:
@@ -79,6 +107,31 @@ namespace cyh::os {
 			return this->idle;
 		}
 	};
+	// Counters of all cpus in [/proc/stat], stored as one column per state
+	// The order of columns is the same as CpuState
+	struct _unixCpuSnapshot {
+		static constexpr nuint COLUMN_COUNT = static_cast<nuint>(CpuState::Count);
+		std::vector<long> m_data;
+		nuint m_count{};
+		nuint size() const { return this->m_count; }
+		void resize(nuint count) {
+			this->m_data.resize(count * COLUMN_COUNT);
+			this->m_count = count;
+		}
+		long* column(CpuState state) { return this->m_data.data() + static_cast<nuint>(state) * this->m_count; }
+		const long* column(CpuState state) const { return this->m_data.data() + static_cast<nuint>(state) * this->m_count; }
+	};
+	// utime/stime of processes, stored as one column per counter
+	// Snapshots to compare must be read with the same pid list
+	struct _unixProcTimeSnapshot {
+		std::vector<long> utime;
+		std::vector<long> stime;
+		nuint size() const { return this->utime.size(); }
+		void resize(nuint count) {
+			this->utime.resize(count);
+			this->stime.resize(count);
+		}
+	};
 	struct _unixProcStat {
 		// (1) Process ID
 		long pid;
@@ -131,14 +184,66 @@ namespace cyh::os {
 		long rss;
 		// (25) Current soft limit in bytes on the rss of the process
 		long rsslim;
+		// (26) The address above which program text can run
+		long start_code;
+		// (27) The address below which program text can run
+		long end_code;
+		// (28) The address of the start (i.e., bottom) of the stack
+		long start_stack;
+		// (29) The current value of ESP (stack pointer), as found in the kernel stack page for the process
+		long kstk_esp;
+		// (30) The current EIP (instruction pointer)
+		long kstk_eip;
+		// (31) The bitmap of pending signals, displayed as a decimal number. Obsolete
+		long signal;
+		// (32) The bitmap of blocked signals, displayed as a decimal number. Obsolete
+		long blocked;
+		// (33) The bitmap of ignored signals, displayed as a decimal number. Obsolete
+		long sig_ignore;
+		// (34) The bitmap of caught signals, displayed as a decimal number. Obsolete
+		long sig_catch;
+		// (35) This is the "channel" in which the process is waiting
+		long wchan;
+		// (36) Number of pages swapped (not maintained)
+		long nswap;
+		// (37) Cumulative nswap for child processes (not maintained)
+		long cnswap;
+		// (38) Signal to be sent to parent when we die
+		long exit_signal;
+		// (39) CPU number last executed on
+		long processor;
 		long total_cpu_time() const {
 			return this->stime + this->utime + this->cstime + this->cutime;
 		}
 	};
+	// Counters of [/proc/pid/schedstat] and context switches in [/proc/pid/status]
+	struct _unixProcSchedStat {
+		// time spent on the cpu in nanoseconds
+		long run_time;
+		// time spent waiting on a run queue in nanoseconds
+		long run_delay;
+		// count of timeslices run on the cpu
+		long timeslices;
+		long voluntary_ctxt_switches;
+		long nonvoluntary_ctxt_switches;
+	};
+	// Paths in procfs under the root set by ProcfsRoot
+	struct ProcfsPath {
+		// <root>/<name>
+		static std::string get(const char* name);
+		// <root>/<pid>/<name>, or <root>/<pid> if name is null, into *pOut to reuse its capacity, return pOut->c_str()
+		static const char* get(uint pid, const char* name, std::string* pOut);
+	};
 	struct UnixInfoParser {
+		// read whole file into pOut, the capacity of pOut is reused
+		static bool read_file(const char* path, std::string* pOut);
+
 		static void read_unix_disk_info(_unixDiskInfo* pInfo, const std::string& rawStr);
 		static void read_unix_cpu_info(_unixCpuInfo* pInfo, const std::string& rawStr);
 		static void read_unix_proc_info(_unixProcStat* pInfo, const std::string& rawStr);
+		static void read_unix_proc_schedstat(_unixProcSchedStat* pInfo, const std::string& rawStr);
+		// read the fields of context switches only, other lines are ignored
+		static void read_unix_proc_status_line(_unixProcSchedStat* pInfo, const std::string& line);
 
 		// read [/proc/diskstats]
 		static _unixDiskInfo read_disk_info(const std::string& disk_label);
@@ -153,14 +258,37 @@ namespace cyh::os {
 		// read [/proc/stat]
 		static std::vector<_unixCpuInfo> read_cpus_info();
 		static double calculate_cpu_usage(_unixCpuInfo* pInfo1, _unixCpuInfo* pInfo2);
+		// read [/proc/stat]
+		static bool read_cpus_snapshot(_unixCpuSnapshot* pSnap);
+		// Write usage of each cpu to pUsages in a single pass over the columns
+		// If pStateUsages is not null, usage of state s of cpu i is written to pStateUsages[s * state_stride + i]
+		// Return the count of cpus written, or 0 if the snapshots are not comparable
+		static nuint calculate_cpus_usage(const _unixCpuSnapshot* pSnap1, const _unixCpuSnapshot* pSnap2, double* pUsages, double* pStateUsages = nullptr, nuint state_stride = 0);
 
 		// read [/proc/pid/stat]
 		static _unixProcStat read_proc_stat(uint pid);
+		// read [/proc/pid/schedstat], the context switches are not touched
+		static bool read_proc_schedstat(uint pid, _unixProcSchedStat* pInfo);
 		static std::vector<_unixProcStat> read_procs_stat();
 		static double calculate_proc_cpu_usage(_unixProcStat* pInfo1, _unixProcStat* pInfo2, _unixCpuInfo* pCInfo1, _unixCpuInfo* pCInfo2);
+		// read utime/stime in [/proc/pid/stat], return false if the process vanished
+		static bool read_proc_time(uint pid, long* pUtime, long* pStime);
+		// read [/proc/pid/stat] of each pid in parallel, the vanished process is recorded as 0
+		static void read_procs_time(const uint* ppids, nuint count, _unixProcTimeSnapshot* pSnap);
+		// Write the percentage of (utime + stime) delta to cpu_delta_time for each process
+		static void calculate_procs_cpu_usage(const _unixProcTimeSnapshot* pSnap1, const _unixProcTimeSnapshot* pSnap2, double cpu_delta_time, double* pUsages);
 	};
 #endif
 	struct UnitConvert {
 		static double GetRatioToByte(const std::string unit);
+		// Units of ProcessInformation::kernal_time and user_time per second
+		static double GetCpuTimeUnitsPerSecond();
+	};
+	// Convert the command line stored as arguments separated by '\0'
+	struct CmdlineConvert {
+		static void Split(std::string_view cmdline, std::vector<std::string>* pArgv);
+		static void Join(const std::vector<std::string>& argv, std::string* pCmdline);
+		// Join the leading count arguments by spaces
+		static void JoinPrefix(std::string_view cmdline, uint count, std::string* pOut);
 	};
 };
@@ -1,15 +1,93 @@
 #include "proc_mon.hpp"
+#include "proc_scan.hpp"
 #include "res_mon.hpp"
 #include "os_internal.hpp"
-#include <map>
+#include "proc_root.hpp"
+#include <algorithm>
 #ifdef __WINDOWS_PLATFORM__
 #include <tlhelp32.h>
 #include <Psapi.h>
 #include <string>
 #else
 #include <future>
+#include <mutex>
+#include <unordered_map>
+#include <climits>
 #endif
 namespace cyh::os {
+#ifndef __WINDOWS_PLATFORM__
+	// Strings of processes resolved once per lifetime, a process is identified by (pid, start_time)
+	// Sharded by pid to keep the workers of a parallel scan from contending
+	class _procIdentityCache {
+		struct _identity {
+			nuint start_time{};
+			std::string exe;
+			// arguments separated by '\0'
+			std::string cmdline;
+		};
+		static constexpr nuint SHARD_COUNT = 16;
+		static constexpr nuint MIN_SWEEP_THRESHOLD = 256;
+		struct alignas(64) _shard {
+			std::mutex m_lock;
+			std::unordered_map<uint, _identity> m_items;
+			nuint m_sweep_threshold{ MIN_SWEEP_THRESHOLD };
+		};
+		_shard m_shards[SHARD_COUNT];
+
+		// Drop the entries of exited processes, called with the lock of shard held
+		static void sweep(_shard* pShard) {
+			std::string path;
+			for (auto it = pShard->m_items.begin(); it != pShard->m_items.end();) {
+				if (access(ProcfsPath::get(it->first, nullptr, &path), F_OK) != 0) {
+					it = pShard->m_items.erase(it);
+				} else {
+					++it;
+				}
+			}
+			pShard->m_sweep_threshold = std::max(MIN_SWEEP_THRESHOLD, pShard->m_items.size() * 2);
+		}
+		static void resolve(uint pid, _identity* pIdentity) {
+			std::string path;
+			char exe[PATH_MAX];
+			auto length = readlink(ProcfsPath::get(pid, "exe", &path), exe, sizeof(exe));
+			if (length > 0) {
+				pIdentity->exe.assign(exe, static_cast<nuint>(length));
+			}
+			UnixInfoParser::read_file(ProcfsPath::get(pid, "cmdline", &path), &pIdentity->cmdline);
+			while (!pIdentity->cmdline.empty() && pIdentity->cmdline.back() == '\0') {
+				pIdentity->cmdline.pop_back();
+			}
+		}
+	public:
+		// Copy the cached strings out, resolve them from procfs on miss
+		void get(uint pid, nuint start_time, std::string* pExe, std::string* pCmdline) {
+			_shard& shard = this->m_shards[pid % SHARD_COUNT];
+			{
+				std::lock_guard<std::mutex> lock(shard.m_lock);
+				auto it = shard.m_items.find(pid);
+				if (it != shard.m_items.end() && it->second.start_time == start_time) {
+					*pExe = it->second.exe;
+					*pCmdline = it->second.cmdline;
+					return;
+				}
+			}
+			_identity identity{};
+			identity.start_time = start_time;
+			resolve(pid, &identity);
+			*pExe = identity.exe;
+			*pCmdline = identity.cmdline;
+			std::lock_guard<std::mutex> lock(shard.m_lock);
+			if (shard.m_items.size() >= shard.m_sweep_threshold) {
+				sweep(&shard);
+			}
+			shard.m_items[pid] = std::move(identity);
+		}
+		static _procIdentityCache& instance() {
+			static _procIdentityCache cache{};
+			return cache;
+		}
+	};
+#endif
 	using FnCloseHandle = void(*)(void*);
 	static void close_win_handle(void* handle) {
 #ifdef __WINDOWS_PLATFORM__
@@ -31,8 +109,7 @@ namespace cyh::os {
 		}
 		*p_callback_closeHandle = close_win_handle;
 #else		
-		unixPath = "/proc/";
-		unixPath += std::to_string(pid);
+		ProcfsPath::get(pid, nullptr, &unixPath);
 		if (!std::filesystem::exists(unixPath)) {
 			return false;
 		}
@@ -53,7 +130,9 @@ namespace cyh::os {
 		{
 			std::ifstream comm_file(basePath + "/comm");
 			if (comm_file.is_open()) {
+				CYHOS_STATS_ADD(FilesOpened, 1);
 				std::getline(comm_file, pinfo->name);
+				CYHOS_STATS_ADD(BytesRead, pinfo->name.size() + 1);
 				comm_file.close();
 			}
 		}
@@ -75,36 +154,59 @@ namespace cyh::os {
 		if (GetProcessTimes(hProcess, &creationTime, &exitTime, &kernelTime, &userTime)) {
 			pinfo->kernal_time = (((ULONGLONG)kernelTime.dwHighDateTime) << 32) + kernelTime.dwLowDateTime;
 			pinfo->user_time = (((ULONGLONG)userTime.dwHighDateTime) << 32) + userTime.dwLowDateTime;
+			// the times of GetProcessTimes exclude the children
+			pinfo->own_cpu_time = pinfo->kernal_time + pinfo->user_time;
+			pinfo->start_time = (((ULONGLONG)creationTime.dwHighDateTime) << 32) + creationTime.dwLowDateTime;
 		}
 #else
+		_unixProcStat stat = UnixInfoParser::read_proc_stat(pinfo->pid);
+		pinfo->user_time = stat.utime + stat.cutime;
+		pinfo->kernal_time = stat.stime + stat.cstime;
+		pinfo->own_cpu_time = stat.utime + stat.stime;
+		pinfo->start_time = stat.start_time;
 		{
-			std::ifstream cmdline_file(basePath + "/cmdline");
-			if (cmdline_file.is_open()) {
-				std::getline(cmdline_file, pinfo->path, '\0');
-				cmdline_file.close();
+			thread_local std::string exe;
+			thread_local std::string cmdline;
+			_procIdentityCache::instance().get(pinfo->pid, stat.start_time, &exe, &cmdline);
+			// fall back to argv[0] if the executable is not accessible
+			if (!exe.empty()) {
+				pinfo->path = exe;
+			} else if (!cmdline.empty()) {
+				pinfo->path.assign(cmdline.c_str());
+			}
+			if (ProcessMonitor::CollectArgv) {
+				CmdlineConvert::Split(cmdline, &pinfo->argv.emplace());
 			}
 		}
+		_unixProcSchedStat schedStat{};
 		{
 			std::ifstream status_file(basePath + "/status");
 			if (status_file.is_open()) {
+				CYHOS_STATS_ADD(FilesOpened, 1);
 				std::string line;
 				while (std::getline(status_file, line)) {
+					CYHOS_STATS_ADD(BytesRead, line.size() + 1);
 					if (line.compare(0, 6, "VmRSS:") == 0) {
 						std::istringstream iss(line);
 						std::string key, unit;
 						long value{};
 						iss >> key >> value >> unit;
 						pinfo->memory = UnitConvert::GetRatioToByte(unit) * value;
-						break;
+					} else {
+						UnixInfoParser::read_unix_proc_status_line(&schedStat, line);
 					}
 				}
 				status_file.close();
 			}
 		}
+		UnixInfoParser::read_proc_schedstat(pinfo->pid, &schedStat);
 		{
-			_unixProcStat stat = UnixInfoParser::read_proc_stat(pinfo->pid);
-			pinfo->user_time = stat.utime + stat.cutime;
-			pinfo->kernal_time = stat.stime + stat.cstime;
+			ProcessSchedStat sched{};
+			sched.run_delay = schedStat.run_delay;
+			sched.voluntary_ctxt_switches = schedStat.voluntary_ctxt_switches;
+			sched.nonvoluntary_ctxt_switches = schedStat.nonvoluntary_ctxt_switches;
+			sched.processor = static_cast<int>(stat.processor);
+			pinfo->sched = sched;
 		}
 #endif
 	}
@@ -131,7 +233,10 @@ namespace cyh::os {
 #else
 	static double get_unix_delta_cpuTime() {
 		auto cpu0 = UnixInfoParser::read_total_cpu_info();
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000u));
+		{
+			CYHOS_STATS_SCOPE(SleepNanoseconds);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1000u));
+		}
 		auto cpu1 = UnixInfoParser::read_total_cpu_info();
 		return static_cast<double>(cpu0.total_time() - cpu1.total_time());
 	}
@@ -152,45 +257,48 @@ namespace cyh::os {
 				callback_closeHandle(handle);
 			}
 		};
-		ProcessInformation result0 = { ~uint{}, "<unknown>", "<unknown>", 0, 0, 0, 0.0 };
+		ProcessInformation result0 = { ~uint{}, "<unknown>", "<unknown>", 0, 0, 0, 0, 0.0 };
 		callbackGetProcDetail(&result0, pid);
 		*pCpuTime = get_win_process_cpuPercentage(&result0);
 #else
 		auto info0 = UnixInfoParser::read_proc_stat(pid);
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000u));
+		{
+			CYHOS_STATS_SCOPE(SleepNanoseconds);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1000u));
+		}
 		auto info1 = UnixInfoParser::read_proc_stat(pid);
 		*pCpuTime = static_cast<double>(info0.total_cpu_time() - info1.total_cpu_time());
 #endif
 	}
 	static void measure_process_cpuTimePercentage_batch(uint* ppid, double* pCpuTimes, nuint count) {
-
+#ifdef __WINDOWS_PLATFORM__
 		std::vector<std::future<void>> tasks;
 		tasks.reserve(count);
-#ifndef __WINDOWS_PLATFORM__
-		std::future<double> taskDeltaCpuTime = std::async(std::launch::async, get_unix_delta_cpuTime);
-#endif
 		for (nuint i = 0; i < count; ++i) {
 			tasks.push_back(std::async(std::launch::async, measure_process_cputime, ppid[i], pCpuTimes + i));
 		}
 		for (auto& task : tasks) {
 			task.get();
 		}
-#ifndef __WINDOWS_PLATFORM__
-		// for unix measure_process_cputime() will get proc cpu delta time instead
-		auto cpuDeltaTime = taskDeltaCpuTime.get();
-		if (cpuDeltaTime == 0.0) {
-			for (nuint i = 0; i < count; ++i) {
-				pCpuTimes[i] = 0.0;
-			}
-		} else {
-			for (nuint i = 0; i < count; ++i) {
-				pCpuTimes[i] /= cpuDeltaTime;
-				pCpuTimes[i] *= 100.0;
-			}
+#else
+		// sample utime/stime of all processes at once, then compute the deltas in a single pass
+		_unixProcTimeSnapshot procs0{};
+		_unixProcTimeSnapshot procs1{};
+		auto cpu0 = UnixInfoParser::read_total_cpu_info();
+		UnixInfoParser::read_procs_time(ppid, count, &procs0);
+		{
+			CYHOS_STATS_SCOPE(SleepNanoseconds);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1000u));
 		}
+		auto cpu1 = UnixInfoParser::read_total_cpu_info();
+		UnixInfoParser::read_procs_time(ppid, count, &procs1);
+		auto cpuDeltaTime = static_cast<double>(cpu1.total_time() - cpu0.total_time());
+		UnixInfoParser::calculate_procs_cpu_usage(&procs0, &procs1, cpuDeltaTime, pCpuTimes);
 #endif
 	}
 
+	bool ProcessMonitor::CollectArgv = false;
+
 	std::vector<uint> ProcessMonitor::GetProcessIDs() {
 		std::vector<uint> result;
 #ifdef __WINDOWS_PLATFORM__
@@ -216,10 +324,15 @@ namespace cyh::os {
 		// Clean the snapshot object
 		CloseHandle(hProcessSnap);
 #else
-		for (const auto& entry : std::filesystem::directory_iterator("/proc")) {
-			if (entry.is_directory()) {
-				std::string pid = entry.path().filename().string();
-				if (std::all_of(pid.begin(), pid.end(), ::isdigit)) {
+		// the root may be set by the user, a missing or unreadable one gives an empty list
+		std::error_code error;
+		std::filesystem::directory_iterator it(ProcfsRoot::GetProcRoot(), error);
+		for (; !error && it != std::filesystem::directory_iterator(); it.increment(error)) {
+			// a process exiting meanwhile is skipped without ending the listing
+			std::error_code entry_error;
+			if (it->is_directory(entry_error)) {
+				std::string pid = it->path().filename().string();
+				if (!pid.empty() && std::all_of(pid.begin(), pid.end(), ::isdigit)) {
 					result.push_back(std::stoul(pid));
 				}
 			}
@@ -238,20 +351,39 @@ namespace cyh::os {
 		return result;
 	}
 	ProcessInformation ProcessMonitor::GetProcessInfo(uint pid, bool with_details) {
-		ProcessInformation result = { ~uint{}, "<unknown>", "<unknown>", 0, 0, 0, 0.0 };
+		ProcessInformation result{};
+		GetProcessInfo(pid, &result, with_details);
+		return result;
+	}
+	bool ProcessMonitor::GetProcessInfo(uint pid, ProcessInformation* pInfo, bool with_details) {
+		if (!pInfo) { return false; }
+		pInfo->pid = ~uint{};
+		pInfo->name = "<unknown>";
+		pInfo->path = "<unknown>";
+		pInfo->memory = 0;
+		pInfo->kernal_time = 0;
+		pInfo->user_time = 0;
+		pInfo->own_cpu_time = 0;
+		pInfo->cpu_time_percentage = 0.0;
+		pInfo->start_time = 0;
+		pInfo->sched.reset();
+		pInfo->argv.reset();
 		void* handle{};
 		std::string unixPath;
 		FnCloseHandle callback_closeHandle{};
 		if (prepare_process_info(pid, &handle, unixPath, &callback_closeHandle)) {
-			get_process_abstraction(handle, &result, pid, unixPath);
+			get_process_abstraction(handle, pInfo, pid, unixPath);
 			if (with_details) {
-				get_process_detail(handle, &result, unixPath);
+				get_process_detail(handle, pInfo, unixPath);
 			}
 			callback_closeHandle(handle);
+			CYHOS_STATS_ADD(PidsScanned, 1);
 		}
-		return result;
+		return is_valid_process(pInfo);
 	}
 	std::vector<ProcessInformation> ProcessMonitor::GetAllProcessInfo(bool with_details) {
+		CYHOS_STATS_ADD(Scans, 1);
+		CYHOS_STATS_SCOPE(ScanNanoseconds);
 		std::vector<ProcessInformation> result;
 		auto pids = GetProcessIDs();
 		auto count = pids.size();
@@ -261,9 +393,7 @@ namespace cyh::os {
 		uint* ppids = pids.data();
 		double* pTimes = cpuTimes.data();
 		std::future<void> taskGetCpuTimes = std::async(std::launch::async, measure_process_cpuTimePercentage_batch, ppids, pTimes, count);
-		for (auto& pid : pids) {
-			result.push_back(GetProcessInfo(pid, with_details));
-		}
+		result = ProcessScanner::Scan(ppids, count, with_details);
 		ProcessInformation* presult = result.data();
 		taskGetCpuTimes.get();
 		for (nuint i = 0; i < count; ++i) {
@@ -271,9 +401,41 @@ namespace cyh::os {
 		}
 		return result;
 	}
+	void ProcessMonitor::GetProcessTable(ProcessTable* pTable, bool with_details) {
+		if (!pTable) { return; }
+		CYHOS_STATS_ADD(Scans, 1);
+		CYHOS_STATS_SCOPE(ScanNanoseconds);
+		auto pids = GetProcessIDs();
+		auto count = pids.size();
+		if (!count) {
+			pTable->clear();
+			return;
+		}
+		std::vector<double> cpuTimes{};
+		cpuTimes.resize(count);
+		uint* ppids = pids.data();
+		double* pTimes = cpuTimes.data();
+		std::future<void> taskGetCpuTimes = std::async(std::launch::async, measure_process_cpuTimePercentage_batch, ppids, pTimes, count);
+		ProcessScanner::Scan(ppids, count, pTable, with_details);
+		taskGetCpuTimes.get();
+		double* presult = pTable->cpu_time_percentages();
+		for (nuint i = 0; i < count; ++i) {
+			presult[i] = pTimes[i];
+		}
+	}
 	std::string ProcessMonitor::GetProcessName(uint pid) {
 		return GetProcessInfo(pid, false).name;
 	}
+	std::vector<std::string> ProcessMonitor::GetProcessArgv(uint pid) {
+		std::vector<std::string> result;
+#ifndef __WINDOWS_PLATFORM__
+		std::string exe;
+		std::string cmdline;
+		_procIdentityCache::instance().get(pid, UnixInfoParser::read_proc_stat(pid).start_time, &exe, &cmdline);
+		CmdlineConvert::Split(cmdline, &result);
+#endif
+		return result;
+	}
 	double ProcessMonitor::GetProcessCpuTime(uint pid) {
 		double result{};
 #ifndef __WINDOWS_PLATFORM__
@@ -312,22 +474,78 @@ namespace cyh::os {
 #endif
 		return false;
 	}
-	std::vector<ProcessGroup> ProcessMonitor::GetProcessGroups() {
+	std::vector<ProcessGroup> ProcessMonitor::GetProcessGroups(ProcessGroupKey key, uint argv_prefix) {
 		std::vector<ProcessGroup> result;
-		auto procs = GetAllProcessInfo(true);
-		std::map<std::string, std::vector<ProcessInformation>> procInfoDict;
-		for (auto& proc : procs) {
-			procInfoDict[proc.name].push_back(proc);
+		ProcessTable table{};
+		GetProcessTable(&table, true);
+
+		// the interned id of the key string of each record
+		std::vector<uint> keys(table.size());
+		const StringPool* pStrings = &table.strings();
+		StringPool groupKeys{};
+		for (nuint i = 0; i < table.size(); ++i) {
+			keys[i] = key == ProcessGroupKey::Exe ? table[i].path_id() : table[i].name_id();
+		}
+#ifndef __WINDOWS_PLATFORM__
+		if (key != ProcessGroupKey::Comm) {
+			std::string exe;
+			std::string cmdline;
+			std::string prefix;
+			for (nuint i = 0; i < table.size(); ++i) {
+				auto record = table[i];
+				_procIdentityCache::instance().get(record.pid(), record.start_time(), &exe, &cmdline);
+				if (exe.empty() && cmdline.empty()) {
+					// kernel threads, each keeps its own name instead of sharing "<unknown>"
+					keys[i] = groupKeys.intern(record.name());
+				} else if (key == ProcessGroupKey::Exe || !argv_prefix) {
+					keys[i] = groupKeys.intern(record.path());
+				} else if (cmdline.empty()) {
+					keys[i] = groupKeys.intern(record.name());
+				} else {
+					CmdlineConvert::JoinPrefix(cmdline, argv_prefix, &prefix);
+					keys[i] = groupKeys.intern(prefix);
+				}
+			}
+			pStrings = &groupKeys;
+		}
+#endif
+		const StringPool& strings = *pStrings;
+
+		// bucket the records by the key
+		std::vector<nuint> offsets(strings.size() + 1);
+		for (nuint i = 0; i < table.size(); ++i) {
+			++offsets[keys[i] + 1];
+		}
+		for (nuint id = 0; id < strings.size(); ++id) {
+			offsets[id + 1] += offsets[id];
+		}
+		std::vector<nuint> members(table.size());
+		{
+			std::vector<nuint> cursors(offsets.begin(), offsets.end() - 1);
+			for (nuint i = 0; i < table.size(); ++i) {
+				members[cursors[keys[i]]++] = i;
+			}
+		}
+		// groups are ordered by name
+		std::vector<uint> groupIds;
+		for (uint id = 0; id < strings.size(); ++id) {
+			if (offsets[id + 1] != offsets[id]) {
+				groupIds.push_back(id);
+			}
 		}
-		result.reserve(procInfoDict.size());
+		std::sort(groupIds.begin(), groupIds.end(), [&] (uint lhs, uint rhs) { return strings.get(lhs) < strings.get(rhs); });
+		result.reserve(groupIds.size());
 
-		for (auto& pair : procInfoDict) {
+		for (auto id : groupIds) {
 			ProcessGroup group{};
-			group.name = pair.first;
-			group.sub_procs = std::move(pair.second);
-			for (auto& sub_proc : group.sub_procs) {
-				group.cpu_time_percentage += sub_proc.cpu_time_percentage;
-				group.memory += sub_proc.memory;
+			group.name = strings.get(id);
+			group.path = table[members[offsets[id]]].path();
+			group.sub_procs.reserve(offsets[id + 1] - offsets[id]);
+			for (nuint i = offsets[id]; i < offsets[id + 1]; ++i) {
+				auto sub_proc = table[members[i]];
+				group.cpu_time_percentage += sub_proc.cpu_time_percentage();
+				group.memory += sub_proc.memory();
+				group.sub_procs.push_back(sub_proc.to_info());
 			}
 			result.push_back(std::move(group));
 		}
@@ -1,17 +1,28 @@
 #pragma once
 #include "os_.hpp"
+#include "proc_table.hpp"
 namespace cyh::os {
 	class ProcessMonitor {
 	public:
+		// Fill ProcessInformation::argv when getting details
+		static bool CollectArgv;
+
 		static std::vector<uint> GetProcessIDs();
 		static std::vector<uint> GetProcessIDs(const char* name);
 		static ProcessInformation GetProcessInfo(uint pid, bool with_details = true);
+		// Fill the information in place to reuse the capacity of strings, return false if the process is not found
+		static bool GetProcessInfo(uint pid, ProcessInformation* pInfo, bool with_details = true);
 		static std::vector<ProcessInformation> GetAllProcessInfo(bool with_details = true);
+		// Get information of all processes into the table, the capacity of the table is reused
+		static void GetProcessTable(ProcessTable* pTable, bool with_details = true);
 
 		static std::string GetProcessName(uint pid);
+		// Get the full command line, empty if unavailable
+		static std::vector<std::string> GetProcessArgv(uint pid);
 		static double GetProcessCpuTime(uint pid);
 		static bool ForceKillProcess(uint pid);
 		
-		static std::vector<ProcessGroup> GetProcessGroups();
+		// argv_prefix is the count of leading arguments used as the key for ProcessGroupKey::ArgvPrefix, 0 groups by the executable
+		static std::vector<ProcessGroup> GetProcessGroups(ProcessGroupKey key = ProcessGroupKey::Comm, uint argv_prefix = 2);
 	};
 };
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "proc_root.hpp"
+#include "os_internal.hpp"
+#include "proc_mon.hpp"
+#include "proc_scan.hpp"
+#include <atomic>
+#include <cstdlib>
+#ifndef __WINDOWS_PLATFORM__
+#include <climits>
+#include <cstdio>
+#endif
+namespace cyh::os {
+	static constexpr char LIVE_PROC_ROOT[] = "/proc";
+
+	static std::string& get_proc_root_storage() {
+		static std::string root = [] {
+			const char* env = getenv("CYHOS_PROC_ROOT");
+			return std::string(env && *env ? env : LIVE_PROC_ROOT);
+		}();
+		return root;
+	}
+
+	void ProcfsRoot::SetProcRoot(const std::string& proc_root) {
+		std::string root = proc_root.empty() ? std::string(LIVE_PROC_ROOT) : proc_root;
+		while (root.size() > 1 && root.back() == '/') { root.pop_back(); }
+		get_proc_root_storage() = std::move(root);
+	}
+	const std::string& ProcfsRoot::GetProcRoot() {
+		return get_proc_root_storage();
+	}
+	bool ProcfsRoot::IsLive() {
+		return get_proc_root_storage() == LIVE_PROC_ROOT;
+	}
+
+#ifdef __WINDOWS_PLATFORM__
+	nuint ProcfsRecorder::Record(const std::string&) {
+		return 0;
+	}
+#else
+	std::string ProcfsPath::get(const char* name) {
+		std::string path = get_proc_root_storage();
+		path += '/';
+		path += name;
+		return path;
+	}
+	const char* ProcfsPath::get(uint pid, const char* name, std::string* pOut) {
+		char number[16];
+		snprintf(number, sizeof(number), "/%u", pid);
+		*pOut = get_proc_root_storage();
+		*pOut += number;
+		if (name) {
+			*pOut += '/';
+			*pOut += name;
+		}
+		return pOut->c_str();
+	}
+
+	// Files read by the monitors
+	static const char* const RECORD_SYSTEM_FILES[] = { "stat", "meminfo", "diskstats" };
+	static const char* const RECORD_PROCESS_FILES[] = { "stat", "status", "schedstat", "comm", "cmdline" };
+
+	static bool write_record_file(const std::string& path, const std::string& content) {
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0) { return false; }
+		nuint written = 0;
+		while (written < content.size()) {
+			auto count = write(fd, content.data() + written, content.size() - written);
+			if (count <= 0) { break; }
+			written += static_cast<nuint>(count);
+		}
+		close(fd);
+		return written == content.size();
+	}
+	// Return false if the process has exited, then nothing of it is left in the recording
+	static bool record_process(uint pid, const std::string& directory, std::string* pBuffer) {
+		std::string source;
+		std::string target = directory + '/' + std::to_string(pid);
+		std::error_code error;
+		std::filesystem::create_directories(target, error);
+		if (error) { return false; }
+		bool has_stat = false;
+		for (auto name : RECORD_PROCESS_FILES) {
+			// schedstat is missing without CONFIG_SCHED_INFO, other files may be unreadable for other users
+			if (!UnixInfoParser::read_file(ProcfsPath::get(pid, name, &source), pBuffer)) { continue; }
+			if (!write_record_file(target + '/' + name, *pBuffer)) { continue; }
+			has_stat = has_stat || (name == RECORD_PROCESS_FILES[0] && !pBuffer->empty());
+		}
+		if (!has_stat) {
+			std::filesystem::remove_all(target, error);
+			return false;
+		}
+		// the link is kept as it is, readlink does not need its target to exist
+		char exe[PATH_MAX];
+		auto length = readlink(ProcfsPath::get(pid, "exe", &source), exe, sizeof(exe) - 1);
+		if (length > 0) {
+			exe[length] = '\0';
+			std::string link = target + "/exe";
+			unlink(link.c_str());
+			// not an error, without the link the executable is reported as inaccessible as for a live process of another user
+			[[maybe_unused]] int linked = symlink(exe, link.c_str());
+		}
+		return true;
+	}
+	nuint ProcfsRecorder::Record(const std::string& directory) {
+		if (directory.empty()) { return 0; }
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		if (error) { return 0; }
+		std::string buffer;
+		for (auto name : RECORD_SYSTEM_FILES) {
+			if (UnixInfoParser::read_file(ProcfsPath::get(name).c_str(), &buffer)) {
+				write_record_file(directory + '/' + name, buffer);
+			}
+		}
+		auto pids = ProcessMonitor::GetProcessIDs();
+		std::atomic<nuint> recorded{ 0 };
+		ProcessScanner::ParallelFor(pids.size(), [&] (nuint begin, nuint end, uint) {
+			thread_local std::string content;
+			nuint count = 0;
+			for (nuint i = begin; i < end; ++i) {
+				if (record_process(pids[i], directory, &content)) { ++count; }
+			}
+			recorded.fetch_add(count, std::memory_order_relaxed);
+		});
+		return recorded.load();
+	}
+#endif
+};
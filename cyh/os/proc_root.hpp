@@ -0,0 +1,25 @@
+#pragma once
+#include "os_.hpp"
+#include <string>
+namespace cyh::os {
+	// Root of the procfs read by the process and resource monitors ( unix only )
+	// A recording made by ProcfsRecorder can be used in place of the live /proc, so sampling and benchmarks
+	// run on a fixed dataset and give the same result across versions and hosts
+	// The default is the environment variable CYHOS_PROC_ROOT if set, otherwise /proc
+	struct ProcfsRoot {
+		// Use the directory in place of /proc, empty restores /proc
+		// Set it before sampling, it must not change while another thread is sampling
+		static void SetProcRoot(const std::string& proc_root);
+		static const std::string& GetProcRoot();
+		// Indicate whether the root is the live /proc
+		static bool IsLive();
+	};
+	// Capture the files of procfs read by the monitors into a directory, which can be used as a proc root
+	// Only those files are copied, so a recording is a few kB per process and can be archived as it is
+	// The memory backing shared memories ( /proc/<pid>/maps, /proc/self/mounts and /sys ) is always read live
+	struct ProcfsRecorder {
+		// Record the current proc root into directory, created if missing, files already in it are replaced
+		// Processes exiting during the recording are skipped, return the count of processes recorded
+		static nuint Record(const std::string& directory);
+	};
+};
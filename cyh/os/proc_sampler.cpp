@@ -0,0 +1,70 @@
+#include "proc_sampler.hpp"
+#include "proc_mon.hpp"
+#include "proc_scan.hpp"
+#include "res_mon.hpp"
+#include "os_internal.hpp"
+#include <algorithm>
+namespace cyh::os {
+	// Delta of counters per second, 0 if the counter goes backward
+	static double get_counter_rate(nuint previous, nuint current, double elapsed_seconds) {
+		if (current < previous || elapsed_seconds <= 0.0) { return 0.0; }
+		return static_cast<double>(current - previous) / elapsed_seconds;
+	}
+
+	const ProcessSampler::_previousSample* ProcessSampler::find_previous(uint pid) const {
+		auto it = std::lower_bound(this->m_previous.begin(), this->m_previous.end(), pid, [] (const _previousSample& sample, uint key) { return sample.pid < key; });
+		if (it == this->m_previous.end() || it->pid != pid) { return nullptr; }
+		return &(*it);
+	}
+	void ProcessSampler::Sample(ProcessTable* pTable) {
+		if (!pTable) { return; }
+		CYHOS_STATS_ADD(Scans, 1);
+		CYHOS_STATS_SCOPE(ScanNanoseconds);
+		auto pids = ProcessMonitor::GetProcessIDs();
+		auto now = std::chrono::steady_clock::now();
+		ProcessScanner::Scan(pids.data(), pids.size(), pTable, true);
+
+		double elapsed = this->m_has_previous ? std::chrono::duration<double>(now - this->m_previous_time).count() : 0.0;
+		// cpu time all processors could provide during the interval
+		double cpu_capacity = elapsed * static_cast<double>(ResourceMonitor::GetProcessorCount()) * UnitConvert::GetCpuTimeUnitsPerSecond();
+		double* pCpuPercentages = pTable->cpu_time_percentages();
+		ProcessSchedStat* pScheds = pTable->scheds();
+
+		this->m_current.clear();
+		for (nuint i = 0; i < pTable->size(); ++i) {
+			auto record = (*pTable)[i];
+			// vanished during the scan
+			if (record.pid() == ~uint()) { continue; }
+			const ProcessSchedStat* pSched = record.sched();
+			// without the children, as GetAllProcessInfo does
+			_previousSample current{ record.pid(), record.start_time(), record.own_cpu_time(), pSched ? *pSched : ProcessSchedStat{}, pSched != nullptr };
+			this->m_current.push_back(current);
+
+			const _previousSample* pPrevious = this->find_previous(current.pid);
+			if (!pPrevious || pPrevious->start_time != current.start_time || elapsed <= 0.0) { continue; }
+			if (cpu_capacity > 0.0) {
+				pCpuPercentages[i] = get_counter_rate(pPrevious->cpu_time, current.cpu_time, cpu_capacity) * 100.0;
+			}
+			if (current.has_sched && pPrevious->has_sched) {
+				ProcessSchedStat& sched = pScheds[i];
+				sched.has_rates = true;
+				sched.run_delay_rate = get_counter_rate(pPrevious->sched.run_delay, sched.run_delay, elapsed);
+				sched.voluntary_ctxt_switch_rate = get_counter_rate(pPrevious->sched.voluntary_ctxt_switches, sched.voluntary_ctxt_switches, elapsed);
+				sched.nonvoluntary_ctxt_switch_rate = get_counter_rate(pPrevious->sched.nonvoluntary_ctxt_switches, sched.nonvoluntary_ctxt_switches, elapsed);
+			}
+		}
+		std::sort(this->m_current.begin(), this->m_current.end(), [] (const _previousSample& lhs, const _previousSample& rhs) { return lhs.pid < rhs.pid; });
+		std::swap(this->m_previous, this->m_current);
+		this->m_previous_time = now;
+		this->m_has_previous = true;
+	}
+	std::vector<ProcessInformation> ProcessSampler::Sample() {
+		this->Sample(&this->m_table);
+		return this->m_table.to_infos();
+	}
+	void ProcessSampler::Reset() {
+		this->m_previous.clear();
+		this->m_current.clear();
+		this->m_has_previous = false;
+	}
+};
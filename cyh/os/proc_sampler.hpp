@@ -0,0 +1,31 @@
+#pragma once
+#include "os_.hpp"
+#include "proc_table.hpp"
+#include <chrono>
+namespace cyh::os {
+	// Sample processes repeatedly without sleeping inside the call
+	// The cpu percentage and the rates of scheduling counters are computed against the previous sample,
+	// a process is matched by (pid, start_time) so a reused pid does not produce a rate
+	class ProcessSampler {
+		struct _previousSample {
+			uint pid;
+			nuint start_time;
+			nuint cpu_time;
+			ProcessSchedStat sched;
+			bool has_sched;
+		};
+		// sorted by pid
+		std::vector<_previousSample> m_previous;
+		std::vector<_previousSample> m_current;
+		std::chrono::steady_clock::time_point m_previous_time{};
+		bool m_has_previous{};
+		ProcessTable m_table;
+		const _previousSample* find_previous(uint pid) const;
+	public:
+		// Sample all processes with details into the table, the first sample has no cpu percentage and rates
+		void Sample(ProcessTable* pTable);
+		std::vector<ProcessInformation> Sample();
+		// Forget the previous sample
+		void Reset();
+	};
+};
@@ -0,0 +1,230 @@
+#include "proc_scan.hpp"
+#include "proc_mon.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+namespace cyh::os {
+	// Count of indices claimed at once, small enough that a slow pid only holds back a few others
+	static constexpr nuint SCAN_CHUNK_SIZE = 16;
+	static constexpr uint SCAN_DEFAULT_MAX_WORKERS = 8;
+
+	// Range of indices owned by a worker, other workers steal from it by the same cursor
+	struct alignas(64) _scanRange {
+		std::atomic<nuint> m_next{};
+		nuint m_end{};
+	};
+	// Output of a worker, merged into the result by index after all workers finished
+	struct alignas(64) _scanTableSlab {
+		std::vector<nuint> m_indices;
+		ProcessTable m_table;
+		// reused by every record of the worker to keep the capacity of strings
+		ProcessInformation m_scratch;
+	};
+
+	// Claim a chunk from the range, return false if the range is exhausted
+	static bool claim_scan_chunk(_scanRange* pRange, nuint* pBegin, nuint* pEnd) {
+		if (pRange->m_next.load(std::memory_order_relaxed) >= pRange->m_end) { return false; }
+		nuint begin = pRange->m_next.fetch_add(SCAN_CHUNK_SIZE, std::memory_order_relaxed);
+		if (begin >= pRange->m_end) { return false; }
+		*pBegin = begin;
+		*pEnd = begin + SCAN_CHUNK_SIZE < pRange->m_end ? begin + SCAN_CHUNK_SIZE : pRange->m_end;
+		return true;
+	}
+	static void run_scan_worker(_scanRange* pRanges, uint worker_count, uint worker_no, const ProcessScanner::FnScanChunk* pfn) {
+		nuint begin{}, end{};
+		// drain the own range first
+		while (claim_scan_chunk(pRanges + worker_no, &begin, &end)) {
+			(*pfn)(begin, end, worker_no);
+		}
+		// then steal from the others
+		for (uint i = 1; i < worker_count; ++i) {
+			_scanRange* pVictim = pRanges + (worker_no + i) % worker_count;
+			while (claim_scan_chunk(pVictim, &begin, &end)) {
+				(*pfn)(begin, end, worker_no);
+			}
+		}
+	}
+	static void split_scan_ranges(std::vector<_scanRange>* pRanges, nuint count, uint worker_count) {
+		// the ranges are not movable, so a longer vector is built instead of resized
+		if (pRanges->size() < worker_count) { *pRanges = std::vector<_scanRange>(worker_count); }
+		nuint per_worker = count / worker_count;
+		nuint remain = count % worker_count;
+		nuint begin = 0;
+		for (uint i = 0; i < worker_count; ++i) {
+			nuint length = per_worker + (i < remain ? 1 : 0);
+			(*pRanges)[i].m_next.store(begin, std::memory_order_relaxed);
+			(*pRanges)[i].m_end = begin + length;
+			begin += length;
+		}
+	}
+
+	// Set while the thread runs chunks of a job, a scan started from a chunk can not wait for the pool
+	static thread_local bool s_in_scan_job = false;
+
+	// Worker threads kept across scans, parked between jobs
+	// A job is run by one caller at a time, the caller works as worker 0 and other callers wait their turn
+	class _scanPool {
+		// held by the caller for the whole job
+		std::mutex m_job_lock;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+		std::vector<std::thread> m_threads;
+		bool m_stopping{};
+		// bumped for every job, a parked worker wakes when it changes
+		uint64_t m_generation{};
+		std::vector<_scanRange> m_ranges;
+		uint m_worker_count{};
+		const ProcessScanner::FnScanChunk* m_pfn{};
+		uint m_pending{};
+		// first exception thrown by a worker of the job
+		std::exception_ptr m_error;
+
+		// Run the chunks of the worker, an exception is kept for the caller and the other workers stop claiming
+		void work(uint worker_no) {
+			s_in_scan_job = true;
+			try {
+				run_scan_worker(this->m_ranges.data(), this->m_worker_count, worker_no, this->m_pfn);
+				s_in_scan_job = false;
+			}
+			catch (...) {
+				s_in_scan_job = false;
+				for (auto& range : this->m_ranges) {
+					range.m_next.store(range.m_end, std::memory_order_relaxed);
+				}
+				std::lock_guard<std::mutex> lock(this->m_mutex);
+				if (!this->m_error) { this->m_error = std::current_exception(); }
+			}
+		}
+		void run(uint worker_no, uint64_t generation) {
+			std::unique_lock<std::mutex> lock(this->m_mutex);
+			while (true) {
+				this->m_wake.wait(lock, [&] { return this->m_stopping || this->m_generation != generation; });
+				if (this->m_stopping) { return; }
+				generation = this->m_generation;
+				if (worker_no >= this->m_worker_count) { continue; }
+				lock.unlock();
+				this->work(worker_no);
+				lock.lock();
+				if (--this->m_pending == 0) { this->m_done.notify_one(); }
+			}
+		}
+	public:
+		~_scanPool() {
+			{
+				std::lock_guard<std::mutex> lock(this->m_mutex);
+				this->m_stopping = true;
+			}
+			this->m_wake.notify_all();
+			for (auto& thread : this->m_threads) {
+				thread.join();
+			}
+		}
+		static _scanPool& instance() {
+			static _scanPool pool{};
+			return pool;
+		}
+		// Wait until the running job finished, then run this one, never called from a chunk of a job
+		void Run(nuint count, uint worker_count, const ProcessScanner::FnScanChunk& fn) {
+			std::lock_guard<std::mutex> job_lock(this->m_job_lock);
+			std::exception_ptr error;
+			{
+				std::unique_lock<std::mutex> lock(this->m_mutex);
+				while (this->m_threads.size() + 1 < worker_count) {
+					this->m_threads.emplace_back(&_scanPool::run, this, static_cast<uint>(this->m_threads.size() + 1), this->m_generation);
+				}
+				split_scan_ranges(&this->m_ranges, count, worker_count);
+				this->m_worker_count = worker_count;
+				this->m_pfn = &fn;
+				this->m_pending = worker_count - 1;
+				this->m_error = nullptr;
+				++this->m_generation;
+			}
+			this->m_wake.notify_all();
+			this->work(0);
+			{
+				std::unique_lock<std::mutex> lock(this->m_mutex);
+				this->m_done.wait(lock, [&] { return this->m_pending == 0; });
+				error = std::move(this->m_error);
+				this->m_error = nullptr;
+				this->m_pfn = nullptr;
+			}
+			if (error) { std::rethrow_exception(error); }
+		}
+	};
+
+	static void run_parallel_scan(nuint count, uint worker_count, const ProcessScanner::FnScanChunk& fn) {
+		if (!count || !worker_count) { return; }
+		// a scan inside a chunk would wait for the job running it
+		if (worker_count <= 1 || s_in_scan_job) {
+			fn(0, count, 0);
+			return;
+		}
+		_scanPool::instance().Run(count, worker_count, fn);
+	}
+
+	uint ProcessScanner::MaxWorkers = 0;
+
+	uint ProcessScanner::GetWorkerCount(nuint count) {
+		uint max_workers = MaxWorkers;
+		if (!max_workers) {
+			max_workers = std::thread::hardware_concurrency();
+			if (max_workers > SCAN_DEFAULT_MAX_WORKERS) { max_workers = SCAN_DEFAULT_MAX_WORKERS; }
+		}
+		if (!max_workers) { max_workers = 1; }
+		// no worker without at least a chunk of its own
+		nuint chunks = (count + SCAN_CHUNK_SIZE - 1) / SCAN_CHUNK_SIZE;
+		if (chunks < max_workers) { max_workers = static_cast<uint>(chunks); }
+		return max_workers;
+	}
+	void ProcessScanner::ParallelFor(nuint count, const FnScanChunk& fn) {
+		run_parallel_scan(count, GetWorkerCount(count), fn);
+	}
+	std::vector<ProcessInformation> ProcessScanner::Scan(const uint* ppids, nuint count, bool with_details) {
+		std::vector<ProcessInformation> result;
+		if (!ppids || !count) { return result; }
+		// every index is claimed by exactly one worker, so the workers fill the result in place
+		result.resize(count);
+		ProcessInformation* presult = result.data();
+		run_parallel_scan(count, GetWorkerCount(count), [=] (nuint begin, nuint end, uint) {
+			for (nuint i = begin; i < end; ++i) {
+				ProcessMonitor::GetProcessInfo(ppids[i], presult + i, with_details);
+			}
+		});
+		return result;
+	}
+	void ProcessScanner::Scan(const uint* ppids, nuint count, ProcessTable* pTable, bool with_details) {
+		if (!pTable) { return; }
+		pTable->clear();
+		if (!ppids || !count) { return; }
+		uint worker_count = GetWorkerCount(count);
+		// kept by the calling thread, so the columns and the string arenas are reused by the next scans
+		thread_local std::vector<_scanTableSlab> slabs;
+		if (slabs.size() < worker_count) { slabs.resize(worker_count); }
+		for (auto& slab : slabs) {
+			slab.m_indices.clear();
+			slab.m_table.clear();
+			slab.m_indices.reserve(count / worker_count + SCAN_CHUNK_SIZE);
+			slab.m_table.reserve(count / worker_count + SCAN_CHUNK_SIZE);
+		}
+		// the workers see their own thread_local, so they get the slabs of the caller by pointer
+		_scanTableSlab* pSlabs = slabs.data();
+		run_parallel_scan(count, worker_count, [=] (nuint begin, nuint end, uint worker_no) {
+			_scanTableSlab& slab = pSlabs[worker_no];
+			for (nuint i = begin; i < end; ++i) {
+				ProcessMonitor::GetProcessInfo(ppids[i], &slab.m_scratch, with_details);
+				slab.m_indices.push_back(i);
+				slab.m_table.push_back(slab.m_scratch);
+			}
+		});
+		pTable->resize(count);
+		for (auto& slab : slabs) {
+			nuint* pIndices = slab.m_indices.data();
+			for (nuint i = 0; i < slab.m_table.size(); ++i) {
+				pTable->assign(pIndices[i], slab.m_table, i);
+			}
+		}
+	}
+};
@@ -0,0 +1,26 @@
+#pragma once
+#include "os_.hpp"
+#include "proc_table.hpp"
+#include <functional>
+namespace cyh::os {
+	class ProcessScanner {
+	public:
+		// Called with a chunk of indices [begin, end) and the number of the worker running it
+		using FnScanChunk = std::function<void(nuint begin, nuint end, uint worker_no)>;
+
+		// Upper bound of workers used by a scan, 0 to use the count of processors (at most 8)
+		static uint MaxWorkers;
+
+		// Get the count of workers a scan over count items will use
+		static uint GetWorkerCount(nuint count);
+		// Split [0, count) across the workers, idle workers steal chunks from the busy ones
+		// The calling thread works as worker 0, the other workers are threads kept across calls
+		// An exception thrown by fn stops the workers and is rethrown on the calling thread
+		// A call made while another one is running waits for it, a call from fn runs fn on the calling thread only
+		static void ParallelFor(nuint count, const FnScanChunk& fn);
+		// Get information of processes in parallel, the result is in the same order as ppids
+		static std::vector<ProcessInformation> Scan(const uint* ppids, nuint count, bool with_details = true);
+		// Get information of processes in parallel into the table, the records are in the same order as ppids
+		static void Scan(const uint* ppids, nuint count, ProcessTable* pTable, bool with_details = true);
+	};
+};
@@ -0,0 +1,146 @@
+#include "proc_table.hpp"
+#include "os_internal.hpp"
+#include <functional>
+namespace cyh::os {
+	void StringPool::rehash(nuint slot_count) {
+		this->m_slots.assign(slot_count, 0);
+		nuint mask = slot_count - 1;
+		for (uint id = 0; id < this->size(); ++id) {
+			nuint slot = std::hash<std::string_view>{}(this->get(id)) & mask;
+			while (this->m_slots[slot]) {
+				slot = (slot + 1) & mask;
+			}
+			this->m_slots[slot] = id + 1;
+		}
+	}
+	uint StringPool::intern(std::string_view str) {
+		// keep the load factor under 0.5
+		if ((this->size() + 1) * 2 > this->m_slots.size()) {
+			this->rehash(this->m_slots.empty() ? 64 : this->m_slots.size() * 2);
+		}
+		nuint mask = this->m_slots.size() - 1;
+		nuint slot = std::hash<std::string_view>{}(str) & mask;
+		while (uint stored = this->m_slots[slot]) {
+			if (this->get(stored - 1) == str) {
+				return stored - 1;
+			}
+			slot = (slot + 1) & mask;
+		}
+		uint id = static_cast<uint>(this->size());
+		this->m_chars.append(str.data(), str.size());
+		this->m_offsets.push_back(this->m_chars.size());
+		this->m_slots[slot] = id + 1;
+		return id;
+	}
+	std::string_view StringPool::get(uint id) const {
+		if (id >= this->size()) { return {}; }
+		nuint begin = this->m_offsets[id];
+		return std::string_view(this->m_chars.data() + begin, this->m_offsets[id + 1] - begin);
+	}
+	nuint StringPool::size() const {
+		return this->m_offsets.size() - 1;
+	}
+	void StringPool::clear() {
+		this->m_chars.clear();
+		this->m_offsets.resize(1);
+		this->m_slots.assign(this->m_slots.size(), 0);
+	}
+
+	ProcessInformation ProcessTable::ProcessView::to_info() const {
+		ProcessInformation result{};
+		result.pid = this->pid();
+		result.name = this->name();
+		result.path = this->path();
+		result.memory = this->memory();
+		result.kernal_time = this->kernal_time();
+		result.user_time = this->user_time();
+		result.own_cpu_time = this->own_cpu_time();
+		result.cpu_time_percentage = this->cpu_time_percentage();
+		result.start_time = this->start_time();
+		if (auto pSched = this->sched()) {
+			result.sched = *pSched;
+		}
+		if (this->has_argv()) {
+			CmdlineConvert::Split(this->cmdline(), &result.argv.emplace());
+		}
+		return result;
+	}
+
+	void ProcessTable::clear() {
+		this->resize(0);
+		this->m_strings.clear();
+	}
+	void ProcessTable::reserve(nuint count) {
+		this->m_pids.reserve(count);
+		this->m_names.reserve(count);
+		this->m_paths.reserve(count);
+		this->m_memory.reserve(count);
+		this->m_kernal_times.reserve(count);
+		this->m_user_times.reserve(count);
+		this->m_own_cpu_times.reserve(count);
+		this->m_cpu_time_percentages.reserve(count);
+		this->m_start_times.reserve(count);
+		this->m_scheds.reserve(count);
+		this->m_has_scheds.reserve(count);
+		this->m_cmdlines.reserve(count);
+	}
+	void ProcessTable::resize(nuint count) {
+		this->m_pids.resize(count);
+		this->m_names.resize(count);
+		this->m_paths.resize(count);
+		this->m_memory.resize(count);
+		this->m_kernal_times.resize(count);
+		this->m_user_times.resize(count);
+		this->m_own_cpu_times.resize(count);
+		this->m_cpu_time_percentages.resize(count);
+		this->m_start_times.resize(count);
+		this->m_scheds.resize(count);
+		this->m_has_scheds.resize(count);
+		this->m_cmdlines.resize(count, ~uint());
+	}
+	nuint ProcessTable::push_back(const ProcessInformation& info) {
+		nuint index = this->size();
+		this->m_pids.push_back(info.pid);
+		this->m_names.push_back(this->m_strings.intern(info.name));
+		this->m_paths.push_back(this->m_strings.intern(info.path));
+		this->m_memory.push_back(info.memory);
+		this->m_kernal_times.push_back(info.kernal_time);
+		this->m_user_times.push_back(info.user_time);
+		this->m_own_cpu_times.push_back(info.own_cpu_time);
+		this->m_cpu_time_percentages.push_back(info.cpu_time_percentage);
+		this->m_start_times.push_back(info.start_time);
+		this->m_scheds.push_back(info.sched.value_or(ProcessSchedStat{}));
+		this->m_has_scheds.push_back(info.sched.has_value() ? 1 : 0);
+		if (info.argv) {
+			thread_local std::string cmdline;
+			CmdlineConvert::Join(*info.argv, &cmdline);
+			this->m_cmdlines.push_back(this->m_strings.intern(cmdline));
+		} else {
+			this->m_cmdlines.push_back(~uint());
+		}
+		return index;
+	}
+	void ProcessTable::assign(nuint index, const ProcessTable& src, nuint src_index) {
+		if (index >= this->size() || src_index >= src.size()) { return; }
+		this->m_pids[index] = src.m_pids[src_index];
+		this->m_names[index] = this->m_strings.intern(src.m_strings.get(src.m_names[src_index]));
+		this->m_paths[index] = this->m_strings.intern(src.m_strings.get(src.m_paths[src_index]));
+		this->m_memory[index] = src.m_memory[src_index];
+		this->m_kernal_times[index] = src.m_kernal_times[src_index];
+		this->m_user_times[index] = src.m_user_times[src_index];
+		this->m_own_cpu_times[index] = src.m_own_cpu_times[src_index];
+		this->m_cpu_time_percentages[index] = src.m_cpu_time_percentages[src_index];
+		this->m_start_times[index] = src.m_start_times[src_index];
+		this->m_scheds[index] = src.m_scheds[src_index];
+		this->m_has_scheds[index] = src.m_has_scheds[src_index];
+		this->m_cmdlines[index] = src.m_cmdlines[src_index] == ~uint() ? ~uint() : this->m_strings.intern(src.m_strings.get(src.m_cmdlines[src_index]));
+	}
+	std::vector<ProcessInformation> ProcessTable::to_infos() const {
+		std::vector<ProcessInformation> result;
+		result.reserve(this->size());
+		for (nuint i = 0; i < this->size(); ++i) {
+			result.push_back((*this)[i].to_info());
+		}
+		return result;
+	}
+};
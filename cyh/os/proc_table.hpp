@@ -0,0 +1,97 @@
+#pragma once
+#include "os_.hpp"
+#include <string_view>
+namespace cyh::os {
+	// Strings interned in a single character arena and addressed by id
+	// Equal strings get the same id until clear() is called
+	class StringPool {
+		std::string m_chars;
+		// begin of string id is m_offsets[id], end is m_offsets[id + 1]
+		std::vector<nuint> m_offsets{ 0 };
+		// open addressing slots of (id + 1), 0 for an empty slot
+		std::vector<uint> m_slots;
+		void rehash(nuint slot_count);
+	public:
+		uint intern(std::string_view str);
+		std::string_view get(uint id) const;
+		// Count of distinct strings
+		nuint size() const;
+		// Remove all strings but keep the capacity
+		void clear();
+	};
+
+	// Snapshot of processes stored as columns, the strings are interned in a pool shared by all records
+	class ProcessTable {
+		std::vector<uint> m_pids;
+		std::vector<uint> m_names;
+		std::vector<uint> m_paths;
+		std::vector<nuint> m_memory;
+		std::vector<nuint> m_kernal_times;
+		std::vector<nuint> m_user_times;
+		std::vector<nuint> m_own_cpu_times;
+		std::vector<double> m_cpu_time_percentages;
+		std::vector<nuint> m_start_times;
+		std::vector<ProcessSchedStat> m_scheds;
+		// 1 if the record has m_scheds filled
+		std::vector<unsigned char> m_has_scheds;
+		// interned arguments separated by '\0', ~uint() if not collected
+		std::vector<uint> m_cmdlines;
+		StringPool m_strings;
+	public:
+		// A record of the table, valid until the table is modified
+		class ProcessView {
+			const ProcessTable* m_table{};
+			nuint m_index{};
+		public:
+			ProcessView(const ProcessTable* table, nuint index) : m_table(table), m_index(index) {}
+			nuint index() const { return this->m_index; }
+			uint pid() const { return this->m_table->m_pids[this->m_index]; }
+			uint name_id() const { return this->m_table->m_names[this->m_index]; }
+			uint path_id() const { return this->m_table->m_paths[this->m_index]; }
+			std::string_view name() const { return this->m_table->m_strings.get(this->name_id()); }
+			std::string_view path() const { return this->m_table->m_strings.get(this->path_id()); }
+			nuint memory() const { return this->m_table->m_memory[this->m_index]; }
+			nuint kernal_time() const { return this->m_table->m_kernal_times[this->m_index]; }
+			nuint user_time() const { return this->m_table->m_user_times[this->m_index]; }
+			nuint own_cpu_time() const { return this->m_table->m_own_cpu_times[this->m_index]; }
+			double cpu_time_percentage() const { return this->m_table->m_cpu_time_percentages[this->m_index]; }
+			nuint start_time() const { return this->m_table->m_start_times[this->m_index]; }
+			// nullptr if the record has no scheduling counters
+			const ProcessSchedStat* sched() const {
+				return this->m_table->m_has_scheds[this->m_index] ? &this->m_table->m_scheds[this->m_index] : nullptr;
+			}
+			bool has_argv() const { return this->m_table->m_cmdlines[this->m_index] != ~uint(); }
+			// Arguments separated by '\0', empty if not collected
+			std::string_view cmdline() const { return this->m_table->m_strings.get(this->m_table->m_cmdlines[this->m_index]); }
+			// Copy the record out for the api using ProcessInformation
+			ProcessInformation to_info() const;
+		};
+
+		nuint size() const { return this->m_pids.size(); }
+		bool empty() const { return this->m_pids.empty(); }
+		ProcessView operator[](nuint index) const { return ProcessView(this, index); }
+
+		// Remove all records but keep the capacity of the columns and the string arena
+		void clear();
+		void reserve(nuint count);
+		// Resize the columns, the new records are empty
+		void resize(nuint count);
+		// Append a record, return its index
+		nuint push_back(const ProcessInformation& info);
+		// Overwrite the record at index with the record of another table
+		void assign(nuint index, const ProcessTable& src, nuint src_index);
+
+		const StringPool& strings() const { return this->m_strings; }
+		const uint* pids() const { return this->m_pids.data(); }
+		const nuint* memory() const { return this->m_memory.data(); }
+		double* cpu_time_percentages() { return this->m_cpu_time_percentages.data(); }
+		const double* cpu_time_percentages() const { return this->m_cpu_time_percentages.data(); }
+		const nuint* start_times() const { return this->m_start_times.data(); }
+		const nuint* kernal_times() const { return this->m_kernal_times.data(); }
+		const nuint* user_times() const { return this->m_user_times.data(); }
+		// Valid only for the records with scheduling counters, see ProcessView::sched()
+		ProcessSchedStat* scheds() { return this->m_scheds.data(); }
+
+		std::vector<ProcessInformation> to_infos() const;
+	};
+};
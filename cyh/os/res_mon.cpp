@@ -47,12 +47,14 @@ namespace cyh::os {
 		GetSystemInfo(&info);
 		return static_cast<long>(info.dwNumberOfProcessors);
 #else
-		std::ifstream file("/proc/stat");
+		std::ifstream file(ProcfsPath::get("stat"));
 		std::string line;
 
 		if (file.is_open()) {
+			CYHOS_STATS_ADD(FilesOpened, 1);
 			long count = 0;
 			while (getline(file, line)) {
+				CYHOS_STATS_ADD(BytesRead, line.size() + 1);
 
 				auto begin_index = line.find("cpu");
 				// break if line is not start with cpu
@@ -87,7 +89,10 @@ namespace cyh::os {
 		return res;
 #else
 		auto info0 = UnixInfoParser::read_cpu_info(cpu_no);
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+		{
+			CYHOS_STATS_SCOPE(SleepNanoseconds);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+		}
 		auto info1 = UnixInfoParser::read_cpu_info(cpu_no);
 		return UnixInfoParser::calculate_cpu_usage(&info0, &info1);
 #endif
@@ -100,7 +105,10 @@ namespace cyh::os {
 		result = 100.0 - result;
 #else
 		_unixDiskInfo diskUsage1 = UnixInfoParser::read_disk_info(disk_label);
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+		{
+			CYHOS_STATS_SCOPE(SleepNanoseconds);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+		}
 		_unixDiskInfo diskUsage2 = UnixInfoParser::read_disk_info(disk_label);
 		result = UnixInfoParser::calculate_disk_usage(&diskUsage1, &diskUsage2);
 #endif
@@ -124,10 +132,12 @@ namespace cyh::os {
 			drives >>= 1;
 		}
 #else
-		std::ifstream diskstats("/proc/diskstats");
+		std::ifstream diskstats(ProcfsPath::get("diskstats"));
 		std::string line;
 		_unixDiskInfo diskUsage{};
+		CYHOS_STATS_ADD(FilesOpened, diskstats.is_open() ? 1 : 0);
 		while (std::getline(diskstats, line)) {
+			CYHOS_STATS_ADD(BytesRead, line.size() + 1);
 			UnixInfoParser::read_unix_disk_info(&diskUsage, line);
 			result.push_back(diskUsage.device);
 		}
@@ -151,20 +161,46 @@ namespace cyh::os {
 			result.push_back(task.get());
 		}
 #else
-		auto infos0 = UnixInfoParser::read_cpus_info();
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-		auto infos1 = UnixInfoParser::read_cpus_info();
-		if (infos0.size() != infos1.size()) {
-			return result;
-		}
-		auto pInfos0 = infos0.data();
-		auto pInfos1 = infos1.data();
-		for (nuint i = 0; i < infos0.size(); ++i) {
-			result.push_back(UnixInfoParser::calculate_cpu_usage(pInfos0 + i, pInfos1 + i));
+		_unixCpuSnapshot infos0{};
+		_unixCpuSnapshot infos1{};
+		UnixInfoParser::read_cpus_snapshot(&infos0);
+		{
+			CYHOS_STATS_SCOPE(SleepNanoseconds);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1000));
 		}
+		UnixInfoParser::read_cpus_snapshot(&infos1);
+		result.resize(infos0.size());
+		result.resize(UnixInfoParser::calculate_cpus_usage(&infos0, &infos1, result.data()));
 #endif
 		return result;
 	}
+	nuint ResourceMonitor::GetAllProcessorUsage(double* pUsages, nuint capacity, double* pStateUsages, uint wait_millis) {
+		if (!pUsages || !capacity) { return 0; }
+#ifdef __WINDOWS_PLATFORM__
+		auto usages = GetAllProcessorUsage();
+		if (usages.size() > capacity) { return 0; }
+		for (nuint i = 0; i < usages.size(); ++i) {
+			pUsages[i] = usages[i];
+		}
+		if (pStateUsages) {
+			memset(pStateUsages, 0, sizeof(double) * capacity * static_cast<nuint>(CpuState::Count));
+		}
+		return usages.size();
+#else
+		// snapshots are kept per thread to reuse the columns between calls
+		thread_local _unixCpuSnapshot infos0{};
+		thread_local _unixCpuSnapshot infos1{};
+		UnixInfoParser::read_cpus_snapshot(&infos0);
+		// checked before the sleep, a buffer too small fails at once
+		if (infos0.size() > capacity) { return 0; }
+		{
+			CYHOS_STATS_SCOPE(SleepNanoseconds);
+			std::this_thread::sleep_for(std::chrono::milliseconds(wait_millis));
+		}
+		UnixInfoParser::read_cpus_snapshot(&infos1);
+		return UnixInfoParser::calculate_cpus_usage(&infos0, &infos1, pUsages, pStateUsages, capacity);
+#endif
+	}
 	std::vector<LogicDiskInformation> ResourceMonitor::GetAllLogicDiskInfo() {
 		std::vector<LogicDiskInformation> result{};	
 #ifdef __WINDOWS_PLATFORM__
@@ -184,7 +220,10 @@ namespace cyh::os {
 		}
 #else
 		auto infos0 = UnixInfoParser::read_disks_info();
-		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+		{
+			CYHOS_STATS_SCOPE(SleepNanoseconds);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+		}
 		auto infos1 = UnixInfoParser::read_disks_info();
 		if (infos0.size() != infos1.size()) {
 			return result;
@@ -231,10 +270,12 @@ namespace cyh::os {
 		vir_avail = static_cast<double>(WinSysMemoryState.ullAvailPageFile);
 #else
 
-		std::ifstream file("/proc/meminfo");
+		std::ifstream file(ProcfsPath::get("meminfo"));
 		std::string line;
 		if (file.is_open()) {
+			CYHOS_STATS_ADD(FilesOpened, 1);
 			while (std::getline(file, line)) {
+				CYHOS_STATS_ADD(BytesRead, line.size() + 1);
 				std::istringstream ss(line);
 				std::string key;
 				long value{};
@@ -14,6 +14,10 @@ namespace cyh::os {
 		// get disk no such as C:,D:...
 		static std::vector<std::string> GetLogicDiskNos();
 		static std::vector<double> GetAllProcessorUsage();
+		// Write usage of each processor to pUsages without allocation, return the count of processors written
+		// If pStateUsages is not null, it should hold capacity * CpuState::Count values, usage of state s of processor i is at [s * capacity + i]
+		// wait_millis is the sampling interval (unix only), 0 if the buffer is too small
+		static nuint GetAllProcessorUsage(double* pUsages, nuint capacity, double* pStateUsages = nullptr, uint wait_millis = 1000u);
 		static std::vector<LogicDiskInformation> GetAllLogicDiskInfo();
 		static MemoryStatus GetMemoryStatus();
 	};
@@ -0,0 +1,663 @@
+#include "sample_history.hpp"
+#include "os_internal.hpp"
+#include "proc_sampler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#ifndef __WINDOWS_PLATFORM__
+#include <cerrno>
+#include <sys/stat.h>
+#endif
+namespace cyh::os {
+	static constexpr uint32_t HISTORY_MAGIC = 0x43594848; // "CYHH"
+	static constexpr uint32_t HISTORY_TRAILER_MAGIC = 0x43594854; // "CYHT"
+	static constexpr uint32_t HISTORY_VERSION = 1;
+	static constexpr nuint HISTORY_STATE_COUNT = static_cast<nuint>(CpuState::Count);
+
+	static constexpr uint8_t HISTORY_FRAME_KEY = 0;
+	static constexpr uint8_t HISTORY_FRAME_DELTA = 1;
+	static constexpr uint8_t HISTORY_FRAME_INDEX = 2;
+	// flags of a process in a frame
+	static constexpr uint8_t HISTORY_PROCESS_FULL = 1;
+	static constexpr uint8_t HISTORY_PROCESS_SCHED = 2;
+	// memory, kernal_time, user_time, then the scheduling counters
+	static constexpr nuint HISTORY_PROCESS_COUNTERS = 6;
+	static constexpr nuint HISTORY_PROCESS_BASIC_COUNTERS = 3;
+
+	// The integers of the fixed parts are in the byte order of the host
+	struct _historyHeader {
+		uint32_t m_magic;
+		uint32_t m_version;
+		uint32_t m_keyframe_interval;
+		uint32_t m_state_count;
+		// Nanoseconds since the unix epoch
+		uint64_t m_created;
+		uint64_t m_reserved;
+	};
+	struct _historyFrame {
+		// Bytes of the payload following the header
+		uint32_t m_size;
+		uint8_t m_kind;
+		uint8_t m_reserved[3];
+		// The timestamp of the sample, or of the last sample before an index frame
+		uint64_t m_timestamp;
+	};
+	struct _historyTrailer {
+		// 0 if no keyframe was written
+		uint64_t m_index_offset;
+		uint64_t m_end_timestamp;
+		uint64_t m_sample_count;
+		uint32_t m_reserved;
+		uint32_t m_magic;
+	};
+	static_assert(sizeof(_historyHeader) == 32 && sizeof(_historyFrame) == 16 && sizeof(_historyTrailer) == 32, "the history layout has no padding");
+
+	struct _historyIndexEntry {
+		uint64_t timestamp;
+		uint64_t offset;
+	};
+
+	static uint64_t get_epoch_nanos() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+	}
+	static void put_varint(std::vector<unsigned char>* pOut, uint64_t value) {
+		while (value >= 0x80) {
+			pOut->push_back(static_cast<unsigned char>(value | 0x80));
+			value >>= 7;
+		}
+		pOut->push_back(static_cast<unsigned char>(value));
+	}
+	// Small differences of either sign become small varints
+	static uint64_t encode_zigzag(uint64_t delta) {
+		return (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+	}
+	static uint64_t decode_zigzag(uint64_t value) {
+		return (value >> 1) ^ (~(value & 1) + 1);
+	}
+	static void get_process_counters(const HistoryProcess& process, uint64_t* pCounters) {
+		pCounters[0] = process.memory;
+		pCounters[1] = process.kernal_time;
+		pCounters[2] = process.user_time;
+		pCounters[3] = process.run_delay;
+		pCounters[4] = process.voluntary_ctxt_switches;
+		pCounters[5] = process.nonvoluntary_ctxt_switches;
+	}
+	static void set_process_counters(HistoryProcess* pProcess, const uint64_t* pCounters) {
+		pProcess->memory = static_cast<nuint>(pCounters[0]);
+		pProcess->kernal_time = static_cast<nuint>(pCounters[1]);
+		pProcess->user_time = static_cast<nuint>(pCounters[2]);
+		pProcess->run_delay = static_cast<nuint>(pCounters[3]);
+		pProcess->voluntary_ctxt_switches = static_cast<nuint>(pCounters[4]);
+		pProcess->nonvoluntary_ctxt_switches = static_cast<nuint>(pCounters[5]);
+	}
+	// Advance *pMatch over the previous processes to the one with pid, nullptr if there is none
+	static const HistoryProcess* find_history_process(const std::vector<HistoryProcess>& previous, nuint* pMatch, uint pid) {
+		while (*pMatch < previous.size() && previous[*pMatch].pid < pid) { ++*pMatch; }
+		if (*pMatch == previous.size() || previous[*pMatch].pid != pid) { return nullptr; }
+		return &previous[*pMatch];
+	}
+
+	// Reads the payload of a frame, any read past the end marks it failed
+	struct _historyInput {
+		const unsigned char* m_pos;
+		const unsigned char* m_end;
+		bool m_failed{};
+		nuint remaining() const { return static_cast<nuint>(this->m_end - this->m_pos); }
+		uint64_t varint() {
+			uint64_t value = 0;
+			for (uint shift = 0; shift < 64; shift += 7) {
+				if (this->m_pos == this->m_end) { break; }
+				unsigned char byte = *this->m_pos++;
+				value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if (!(byte & 0x80)) { return value; }
+			}
+			this->m_failed = true;
+			return 0;
+		}
+		uint8_t byte() {
+			if (this->m_pos == this->m_end) {
+				this->m_failed = true;
+				return 0;
+			}
+			return *this->m_pos++;
+		}
+		const char* bytes(nuint size) {
+			if (this->remaining() < size) {
+				this->m_failed = true;
+				return nullptr;
+			}
+			auto result = reinterpret_cast<const char*>(this->m_pos);
+			this->m_pos += size;
+			return result;
+		}
+	};
+
+	// file access, unavailable on windows
+#ifdef __WINDOWS_PLATFORM__
+	static int create_history_file(const std::string&) {
+		return -1;
+	}
+	static bool write_history_file(int, const void*, nuint) {
+		return false;
+	}
+	static void close_history_file(int) {}
+	static const unsigned char* map_history_file(const std::string&, nuint*) {
+		return nullptr;
+	}
+	static void unmap_history_file(const unsigned char*, nuint) {}
+#else
+	static int create_history_file(const std::string& path) {
+		return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	}
+	static bool write_history_file(int fd, const void* data, nuint size) {
+		auto pData = static_cast<const char*>(data);
+		while (size) {
+			auto count = write(fd, pData, size);
+			if (count < 0 && errno == EINTR) { continue; }
+			if (count <= 0) { return false; }
+			pData += count;
+			size -= static_cast<nuint>(count);
+		}
+		return true;
+	}
+	static void close_history_file(int fd) {
+		close(fd);
+	}
+	static const unsigned char* map_history_file(const std::string& path, nuint* pSize) {
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) { return nullptr; }
+		struct stat info {};
+		void* data = MAP_FAILED;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			data = mmap(nullptr, static_cast<nuint>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+		if (data == MAP_FAILED) { return nullptr; }
+		*pSize = static_cast<nuint>(info.st_size);
+		return static_cast<const unsigned char*>(data);
+	}
+	static void unmap_history_file(const unsigned char* data, nuint size) {
+		munmap(const_cast<unsigned char*>(data), size);
+	}
+#endif
+
+	struct HistoryWriter::_writerState {
+		std::mutex m_lock;
+		int m_fd{ -1 };
+		HistoryOptions m_options;
+		uint64_t m_offset{};
+		uint64_t m_sample_count{};
+		uint64_t m_last_timestamp{};
+		uint64_t m_last_index_offset{};
+		// keyframes written since the last index frame
+		std::vector<_historyIndexEntry> m_pending;
+		HistorySample m_previous;
+		HistorySample m_current;
+		std::vector<unsigned char> m_frame;
+		ProcessSampler m_sampler;
+		ProcessTable m_table;
+#ifndef __WINDOWS_PLATFORM__
+		_unixCpuSnapshot m_cpus;
+#endif
+	};
+
+	HistoryWriter::HistoryWriter() : m_state(std::make_unique<_writerState>()) {}
+	HistoryWriter::~HistoryWriter() {
+		this->Close();
+	}
+	bool HistoryWriter::Create(const std::string& path, const HistoryOptions& options) {
+		auto& state = *this->m_state;
+		std::lock_guard<std::mutex> lock(state.m_lock);
+		if (state.m_fd >= 0) { return false; }
+		int fd = create_history_file(path);
+		if (fd < 0) { return false; }
+		_historyHeader header{};
+		header.m_magic = HISTORY_MAGIC;
+		header.m_version = HISTORY_VERSION;
+		header.m_keyframe_interval = std::max(options.keyframe_interval, 1u);
+		header.m_state_count = static_cast<uint32_t>(HISTORY_STATE_COUNT);
+		header.m_created = get_epoch_nanos();
+		if (!write_history_file(fd, &header, sizeof(header))) {
+			close_history_file(fd);
+			return false;
+		}
+		state.m_fd = fd;
+		state.m_options.keyframe_interval = header.m_keyframe_interval;
+		state.m_options.index_interval = std::max(options.index_interval, 1u);
+		state.m_offset = sizeof(header);
+		state.m_sample_count = 0;
+		state.m_last_timestamp = 0;
+		state.m_last_index_offset = 0;
+		state.m_pending.clear();
+		state.m_previous = HistorySample{};
+		return true;
+	}
+	bool HistoryWriter::is_valid() const {
+		return this->m_state->m_fd >= 0;
+	}
+	uint64_t HistoryWriter::sample_count() const {
+		return this->m_state->m_sample_count;
+	}
+	bool HistoryWriter::write_frame(uint8_t kind, uint64_t timestamp) {
+		auto& state = *this->m_state;
+		_historyFrame frame{};
+		frame.m_size = static_cast<uint32_t>(state.m_frame.size() - sizeof(_historyFrame));
+		frame.m_kind = kind;
+		frame.m_timestamp = timestamp;
+		memcpy(state.m_frame.data(), &frame, sizeof(frame));
+		if (!write_history_file(state.m_fd, state.m_frame.data(), state.m_frame.size())) { return false; }
+		state.m_offset += state.m_frame.size();
+		return true;
+	}
+	bool HistoryWriter::write_index() {
+		auto& state = *this->m_state;
+		auto& frame = state.m_frame;
+		frame.resize(sizeof(_historyFrame));
+		// the index frames are chained backward from the trailer
+		put_varint(&frame, state.m_last_index_offset);
+		put_varint(&frame, state.m_pending.size());
+		_historyIndexEntry previous{};
+		for (auto& entry : state.m_pending) {
+			// the wall clock may step backward
+			put_varint(&frame, encode_zigzag(entry.timestamp - previous.timestamp));
+			put_varint(&frame, entry.offset - previous.offset);
+			previous = entry;
+		}
+		uint64_t offset = state.m_offset;
+		if (!this->write_frame(HISTORY_FRAME_INDEX, state.m_last_timestamp)) { return false; }
+		state.m_last_index_offset = offset;
+		state.m_pending.clear();
+		return true;
+	}
+	bool HistoryWriter::append_current() {
+		auto& state = *this->m_state;
+		auto& current = state.m_current;
+		auto& previous = state.m_previous;
+		if (current.cpu_times.size() != static_cast<nuint>(current.processor_count) * HISTORY_STATE_COUNT) { return false; }
+		auto by_pid = [] (const HistoryProcess& lhs, const HistoryProcess& rhs) { return lhs.pid < rhs.pid; };
+		if (!std::is_sorted(current.processes.begin(), current.processes.end(), by_pid)) {
+			std::sort(current.processes.begin(), current.processes.end(), by_pid);
+		}
+		bool is_keyframe = state.m_sample_count % state.m_options.keyframe_interval == 0 || current.processor_count != previous.processor_count;
+
+		auto& frame = state.m_frame;
+		frame.resize(sizeof(_historyFrame));
+		// processors
+		put_varint(&frame, current.processor_count);
+		for (nuint i = 0; i < current.cpu_times.size(); ++i) {
+			put_varint(&frame, is_keyframe ? current.cpu_times[i] : encode_zigzag(current.cpu_times[i] - previous.cpu_times[i]));
+		}
+		// processes, a process not in the previous sample or whose pid was reused is stored in full
+		put_varint(&frame, current.processes.size());
+		uint previous_pid = 0;
+		nuint match = 0;
+		uint64_t counters[HISTORY_PROCESS_COUNTERS];
+		uint64_t previous_counters[HISTORY_PROCESS_COUNTERS];
+		for (auto& process : current.processes) {
+			put_varint(&frame, process.pid - previous_pid);
+			previous_pid = process.pid;
+			const HistoryProcess* pPrevious = is_keyframe ? nullptr : find_history_process(previous.processes, &match, process.pid);
+			if (pPrevious && (pPrevious->start_time != process.start_time || pPrevious->has_sched != process.has_sched)) {
+				pPrevious = nullptr;
+			}
+			frame.push_back((pPrevious ? 0 : HISTORY_PROCESS_FULL) | (process.has_sched ? HISTORY_PROCESS_SCHED : 0));
+			nuint counter_count = process.has_sched ? HISTORY_PROCESS_COUNTERS : HISTORY_PROCESS_BASIC_COUNTERS;
+			get_process_counters(process, counters);
+			if (pPrevious) {
+				get_process_counters(*pPrevious, previous_counters);
+				for (nuint c = 0; c < counter_count; ++c) {
+					put_varint(&frame, encode_zigzag(counters[c] - previous_counters[c]));
+				}
+				continue;
+			}
+			put_varint(&frame, process.start_time);
+			put_varint(&frame, process.name.size());
+			frame.insert(frame.end(), process.name.begin(), process.name.end());
+			for (nuint c = 0; c < counter_count; ++c) {
+				put_varint(&frame, counters[c]);
+			}
+		}
+
+		uint64_t offset = state.m_offset;
+		if (!this->write_frame(is_keyframe ? HISTORY_FRAME_KEY : HISTORY_FRAME_DELTA, current.timestamp)) { return false; }
+		std::swap(previous, current);
+		++state.m_sample_count;
+		state.m_last_timestamp = previous.timestamp;
+		if (is_keyframe) {
+			state.m_pending.push_back({ previous.timestamp, offset });
+			if (state.m_pending.size() >= state.m_options.index_interval) { return this->write_index(); }
+		}
+		return true;
+	}
+	bool HistoryWriter::Append(const HistorySample& sample) {
+		auto& state = *this->m_state;
+		std::lock_guard<std::mutex> lock(state.m_lock);
+		if (state.m_fd < 0) { return false; }
+		state.m_current = sample;
+		return this->append_current();
+	}
+	bool HistoryWriter::Record() {
+		auto& state = *this->m_state;
+		std::lock_guard<std::mutex> lock(state.m_lock);
+		if (state.m_fd < 0) { return false; }
+		auto& current = state.m_current;
+		current.timestamp = get_epoch_nanos();
+		current.processor_count = 0;
+		current.cpu_times.clear();
+#ifndef __WINDOWS_PLATFORM__
+		if (UnixInfoParser::read_cpus_snapshot(&state.m_cpus)) {
+			// the columns of the snapshot have the layout of cpu_times
+			current.processor_count = static_cast<uint>(state.m_cpus.size());
+			current.cpu_times.assign(state.m_cpus.m_data.begin(), state.m_cpus.m_data.end());
+		}
+#endif
+		state.m_sampler.Sample(&state.m_table);
+		// the records keep the capacity of their names
+		current.processes.resize(state.m_table.size());
+		nuint count = 0;
+		for (nuint i = 0; i < state.m_table.size(); ++i) {
+			auto view = state.m_table[i];
+			// vanished during the scan
+			if (view.pid() == ~uint()) { continue; }
+			auto& process = current.processes[count++];
+			process.pid = view.pid();
+			process.start_time = view.start_time();
+			process.name.assign(view.name());
+			process.memory = view.memory();
+			process.kernal_time = view.kernal_time();
+			process.user_time = view.user_time();
+			auto pSched = view.sched();
+			process.has_sched = pSched != nullptr;
+			process.run_delay = pSched ? pSched->run_delay : 0;
+			process.voluntary_ctxt_switches = pSched ? pSched->voluntary_ctxt_switches : 0;
+			process.nonvoluntary_ctxt_switches = pSched ? pSched->nonvoluntary_ctxt_switches : 0;
+		}
+		current.processes.resize(count);
+		return this->append_current();
+	}
+	void HistoryWriter::run(uint interval_millis) {
+		std::unique_lock<std::mutex> lock(this->m_mutex);
+		while (!this->m_stopping) {
+			lock.unlock();
+			this->Record();
+			lock.lock();
+			this->m_stop_signal.wait_for(lock, std::chrono::milliseconds(interval_millis), [this]() { return this->m_stopping; });
+		}
+	}
+	bool HistoryWriter::Start(uint interval_millis) {
+		if (!this->is_valid() || this->m_thread.joinable()) { return false; }
+		this->m_stopping = false;
+		this->m_thread = std::thread(&HistoryWriter::run, this, interval_millis);
+		return true;
+	}
+	void HistoryWriter::Stop() {
+		if (!this->m_thread.joinable()) { return; }
+		{
+			std::lock_guard<std::mutex> lock(this->m_mutex);
+			this->m_stopping = true;
+		}
+		this->m_stop_signal.notify_all();
+		this->m_thread.join();
+	}
+	void HistoryWriter::Close() {
+		this->Stop();
+		auto& state = *this->m_state;
+		std::lock_guard<std::mutex> lock(state.m_lock);
+		if (state.m_fd < 0) { return; }
+		// without the trailer the reader scans the frames, so a failed write loses nothing
+		if (state.m_pending.empty() || this->write_index()) {
+			_historyTrailer trailer{};
+			trailer.m_index_offset = state.m_last_index_offset;
+			trailer.m_end_timestamp = state.m_last_timestamp;
+			trailer.m_sample_count = state.m_sample_count;
+			trailer.m_magic = HISTORY_TRAILER_MAGIC;
+			write_history_file(state.m_fd, &trailer, sizeof(trailer));
+		}
+		close_history_file(state.m_fd);
+		state.m_fd = -1;
+	}
+
+	HistoryReader HistoryReader::Open(const std::string& path) {
+		HistoryReader reader;
+		nuint size = 0;
+		auto data = map_history_file(path, &size);
+		if (!data) { return reader; }
+		reader.m_data = data;
+		reader.m_size = size;
+		_historyHeader header{};
+		if (size < sizeof(header)) {
+			reader.release();
+			return reader;
+		}
+		memcpy(&header, data, sizeof(header));
+		if (header.m_magic != HISTORY_MAGIC || header.m_version != HISTORY_VERSION || header.m_state_count != HISTORY_STATE_COUNT) {
+			reader.release();
+			return reader;
+		}
+		reader.m_end = size;
+		if (!reader.load_index()) {
+			reader.scan_frames();
+		}
+		reader.m_cursor = reader.m_keyframes.empty() ? reader.m_end : static_cast<nuint>(reader.m_keyframes.front().offset);
+		return reader;
+	}
+	bool HistoryReader::load_index() {
+		if (this->m_size < sizeof(_historyHeader) + sizeof(_historyTrailer)) { return false; }
+		_historyTrailer trailer{};
+		memcpy(&trailer, this->m_data + this->m_size - sizeof(trailer), sizeof(trailer));
+		if (trailer.m_magic != HISTORY_TRAILER_MAGIC) { return false; }
+		this->m_end = this->m_size - sizeof(trailer);
+		this->m_end_timestamp = trailer.m_end_timestamp;
+		// the chain is walked from the last index frame, each frame lists its keyframes in order
+		std::vector<_historyIndexEntry> entries;
+		uint64_t offset = trailer.m_index_offset;
+		uint64_t limit = this->m_end;
+		while (offset) {
+			_historyFrame frame{};
+			if (offset < sizeof(_historyHeader) || offset + sizeof(frame) > limit) { break; }
+			memcpy(&frame, this->m_data + offset, sizeof(frame));
+			if (frame.m_kind != HISTORY_FRAME_INDEX || offset + sizeof(frame) + frame.m_size > limit) { break; }
+			_historyInput input{ this->m_data + offset + sizeof(frame), this->m_data + offset + sizeof(frame) + frame.m_size };
+			uint64_t previous_index = input.varint();
+			uint64_t count = input.varint();
+			if (input.m_failed || count > input.remaining()) { break; }
+			nuint first = entries.size();
+			_historyIndexEntry entry{};
+			for (uint64_t i = 0; i < count; ++i) {
+				entry.timestamp += decode_zigzag(input.varint());
+				entry.offset += input.varint();
+				entries.push_back(entry);
+			}
+			if (input.m_failed) { break; }
+			std::reverse(entries.begin() + first, entries.end());
+			// an index frame only points backward
+			limit = offset;
+			offset = previous_index;
+		}
+		if (offset) { return false; }
+		this->m_keyframes.resize(entries.size());
+		for (nuint i = 0; i < entries.size(); ++i) {
+			auto& entry = entries[entries.size() - 1 - i];
+			if (entry.offset < sizeof(_historyHeader) || entry.offset >= this->m_end) {
+				this->m_keyframes.clear();
+				return false;
+			}
+			this->m_keyframes[i] = { entry.timestamp, entry.offset };
+		}
+		return true;
+	}
+	void HistoryReader::scan_frames() {
+		this->m_keyframes.clear();
+		// only the headers of the frames are read, a truncated frame at the end is left out
+		nuint offset = sizeof(_historyHeader);
+		_historyFrame frame{};
+		while (offset + sizeof(frame) <= this->m_end) {
+			memcpy(&frame, this->m_data + offset, sizeof(frame));
+			if (offset + sizeof(frame) + frame.m_size > this->m_end) { break; }
+			if (frame.m_kind == HISTORY_FRAME_KEY) {
+				this->m_keyframes.push_back({ frame.m_timestamp, offset });
+			}
+			if (frame.m_kind != HISTORY_FRAME_INDEX) {
+				this->m_end_timestamp = frame.m_timestamp;
+			}
+			offset += sizeof(frame) + frame.m_size;
+		}
+		this->m_end = offset;
+	}
+	bool HistoryReader::decode_next() {
+		_historyFrame frame{};
+		while (true) {
+			if (this->m_cursor + sizeof(frame) > this->m_end) { return false; }
+			memcpy(&frame, this->m_data + this->m_cursor, sizeof(frame));
+			if (this->m_cursor + sizeof(frame) + frame.m_size > this->m_end) { return false; }
+			if (frame.m_kind != HISTORY_FRAME_INDEX) { break; }
+			this->m_cursor += sizeof(frame) + frame.m_size;
+		}
+		bool is_keyframe = frame.m_kind == HISTORY_FRAME_KEY;
+		if (!is_keyframe && (frame.m_kind != HISTORY_FRAME_DELTA || !this->m_has_sample)) { return false; }
+		const HistorySample& previous = this->m_sample;
+		HistorySample& sample = this->m_decoding;
+		_historyInput input{ this->m_data + this->m_cursor + sizeof(frame), this->m_data + this->m_cursor + sizeof(frame) + frame.m_size };
+		sample.timestamp = frame.m_timestamp;
+
+		// processors
+		uint64_t processor_count = input.varint();
+		if (processor_count > input.remaining() / HISTORY_STATE_COUNT) { return false; }
+		if (!is_keyframe && processor_count != previous.processor_count) { return false; }
+		sample.processor_count = static_cast<uint>(processor_count);
+		sample.cpu_times.resize(static_cast<nuint>(processor_count) * HISTORY_STATE_COUNT);
+		for (nuint i = 0; i < sample.cpu_times.size(); ++i) {
+			uint64_t value = input.varint();
+			sample.cpu_times[i] = is_keyframe ? value : previous.cpu_times[i] + decode_zigzag(value);
+		}
+
+		// processes, each takes at least the pid and the flags
+		uint64_t process_count = input.varint();
+		if (input.m_failed || process_count > input.remaining() / 2) { return false; }
+		sample.processes.resize(static_cast<nuint>(process_count));
+		uint pid = 0;
+		nuint match = 0;
+		uint64_t counters[HISTORY_PROCESS_COUNTERS]{};
+		for (auto& process : sample.processes) {
+			pid += static_cast<uint>(input.varint());
+			uint8_t flags = input.byte();
+			process.pid = pid;
+			process.has_sched = (flags & HISTORY_PROCESS_SCHED) != 0;
+			nuint counter_count = process.has_sched ? HISTORY_PROCESS_COUNTERS : HISTORY_PROCESS_BASIC_COUNTERS;
+			if (flags & HISTORY_PROCESS_FULL) {
+				process.start_time = static_cast<nuint>(input.varint());
+				uint64_t name_size = input.varint();
+				if (name_size > input.remaining()) { return false; }
+				process.name.assign(input.bytes(static_cast<nuint>(name_size)), static_cast<nuint>(name_size));
+				std::fill_n(counters, HISTORY_PROCESS_COUNTERS, 0);
+				for (nuint c = 0; c < counter_count; ++c) {
+					counters[c] = input.varint();
+				}
+			} else {
+				auto pPrevious = is_keyframe ? nullptr : find_history_process(previous.processes, &match, pid);
+				if (!pPrevious || pPrevious->has_sched != process.has_sched) { return false; }
+				process.start_time = pPrevious->start_time;
+				process.name.assign(pPrevious->name);
+				get_process_counters(*pPrevious, counters);
+				for (nuint c = 0; c < counter_count; ++c) {
+					counters[c] += decode_zigzag(input.varint());
+				}
+			}
+			set_process_counters(&process, counters);
+			if (input.m_failed) { return false; }
+		}
+		if (input.m_failed) { return false; }
+
+		std::swap(this->m_sample, this->m_decoding);
+		this->m_has_sample = true;
+		this->m_cursor += sizeof(frame) + frame.m_size;
+		return true;
+	}
+	void HistoryReader::release() {
+		if (this->m_data) {
+			unmap_history_file(this->m_data, this->m_size);
+		}
+		this->m_data = nullptr;
+		this->m_size = 0;
+		this->m_end = 0;
+		this->m_end_timestamp = 0;
+		this->m_keyframes.clear();
+		this->m_cursor = 0;
+		this->m_has_sample = false;
+	}
+	HistoryReader::HistoryReader(HistoryReader&& other) noexcept {
+		*this = std::move(other);
+	}
+	HistoryReader& HistoryReader::operator=(HistoryReader&& other) noexcept {
+		if (this == &other) { return *this; }
+		this->release();
+		this->m_data = other.m_data;
+		this->m_size = other.m_size;
+		this->m_end = other.m_end;
+		this->m_end_timestamp = other.m_end_timestamp;
+		this->m_keyframes = std::move(other.m_keyframes);
+		this->m_cursor = other.m_cursor;
+		this->m_has_sample = other.m_has_sample;
+		this->m_sample = std::move(other.m_sample);
+		this->m_decoding = std::move(other.m_decoding);
+		other.m_data = nullptr;
+		other.release();
+		return *this;
+	}
+	HistoryReader::~HistoryReader() {
+		this->release();
+	}
+	bool HistoryReader::is_valid() const {
+		return this->m_data != nullptr;
+	}
+	uint64_t HistoryReader::begin_timestamp() const {
+		return this->m_keyframes.empty() ? 0 : this->m_keyframes.front().timestamp;
+	}
+	uint64_t HistoryReader::end_timestamp() const {
+		return this->m_keyframes.empty() ? 0 : this->m_end_timestamp;
+	}
+	bool HistoryReader::Seek(uint64_t timestamp) {
+		if (this->m_keyframes.empty()) { return false; }
+		// the last keyframe at or before timestamp, samples between it and timestamp are decoded and dropped
+		auto it = std::upper_bound(this->m_keyframes.begin(), this->m_keyframes.end(), timestamp, [] (uint64_t key, const _keyframe& keyframe) {
+			return key < keyframe.timestamp;
+		});
+		if (it != this->m_keyframes.begin()) { --it; }
+		this->m_cursor = static_cast<nuint>(it->offset);
+		this->m_has_sample = false;
+		_historyFrame frame{};
+		while (this->m_cursor + sizeof(frame) <= this->m_end) {
+			memcpy(&frame, this->m_data + this->m_cursor, sizeof(frame));
+			if (frame.m_kind == HISTORY_FRAME_INDEX) {
+				this->m_cursor += sizeof(frame) + frame.m_size;
+				continue;
+			}
+			if (frame.m_timestamp >= timestamp) { return true; }
+			if (!this->decode_next()) { return false; }
+		}
+		return false;
+	}
+	const HistorySample* HistoryReader::Next() {
+		return this->decode_next() ? &this->m_sample : nullptr;
+	}
+	nuint HistoryReader::GetProcessorUsages(const HistorySample& previous, const HistorySample& current, double* pUsages, nuint capacity) {
+		nuint count = current.processor_count;
+		if (!pUsages || previous.processor_count != count || current.cpu_times.size() != count * HISTORY_STATE_COUNT
+			|| previous.cpu_times.size() != current.cpu_times.size()) {
+			return 0;
+		}
+		count = std::min(count, capacity);
+		nuint idle_column = static_cast<nuint>(CpuState::Idle);
+		for (nuint i = 0; i < count; ++i) {
+			double total = 0.0;
+			for (nuint s = 0; s < HISTORY_STATE_COUNT; ++s) {
+				nuint index = s * current.processor_count + i;
+				total += static_cast<double>(static_cast<int64_t>(current.cpu_times[index] - previous.cpu_times[index]));
+			}
+			nuint idle_index = idle_column * current.processor_count + i;
+			double idle = static_cast<double>(static_cast<int64_t>(current.cpu_times[idle_index] - previous.cpu_times[idle_index]));
+			pUsages[i] = total > 0.0 ? (total - idle) / total * 100.0 : 0.0;
+		}
+		return count;
+	}
+};
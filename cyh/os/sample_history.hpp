@@ -0,0 +1,129 @@
+#pragma once
+#include "os_.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+namespace cyh::os {
+	struct HistoryProcess {
+		uint pid{};
+		nuint start_time{};
+		std::string name;
+		nuint memory{};
+		nuint kernal_time{};
+		nuint user_time{};
+		// The scheduling counters below are valid only if has_sched is set
+		bool has_sched{};
+		nuint run_delay{};
+		nuint voluntary_ctxt_switches{};
+		nuint nonvoluntary_ctxt_switches{};
+	};
+	// A sample of the host stored in a history file, the counters are cumulative as read from the system
+	struct HistorySample {
+		// Nanoseconds since the unix epoch
+		uint64_t timestamp{};
+		uint processor_count{};
+		// Clock ticks of processor i in state s at [s * processor_count + i], the layout of the state usages of ResourceMonitor
+		std::vector<uint64_t> cpu_times;
+		// Sorted by pid
+		std::vector<HistoryProcess> processes;
+	};
+	struct HistoryOptions {
+		// A sample is stored in full every keyframe_interval samples, the others as deltas from the previous one
+		// A reader seeking a timestamp decodes at most keyframe_interval samples
+		uint keyframe_interval{ 60 };
+		// Keyframes indexed by each index frame
+		uint index_interval{ 16 };
+	};
+
+	// Append samples to a binary history file ( unix only )
+	// A frame is a fixed header with its size and timestamp followed by varint encoded counters,
+	// the counters of a delta frame are zigzag encoded differences to the previous sample, so an idle
+	// process costs a few bytes per sample. Index frames listing the keyframes are appended periodically
+	// and Close appends a trailer pointing to the last of them
+	class HistoryWriter {
+		struct _writerState;
+		std::unique_ptr<_writerState> m_state;
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_stop_signal;
+		bool m_stopping{};
+
+		// Encode m_current against m_previous and write it as a frame
+		bool append_current();
+		bool write_frame(uint8_t kind, uint64_t timestamp);
+		bool write_index();
+		void run(uint interval_millis);
+	public:
+		HistoryWriter();
+		HistoryWriter(const HistoryWriter&) = delete;
+		HistoryWriter& operator=(const HistoryWriter&) = delete;
+		~HistoryWriter();
+
+		// Create the file, a file already at path is replaced, return false if failed
+		bool Create(const std::string& path, const HistoryOptions& options = {});
+		bool is_valid() const;
+		// Count of samples appended
+		uint64_t sample_count() const;
+		// Append a sample, its processes are sorted by pid if they are not
+		bool Append(const HistorySample& sample);
+		// Sample the processors and the processes of the host and append them
+		bool Record();
+		// Record every interval_millis on a background thread until Stop
+		bool Start(uint interval_millis = 1000u);
+		void Stop();
+		// Stop, write the last index and the trailer then close the file, the destructor calls it
+		// A file not closed is still readable, the reader then scans the frame headers to find the keyframes
+		void Close();
+	};
+
+	// Read a history file through a read only mapping, samples are decoded only from the keyframe before the position
+	// The file is mapped as it is when opened, a frame being written is ignored
+	class HistoryReader {
+		struct _keyframe {
+			uint64_t timestamp;
+			uint64_t offset;
+		};
+		const unsigned char* m_data{};
+		nuint m_size{};
+		// End of the frames, the trailer follows it if the file is closed
+		nuint m_end{};
+		uint64_t m_end_timestamp{};
+		std::vector<_keyframe> m_keyframes;
+		// Offset of the next frame to decode
+		nuint m_cursor{};
+		bool m_has_sample{};
+		HistorySample m_sample;
+		HistorySample m_decoding;
+
+		bool load_index();
+		void scan_frames();
+		// Decode the frame at m_cursor into m_sample, return false at the end or if it is corrupted
+		bool decode_next();
+		void release();
+	public:
+		static HistoryReader Open(const std::string& path);
+
+		HistoryReader() = default;
+		HistoryReader(const HistoryReader&) = delete;
+		HistoryReader& operator=(const HistoryReader&) = delete;
+		HistoryReader(HistoryReader&& other) noexcept;
+		HistoryReader& operator=(HistoryReader&& other) noexcept;
+		~HistoryReader();
+
+		bool is_valid() const;
+		nuint keyframe_count() const { return this->m_keyframes.size(); }
+		// Timestamps of the first and the last sample, 0 if empty
+		uint64_t begin_timestamp() const;
+		uint64_t end_timestamp() const;
+		// Position before the first sample at or after timestamp, return false if there is none
+		bool Seek(uint64_t timestamp);
+		// Decode the next sample, nullptr at the end, the sample is valid until the next call
+		const HistorySample* Next();
+
+		// Usage of each processor in percent between two samples, return the count written, 0 if they do not match
+		static nuint GetProcessorUsages(const HistorySample& previous, const HistorySample& current, double* pUsages, nuint capacity);
+	};
+};
@@ -0,0 +1,175 @@
+#include "shm_arena.hpp"
+namespace cyh::os {
+	static constexpr uint32_t ARENA_MAGIC = 0x4E524141; // "AARN"
+	static constexpr uint32_t ARENA_VERSION = 1;
+	static constexpr nuint ARENA_ALIGNMENT = 64;
+	// The smallest block including its header
+	static constexpr uint ARENA_MIN_BLOCK_SHIFT = 5;
+	static constexpr uint32_t ARENA_BLOCK_USED = 0x44455355; // "USED"
+	static constexpr uint32_t ARENA_BLOCK_FREE = 0x45455246; // "FREE"
+	static constexpr uint64_t ARENA_OFFSET_MASK = (uint64_t(1) << 48) - 1;
+	static constexpr uint ARENA_TAG_SHIFT = 48;
+
+	// Header in front of every block, blocks are addressed by their offset from the heap
+	struct _arenaBlock {
+		uint32_t m_class;
+		uint32_t m_state;
+		// offset of the next free block while in a free list
+		std::atomic<uint64_t> m_next;
+	};
+	static_assert(sizeof(_arenaBlock) == SharedHeap::ALIGNMENT, "block header must keep the payload aligned");
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared arena requires lock free 64 bit atomics");
+
+	static nuint align_arena_size(nuint size, nuint alignment) {
+		return (size + alignment - 1) & ~(alignment - 1);
+	}
+	// The smallest class whose block holds size bytes of payload, CLASS_COUNT if too large
+	static uint get_size_class(nuint size, uint class_count) {
+		nuint block_size = size + sizeof(_arenaBlock);
+		if (block_size < size) { return class_count; }
+		uint size_class = 0;
+		while (size_class < class_count && (nuint(1) << (size_class + ARENA_MIN_BLOCK_SHIFT)) < block_size) {
+			++size_class;
+		}
+		return size_class;
+	}
+	static nuint get_class_block_size(uint size_class) {
+		return nuint(1) << (size_class + ARENA_MIN_BLOCK_SHIFT);
+	}
+	static uint64_t make_tagged_offset(uint64_t tagged, uint64_t offset) {
+		uint64_t tag = (tagged >> ARENA_TAG_SHIFT) + 1;
+		return (tag << ARENA_TAG_SHIFT) | (offset & ARENA_OFFSET_MASK);
+	}
+
+	void SharedHeap::initialize(nuint capacity) {
+		this->m_version = ARENA_VERSION;
+		this->m_capacity = capacity;
+		this->m_root.store(0, std::memory_order_relaxed);
+		this->m_bump.store(align_arena_size(sizeof(SharedHeap), ARENA_ALIGNMENT), std::memory_order_relaxed);
+		for (auto& free_list : this->m_free_lists) {
+			free_list.m_head.store(0, std::memory_order_relaxed);
+		}
+		this->m_magic.store(ARENA_MAGIC, std::memory_order_release);
+	}
+	bool SharedHeap::is_initialized() const {
+		return this->m_magic.load(std::memory_order_acquire) == ARENA_MAGIC && this->m_version == ARENA_VERSION;
+	}
+	uint64_t SharedHeap::carve_block(uint size_class) {
+		uint64_t block_size = get_class_block_size(size_class);
+		uint64_t bump = this->m_bump.load(std::memory_order_relaxed);
+		do {
+			// a failed large request must not consume the space left for smaller ones
+			if (bump + block_size > this->m_capacity || bump + block_size < bump) { return 0; }
+		} while (!this->m_bump.compare_exchange_weak(bump, bump + block_size, std::memory_order_relaxed));
+		return bump;
+	}
+	uint64_t SharedHeap::pop_free_block(uint size_class) {
+		auto& head = this->m_free_lists[size_class].m_head;
+		uint64_t tagged = head.load(std::memory_order_acquire);
+		while (true) {
+			uint64_t offset = tagged & ARENA_OFFSET_MASK;
+			if (!offset) { return 0; }
+			// the block may be popped and reused by another process meanwhile, then the tag makes the exchange fail
+			auto block = reinterpret_cast<_arenaBlock*>(reinterpret_cast<unsigned char*>(this) + offset);
+			uint64_t next = block->m_next.load(std::memory_order_relaxed);
+			if (head.compare_exchange_weak(tagged, make_tagged_offset(tagged, next), std::memory_order_acquire, std::memory_order_acquire)) {
+				return offset;
+			}
+		}
+	}
+	void SharedHeap::push_free_block(uint size_class, uint64_t offset) {
+		auto& head = this->m_free_lists[size_class].m_head;
+		auto block = reinterpret_cast<_arenaBlock*>(reinterpret_cast<unsigned char*>(this) + offset);
+		uint64_t tagged = head.load(std::memory_order_relaxed);
+		do {
+			block->m_next.store(tagged & ARENA_OFFSET_MASK, std::memory_order_relaxed);
+		} while (!head.compare_exchange_weak(tagged, make_tagged_offset(tagged, offset), std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	void* SharedHeap::Allocate(nuint size) {
+		uint size_class = get_size_class(size, CLASS_COUNT);
+		if (size_class >= CLASS_COUNT) { return nullptr; }
+		uint64_t offset = this->pop_free_block(size_class);
+		if (!offset) {
+			offset = this->carve_block(size_class);
+			if (!offset) { return nullptr; }
+		}
+		auto block = reinterpret_cast<_arenaBlock*>(reinterpret_cast<unsigned char*>(this) + offset);
+		block->m_class = size_class;
+		block->m_state = ARENA_BLOCK_USED;
+		return block + 1;
+	}
+	void SharedHeap::Deallocate(void* ptr) {
+		if (!ptr) { return; }
+		auto block = reinterpret_cast<_arenaBlock*>(ptr) - 1;
+		uint64_t offset = static_cast<uint64_t>(reinterpret_cast<unsigned char*>(block) - reinterpret_cast<unsigned char*>(this));
+		if (offset >= this->m_capacity) { return; }
+		// also rejects a double free
+		if (block->m_state != ARENA_BLOCK_USED || block->m_class >= CLASS_COUNT) { return; }
+		block->m_state = ARENA_BLOCK_FREE;
+		this->push_free_block(block->m_class, offset);
+	}
+	nuint SharedHeap::GetBlockSize(const void* ptr) const {
+		if (!ptr) { return 0; }
+		auto block = reinterpret_cast<const _arenaBlock*>(ptr) - 1;
+		if (block->m_state != ARENA_BLOCK_USED || block->m_class >= CLASS_COUNT) { return 0; }
+		return get_class_block_size(block->m_class) - sizeof(_arenaBlock);
+	}
+	void SharedHeap::SetRoot(void* ptr) {
+		uint64_t offset = ptr ? static_cast<uint64_t>((unsigned char*)ptr - (unsigned char*)this) : 0;
+		this->m_root.store(offset, std::memory_order_release);
+	}
+	void* SharedHeap::GetRoot() const {
+		uint64_t offset = this->m_root.load(std::memory_order_acquire);
+		if (!offset) { return nullptr; }
+		return (unsigned char*)this + offset;
+	}
+	nuint SharedHeap::capacity() const {
+		return static_cast<nuint>(this->m_capacity);
+	}
+	nuint SharedHeap::high_water() const {
+		return static_cast<nuint>(this->m_bump.load(std::memory_order_relaxed));
+	}
+
+	SharedArena::SharedArena(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize) : m_holder(std::move(holder)) {
+		if (!this->m_holder.data()) { return; }
+		auto address = reinterpret_cast<uintptr_t>(this->m_holder.data());
+		auto base = reinterpret_cast<unsigned char*>(align_arena_size(address, ARENA_ALIGNMENT));
+		nuint usable = this->m_holder.capacity() - static_cast<nuint>(base - (unsigned char*)this->m_holder.data());
+		if (usable < align_arena_size(sizeof(SharedHeap), ARENA_ALIGNMENT)) { return; }
+		auto heap = reinterpret_cast<SharedHeap*>(base);
+		if (initialize) {
+			heap = new (base) SharedHeap{};
+			heap->initialize(usable);
+			this->m_holder.MarkReady();
+		} else if (!heap->is_initialized() || heap->m_capacity > usable) {
+			return;
+		}
+		this->m_heap = heap;
+	}
+	SharedArena::SharedArena(SharedArena&& other) noexcept {
+		*this = std::move(other);
+	}
+	SharedArena& SharedArena::operator=(SharedArena&& other) noexcept {
+		if (this == &other) { return *this; }
+		this->m_holder = std::move(other.m_holder);
+		this->m_heap = other.m_heap;
+		other.m_heap = nullptr;
+		return *this;
+	}
+	bool SharedArena::is_valid() const {
+		return this->m_heap != nullptr;
+	}
+	SharedHeap* SharedArena::heap() const {
+		return this->m_heap;
+	}
+	SharedArena SharedArena::Create(const std::string& name, nuint capacity, const SharedMemoryManager::SharedMemoryOptions& options) {
+		nuint size = capacity + align_arena_size(sizeof(SharedHeap), ARENA_ALIGNMENT) + ARENA_ALIGNMENT;
+		SharedMemoryManager::SharedMemoryOptions create_options = options;
+		create_options.defer_ready = true;
+		return SharedArena(SharedMemoryManager::CreateSharedMemory(name, size, create_options), true);
+	}
+	SharedArena SharedArena::Open(const std::string& name, const SharedMemoryManager::SharedMemoryOptions& options) {
+		return SharedArena(SharedMemoryManager::OpenSharedMemory(SharedMemoryManager::ACCESS_READWRITE, name, options), false);
+	}
+};
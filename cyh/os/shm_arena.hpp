@@ -0,0 +1,199 @@
+#pragma once
+#include "shmem_mgr.hpp"
+#include <atomic>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <vector>
+namespace cyh::os {
+	// Pointer stored as the distance from its own address, so it stays valid in every process mapping the segment
+	// Copies are rebased to their new address, a shm_ptr can not point to itself since distance 0 means nullptr
+	template<class T>
+	class shm_ptr {
+		std::intptr_t m_offset{};
+
+		void set(T* ptr) noexcept {
+			this->m_offset = ptr ? static_cast<std::intptr_t>(reinterpret_cast<std::uintptr_t>(ptr) - reinterpret_cast<std::uintptr_t>(this)) : 0;
+		}
+	public:
+		using element_type = T;
+		using value_type = std::remove_cv_t<T>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = shm_ptr<T>;
+		using reference = std::add_lvalue_reference_t<T>;
+		using iterator_category = std::random_access_iterator_tag;
+		template<class U>
+		using rebind = shm_ptr<U>;
+
+		shm_ptr() noexcept = default;
+		shm_ptr(std::nullptr_t) noexcept {}
+		shm_ptr(T* ptr) noexcept { this->set(ptr); }
+		shm_ptr(const shm_ptr& other) noexcept { this->set(other.get()); }
+		template<class U> requires std::is_convertible_v<U*, T*>
+		shm_ptr(const shm_ptr<U>& other) noexcept { this->set(other.get()); }
+		template<class U> requires (!std::is_convertible_v<U*, T*> && requires(U* ptr) { static_cast<T*>(ptr); })
+		explicit shm_ptr(const shm_ptr<U>& other) noexcept { this->set(static_cast<T*>(other.get())); }
+
+		shm_ptr& operator=(const shm_ptr& other) noexcept { this->set(other.get()); return *this; }
+		shm_ptr& operator=(T* ptr) noexcept { this->set(ptr); return *this; }
+		shm_ptr& operator=(std::nullptr_t) noexcept { this->m_offset = 0; return *this; }
+
+		T* get() const noexcept {
+			return this->m_offset ? reinterpret_cast<T*>(reinterpret_cast<std::uintptr_t>(this) + static_cast<std::uintptr_t>(this->m_offset)) : nullptr;
+		}
+		T* operator->() const noexcept { return this->get(); }
+		reference operator*() const noexcept { return *this->get(); }
+		reference operator[](difference_type index) const noexcept { return this->get()[index]; }
+		explicit operator bool() const noexcept { return this->m_offset != 0; }
+
+		// Required by std::pointer_traits for fancy pointers
+		template<class U = T> requires (!std::is_void_v<U>)
+		static shm_ptr pointer_to(U& ref) noexcept { return shm_ptr(std::addressof(ref)); }
+
+		shm_ptr& operator++() noexcept { return *this = this->get() + 1; }
+		shm_ptr& operator--() noexcept { return *this = this->get() - 1; }
+		shm_ptr operator++(int) noexcept { shm_ptr result(*this); ++*this; return result; }
+		shm_ptr operator--(int) noexcept { shm_ptr result(*this); --*this; return result; }
+		shm_ptr& operator+=(difference_type count) noexcept { return *this = this->get() + count; }
+		shm_ptr& operator-=(difference_type count) noexcept { return *this = this->get() - count; }
+		friend shm_ptr operator+(const shm_ptr& ptr, difference_type count) noexcept { return shm_ptr(ptr.get() + count); }
+		friend shm_ptr operator+(difference_type count, const shm_ptr& ptr) noexcept { return shm_ptr(ptr.get() + count); }
+		friend shm_ptr operator-(const shm_ptr& ptr, difference_type count) noexcept { return shm_ptr(ptr.get() - count); }
+		friend difference_type operator-(const shm_ptr& lhs, const shm_ptr& rhs) noexcept { return lhs.get() - rhs.get(); }
+		friend bool operator==(const shm_ptr& lhs, const shm_ptr& rhs) noexcept { return lhs.get() == rhs.get(); }
+		friend std::strong_ordering operator<=>(const shm_ptr& lhs, const shm_ptr& rhs) noexcept { return std::compare_three_way{}(lhs.get(), rhs.get()); }
+	};
+
+	// Allocator state placed in a shared memory, every process mapping it can allocate and free
+	// Blocks are grouped by power of 2 size classes, each class keeps a lock free free list
+	// and new blocks are carved from the unused space by a bump pointer
+	class SharedHeap {
+		friend class SharedArena;
+		static constexpr uint CLASS_COUNT = 40;
+		struct alignas(64) _freeList {
+			// offset of the first free block in the low 48 bits, an ABA tag in the high 16 bits
+			std::atomic<uint64_t> m_head;
+		};
+		std::atomic<uint32_t> m_magic;
+		uint32_t m_version;
+		// bytes from the beginning of the heap to the end of the segment
+		uint64_t m_capacity;
+		// offset of the object published by SetRoot
+		std::atomic<uint64_t> m_root;
+		alignas(64) std::atomic<uint64_t> m_bump;
+		_freeList m_free_lists[CLASS_COUNT];
+
+		SharedHeap() = default;
+		void initialize(nuint capacity);
+		bool is_initialized() const;
+		// Carve a new block of the class from the unused space, 0 if full
+		uint64_t carve_block(uint size_class);
+		uint64_t pop_free_block(uint size_class);
+		void push_free_block(uint size_class, uint64_t offset);
+	public:
+		// Alignment of every allocated address
+		static constexpr nuint ALIGNMENT = 16;
+
+		SharedHeap(const SharedHeap&) = delete;
+		SharedHeap& operator=(const SharedHeap&) = delete;
+
+		// Allocate a block of at least size bytes, return nullptr if the heap is full
+		// The size is rounded up to a power of 2 including a 16 bytes header
+		void* Allocate(nuint size);
+		// Return a block to its free list, a pointer not allocated by this heap is ignored
+		void Deallocate(void* ptr);
+		// The usable size of an allocated block
+		nuint GetBlockSize(const void* ptr) const;
+
+		template<class T, class... Args>
+		T* Construct(Args&&... args) {
+			static_assert(alignof(T) <= ALIGNMENT, "the alignment of type is not supported by SharedHeap");
+			void* ptr = this->Allocate(sizeof(T));
+			return ptr ? new (ptr) T(std::forward<Args>(args)...) : nullptr;
+		}
+		template<class T>
+		void Destroy(T* ptr) {
+			if (!ptr) { return; }
+			ptr->~T();
+			this->Deallocate(ptr);
+		}
+
+		// Publish an object in the heap so other processes can find it after opening, nullptr to clear
+		void SetRoot(void* ptr);
+		void* GetRoot() const;
+		template<class T>
+		T* GetRoot() const { return (T*)(this->GetRoot()); }
+
+		// Bytes from the beginning of the heap to the end of the segment
+		nuint capacity() const;
+		// Bytes ever carved by the bump pointer, freed blocks stay carved for their size class
+		nuint high_water() const;
+	};
+
+	// STL allocator over a SharedHeap, containers using it can be placed in the shared memory
+	// and used by every process, since both the allocator and the pointers are offset based
+	// allocate throws std::bad_alloc as required by the containers if the heap is full
+	template<class T>
+	class SharedAllocator {
+		template<class U> friend class SharedAllocator;
+		shm_ptr<SharedHeap> m_heap;
+	public:
+		using value_type = T;
+		using pointer = shm_ptr<T>;
+		using const_pointer = shm_ptr<const T>;
+		using void_pointer = shm_ptr<void>;
+		using const_void_pointer = shm_ptr<const void>;
+		using size_type = nuint;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::true_type;
+		using is_always_equal = std::false_type;
+
+		SharedAllocator(SharedHeap* heap) noexcept : m_heap(heap) {}
+		SharedAllocator(const SharedAllocator& other) noexcept : m_heap(other.m_heap) {}
+		template<class U>
+		SharedAllocator(const SharedAllocator<U>& other) noexcept : m_heap(other.m_heap) {}
+		SharedAllocator& operator=(const SharedAllocator& other) noexcept = default;
+
+		pointer allocate(size_type count) {
+			static_assert(alignof(T) <= SharedHeap::ALIGNMENT, "the alignment of type is not supported by SharedHeap");
+			if (count > ~size_type() / sizeof(T)) { throw std::bad_array_new_length(); }
+			void* ptr = this->m_heap->Allocate(count * sizeof(T));
+			if (!ptr) { throw std::bad_alloc(); }
+			return pointer(static_cast<T*>(ptr));
+		}
+		void deallocate(pointer ptr, size_type) noexcept {
+			this->m_heap->Deallocate(ptr.get());
+		}
+		SharedHeap* heap() const noexcept { return this->m_heap.get(); }
+
+		template<class U>
+		friend bool operator==(const SharedAllocator& lhs, const SharedAllocator<U>& rhs) noexcept { return lhs.m_heap.get() == rhs.m_heap.get(); }
+	};
+	template<class T>
+	using SharedVector = std::vector<T, SharedAllocator<T>>;
+
+	// A shared memory managed by a SharedHeap
+	class SharedArena {
+		SharedMemoryManager::SharedMemoryHolder m_holder;
+		SharedHeap* m_heap{};
+
+		SharedArena(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize);
+	public:
+		static SharedArena Create(const std::string& name, nuint capacity, const SharedMemoryManager::SharedMemoryOptions& options = {});
+		static SharedArena Open(const std::string& name, const SharedMemoryManager::SharedMemoryOptions& options = {});
+
+		SharedArena() = default;
+		SharedArena(const SharedArena&) = delete;
+		SharedArena& operator=(const SharedArena&) = delete;
+		SharedArena(SharedArena&& other) noexcept;
+		SharedArena& operator=(SharedArena&& other) noexcept;
+
+		bool is_valid() const;
+		SharedHeap* heap() const;
+		template<class T>
+		SharedAllocator<T> get_allocator() const { return SharedAllocator<T>(this->m_heap); }
+	};
+};
@@ -0,0 +1,189 @@
+#include "shm_broadcast.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+namespace cyh::os {
+	static constexpr uint32_t BROADCAST_MAGIC = 0x474C4342; // "BCLG"
+	static constexpr uint32_t BROADCAST_VERSION = 1;
+	static constexpr nuint BROADCAST_ALIGNMENT = 64;
+
+	struct SharedBroadcastLog::_logHeader {
+		std::atomic<uint32_t> m_magic;
+		uint32_t m_version;
+		uint64_t m_slot_count;
+		uint64_t m_slot_size;
+		// count of records published, only written by the writer
+		alignas(BROADCAST_ALIGNMENT) std::atomic<uint64_t> m_write_position;
+		// notified by the writer after publishing a record
+		alignas(BROADCAST_ALIGNMENT) SharedCondition m_readable;
+	};
+	// Record n is complete in its slot when sequence == 2n + 2, and being written while sequence == 2n + 1
+	struct SharedBroadcastLog::_logSlot {
+		std::atomic<uint64_t> m_sequence;
+		uint64_t m_length;
+		unsigned char* payload() { return reinterpret_cast<unsigned char*>(this + 1); }
+	};
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared broadcast log requires lock free 64 bit atomics");
+
+	static nuint align_broadcast_size(nuint size) {
+		return (size + BROADCAST_ALIGNMENT - 1) & ~(BROADCAST_ALIGNMENT - 1);
+	}
+	static nuint round_up_broadcast_slot_count(nuint value) {
+		nuint result = 2;
+		while (result < value) { result <<= 1; }
+		return result;
+	}
+
+	SharedBroadcastLog::SharedBroadcastLog(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize, nuint slot_count, nuint slot_size) : m_holder(std::move(holder)) {
+		if (!this->m_holder.data()) { return; }
+		auto data = static_cast<unsigned char*>(this->m_holder.data());
+		unsigned char* base = reinterpret_cast<unsigned char*>(align_broadcast_size(reinterpret_cast<uintptr_t>(data)));
+		nuint usable = this->m_holder.capacity() - static_cast<nuint>(base - data);
+		auto header = reinterpret_cast<_logHeader*>(base);
+		if (!initialize) {
+			if (header->m_magic.load(std::memory_order_acquire) != BROADCAST_MAGIC || header->m_version != BROADCAST_VERSION) { return; }
+			slot_count = static_cast<nuint>(header->m_slot_count);
+			slot_size = static_cast<nuint>(header->m_slot_size);
+		}
+		nuint slot_stride = align_broadcast_size(sizeof(_logSlot) + slot_size);
+		if (align_broadcast_size(sizeof(_logHeader)) + slot_count * slot_stride > usable) { return; }
+
+		this->m_slots = base + align_broadcast_size(sizeof(_logHeader));
+		this->m_slot_count = slot_count;
+		this->m_slot_size = slot_size;
+		this->m_slot_stride = slot_stride;
+		if (initialize) {
+			// the fresh segment is zero filled, sequence 0 marks a slot never written
+			header = new (base) _logHeader{};
+			header->m_version = BROADCAST_VERSION;
+			header->m_slot_count = slot_count;
+			header->m_slot_size = slot_size;
+			header->m_magic.store(BROADCAST_MAGIC, std::memory_order_release);
+			this->m_holder.MarkReady();
+		}
+		this->m_header = header;
+		this->m_cursor = header->m_write_position.load(std::memory_order_acquire);
+	}
+	SharedBroadcastLog::SharedBroadcastLog(SharedBroadcastLog&& other) noexcept {
+		*this = std::move(other);
+	}
+	SharedBroadcastLog& SharedBroadcastLog::operator=(SharedBroadcastLog&& other) noexcept {
+		if (this == &other) { return *this; }
+		this->m_holder = std::move(other.m_holder);
+		this->m_header = other.m_header;
+		this->m_slots = other.m_slots;
+		this->m_slot_count = other.m_slot_count;
+		this->m_slot_size = other.m_slot_size;
+		this->m_slot_stride = other.m_slot_stride;
+		this->m_cursor = other.m_cursor;
+		this->m_lost_count = other.m_lost_count;
+		other.m_header = nullptr;
+		other.m_slots = nullptr;
+		other.m_slot_count = 0;
+		return *this;
+	}
+
+	SharedBroadcastLog SharedBroadcastLog::Create(const std::string& name, nuint slot_count, nuint slot_size, const SharedMemoryManager::SharedMemoryOptions& options) {
+		slot_count = round_up_broadcast_slot_count(slot_count);
+		nuint byteSize = BROADCAST_ALIGNMENT + align_broadcast_size(sizeof(_logHeader)) + slot_count * align_broadcast_size(sizeof(_logSlot) + slot_size);
+		SharedMemoryManager::SharedMemoryOptions create_options = options;
+		create_options.defer_ready = true;
+		return SharedBroadcastLog(SharedMemoryManager::CreateSharedMemory(name, byteSize, create_options), true, slot_count, slot_size);
+	}
+	SharedBroadcastLog SharedBroadcastLog::Open(const std::string& name, uint wait_millis) {
+		SharedMemoryManager::SharedMemoryOptions options{};
+		options.wait_ready_millis = wait_millis;
+		return SharedBroadcastLog(SharedMemoryManager::OpenSharedMemory(SharedMemoryManager::ACCESS_READWRITE, name, options), false, 0, 0);
+	}
+
+	SharedBroadcastLog::_logSlot* SharedBroadcastLog::get_slot(uint64_t position) const {
+		return reinterpret_cast<_logSlot*>(this->m_slots + (position & (this->m_slot_count - 1)) * this->m_slot_stride);
+	}
+	bool SharedBroadcastLog::is_valid() const {
+		return this->m_header != nullptr;
+	}
+	nuint SharedBroadcastLog::slot_count() const {
+		return this->m_slot_count;
+	}
+	nuint SharedBroadcastLog::slot_size() const {
+		return this->m_slot_size;
+	}
+	uint64_t SharedBroadcastLog::published_count() const {
+		if (!this->m_header) { return 0; }
+		return this->m_header->m_write_position.load(std::memory_order_acquire);
+	}
+
+	bool SharedBroadcastLog::Publish(const void* data, nuint size) {
+		if (!this->m_header || size > this->m_slot_size) { return false; }
+		// only this writer changes the position, it is reloaded so the role can be handed over to another process
+		uint64_t position = this->m_header->m_write_position.load(std::memory_order_relaxed);
+		auto slot = this->get_slot(position);
+		slot->m_sequence.store(2 * position + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot->m_length = size;
+		memcpy(slot->payload(), data, size);
+		slot->m_sequence.store(2 * position + 2, std::memory_order_release);
+		this->m_header->m_write_position.store(position + 1, std::memory_order_release);
+		this->m_header->m_readable.NotifyAll();
+		return true;
+	}
+
+	uint64_t SharedBroadcastLog::cursor() const {
+		return this->m_cursor;
+	}
+	uint64_t SharedBroadcastLog::lost_count() const {
+		return this->m_lost_count;
+	}
+	uint64_t SharedBroadcastLog::pending_count() const {
+		uint64_t position = this->published_count();
+		return position > this->m_cursor ? position - this->m_cursor : 0;
+	}
+	void SharedBroadcastLog::SeekToLatest() {
+		this->m_cursor = this->published_count();
+	}
+	void SharedBroadcastLog::SeekToOldest() {
+		uint64_t position = this->published_count();
+		// the slot of the oldest record may be being overwritten by the next one
+		this->m_cursor = position >= this->m_slot_count ? position - this->m_slot_count + 1 : 0;
+	}
+	void SharedBroadcastLog::skip_lapped_records() {
+		uint64_t cursor = this->m_cursor;
+		this->SeekToOldest();
+		this->m_cursor = std::max(this->m_cursor, cursor);
+		this->m_lost_count += this->m_cursor - cursor;
+	}
+	bool SharedBroadcastLog::WaitForData(uint timeout_millis, uint spin_count) {
+		if (!this->m_header) { return false; }
+		return this->m_header->m_readable.WaitFor([this] { return this->pending_count() != 0; }, timeout_millis, spin_count);
+	}
+	bool SharedBroadcastLog::TryRead(void* buffer, nuint buffer_size, nuint* pSize) {
+		if (pSize) { *pSize = 0; }
+		if (!this->m_header) { return false; }
+		while (true) {
+			auto slot = this->get_slot(this->m_cursor);
+			uint64_t expected = 2 * this->m_cursor + 2;
+			uint64_t sequence = slot->m_sequence.load(std::memory_order_acquire);
+			// an older record or the record being written
+			if (sequence < expected) { return false; }
+			if (sequence == expected) {
+				// a torn length is only used for the copy, which is discarded if the sequence changed
+				nuint size = std::min(static_cast<nuint>(slot->m_length), this->m_slot_size);
+				bool fits = size <= buffer_size;
+				if (fits) {
+					memcpy(buffer, slot->payload(), size);
+				}
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot->m_sequence.load(std::memory_order_relaxed) == expected) {
+					if (pSize) { *pSize = size; }
+					if (!fits) { return false; }
+					++this->m_cursor;
+					return true;
+				}
+			}
+			// the slot holds or is being overwritten by a newer record
+			this->skip_lapped_records();
+		}
+	}
+};
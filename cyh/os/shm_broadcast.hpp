@@ -0,0 +1,67 @@
+#pragma once
+#include "shmem_mgr.hpp"
+#include "shm_sync.hpp"
+namespace cyh::os {
+	// Single writer multi reader broadcast log of records in a shared memory, every subscriber reads every record
+	// Records are copied into fixed size slots, each slot is guarded by its own sequence ( a seqlock ),
+	// so the cost of Publish does not depend on the count of subscribers and readers never block the writer
+	//
+	// Each opened object is an independent subscriber with its own cursor in its own process.
+	// A subscriber slower than the writer is lapped, then it skips to the oldest record still available
+	// and the records skipped are added to lost_count()
+	class SharedBroadcastLog {
+		struct _logHeader;
+		struct _logSlot;
+		SharedMemoryManager::SharedMemoryHolder m_holder;
+		_logHeader* m_header{};
+		unsigned char* m_slots{};
+		nuint m_slot_count{};
+		nuint m_slot_size{};
+		nuint m_slot_stride{};
+		// number of the next record to read
+		uint64_t m_cursor{};
+		uint64_t m_lost_count{};
+
+		SharedBroadcastLog(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize, nuint slot_count, nuint slot_size);
+		_logSlot* get_slot(uint64_t position) const;
+		// Move the cursor of a lapped subscriber to the oldest record which is not being overwritten
+		void skip_lapped_records();
+	public:
+		// slot_count is rounded up to a power of 2, slot_size is the largest record in bytes
+		static SharedBroadcastLog Create(const std::string& name, nuint slot_count, nuint slot_size, const SharedMemoryManager::SharedMemoryOptions& options = {});
+		// The subscriber starts after the latest record, wait up to wait_millis for the creator to initialize it
+		static SharedBroadcastLog Open(const std::string& name, uint wait_millis = 0);
+
+		SharedBroadcastLog() = default;
+		SharedBroadcastLog(const SharedBroadcastLog&) = delete;
+		SharedBroadcastLog& operator=(const SharedBroadcastLog&) = delete;
+		SharedBroadcastLog(SharedBroadcastLog&& other) noexcept;
+		SharedBroadcastLog& operator=(SharedBroadcastLog&& other) noexcept;
+
+		bool is_valid() const;
+		nuint slot_count() const;
+		nuint slot_size() const;
+		// Count of records ever published
+		uint64_t published_count() const;
+
+		// Writer side, only one process publishes at a time
+		// Overwrite the oldest record if the log is full, return false only if size is larger than slot_size()
+		bool Publish(const void* data, nuint size);
+
+		// Subscriber side, number of the next record to read
+		uint64_t cursor() const;
+		// Subscriber side, count of records skipped because the writer lapped this subscriber
+		uint64_t lost_count() const;
+		// Subscriber side, count of records published but not read yet, it may be larger than slot_count() if lapped
+		uint64_t pending_count() const;
+		// Subscriber side, skip the records not read yet
+		void SeekToLatest();
+		// Subscriber side, read again from the oldest record still available
+		void SeekToOldest();
+		// Subscriber side, block until a record is available to read, return false on timeout
+		bool WaitForData(uint timeout_millis = SharedSync::INFINITE_WAIT, uint spin_count = SharedSync::DEFAULT_SPIN_COUNT);
+		// Subscriber side, copy the next record into buffer and set *pSize to its size
+		// Return false if no record is available ( then *pSize is 0 ), or if buffer_size is too small ( then *pSize is the size required )
+		bool TryRead(void* buffer, nuint buffer_size, nuint* pSize);
+	};
+};
@@ -0,0 +1,253 @@
+#pragma once
+#include "shmem_mgr.hpp"
+#include "shm_sync.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+namespace cyh::os {
+	// Hash of the bytes of a key, the result is the same in every process and build
+	template<class K>
+	struct SharedBytesHash {
+		static_assert(std::has_unique_object_representations_v<K>, "padding bytes of key would change its hash, provide a hash for the key");
+		uint64_t operator()(const K& key) const noexcept {
+			// FNV-1a, then a finalizer so the low bits used as index are mixed
+			uint64_t hash = 0xCBF29CE484222325ull;
+			auto pBytes = reinterpret_cast<const unsigned char*>(&key);
+			for (nuint i = 0; i < sizeof(K); ++i) {
+				hash = (hash ^ pBytes[i]) * 0x100000001B3ull;
+			}
+			hash ^= hash >> 33;
+			hash *= 0xFF51AFD7ED558CCDull;
+			hash ^= hash >> 33;
+			return hash;
+		}
+	};
+	template<class K>
+	struct SharedBytesEqual {
+		bool operator()(const K& lhs, const K& rhs) const noexcept {
+			return memcmp(&lhs, &rhs, sizeof(K)) == 0;
+		}
+	};
+
+	// Fixed capacity open addressing hash map in a shared memory, built by one process and read by many
+	// Readers do not lock, each bucket carries a version which is odd while a writer changes it,
+	// so a reader copies the bucket and retries if the version changed meanwhile
+	// Writers are serialized by a SharedMutex in the segment
+	// A writer killed while changing a bucket leaves its version odd and the mutex locked, then lookups
+	// probing through the bucket fail after SharedSync::SEQLOCK_TIMEOUT_MILLIS and the map must be created again
+	// K and V are copied as bytes, Hash must give the same result in every process
+	template<class K, class V, class Hash = SharedBytesHash<K>, class KeyEqual = SharedBytesEqual<K>>
+	class SharedHashMap {
+		static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>, "key and value of SharedHashMap must be trivially copyable");
+		static constexpr uint32_t MAP_MAGIC = 0x50414D48; // "HMAP"
+		static constexpr uint32_t MAP_VERSION = 1;
+		static constexpr nuint MAP_ALIGNMENT = 64;
+		static constexpr uint32_t BUCKET_EMPTY = 0;
+		static constexpr uint32_t BUCKET_FULL = 1;
+		// erased buckets keep the probe sequences of other keys intact
+		static constexpr uint32_t BUCKET_ERASED = 2;
+
+		struct _mapBucket {
+			std::atomic<uint32_t> m_version;
+			std::atomic<uint32_t> m_state;
+			K m_key;
+			V m_value;
+		};
+		struct _mapHeader {
+			std::atomic<uint32_t> m_magic;
+			uint32_t m_version;
+			uint64_t m_bucket_count;
+			uint32_t m_key_size;
+			uint32_t m_value_size;
+			std::atomic<uint64_t> m_size;
+			// full and erased buckets, only accessed by the writer
+			uint64_t m_used;
+			alignas(MAP_ALIGNMENT) SharedMutex m_writer;
+		};
+
+		SharedMemoryManager::SharedMemoryHolder m_holder;
+		_mapHeader* m_header{};
+		_mapBucket* m_buckets{};
+		nuint m_mask{};
+
+		static nuint align_map_size(nuint size, nuint alignment) {
+			return (size + alignment - 1) & ~(alignment - 1);
+		}
+		// Keep one of 8 buckets empty, so probes of missing keys stop early
+		static nuint get_bucket_count(nuint capacity) {
+			nuint count = 8;
+			while (count - count / 8 < capacity) { count <<= 1; }
+			return count;
+		}
+		static nuint get_segment_size(nuint bucket_count) {
+			return MAP_ALIGNMENT + align_map_size(sizeof(_mapHeader), MAP_ALIGNMENT) + bucket_count * sizeof(_mapBucket);
+		}
+
+		SharedHashMap(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize, nuint bucket_count) : m_holder(std::move(holder)) {
+			if (!this->m_holder.data()) { return; }
+			auto address = reinterpret_cast<uintptr_t>(this->m_holder.data());
+			auto base = reinterpret_cast<unsigned char*>(align_map_size(address, MAP_ALIGNMENT));
+			nuint usable = this->m_holder.capacity() - static_cast<nuint>(base - (unsigned char*)this->m_holder.data());
+			auto header = reinterpret_cast<_mapHeader*>(base);
+			if (initialize) {
+				// the fresh segment is zero filled, which is an empty table and an unlocked writer mutex
+				header = new (base) _mapHeader{};
+				header->m_version = MAP_VERSION;
+				header->m_bucket_count = bucket_count;
+				header->m_key_size = sizeof(K);
+				header->m_value_size = sizeof(V);
+				header->m_magic.store(MAP_MAGIC, std::memory_order_release);
+				this->m_holder.MarkReady();
+			} else {
+				if (header->m_magic.load(std::memory_order_acquire) != MAP_MAGIC || header->m_version != MAP_VERSION) { return; }
+				if (header->m_key_size != sizeof(K) || header->m_value_size != sizeof(V)) { return; }
+				bucket_count = static_cast<nuint>(header->m_bucket_count);
+			}
+			if (get_segment_size(bucket_count) - MAP_ALIGNMENT > usable) { return; }
+			this->m_header = header;
+			this->m_buckets = reinterpret_cast<_mapBucket*>(base + align_map_size(sizeof(_mapHeader), MAP_ALIGNMENT));
+			this->m_mask = bucket_count - 1;
+		}
+		nuint get_index(const K& key) const {
+			return static_cast<nuint>(Hash{}(key)) & this->m_mask;
+		}
+		// Change a bucket under its version, only called by the writer
+		template<class Fn>
+		static void write_bucket(_mapBucket* pBucket, Fn&& fn) {
+			uint32_t version = pBucket->m_version.load(std::memory_order_relaxed);
+			pBucket->m_version.store(version + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			fn(pBucket);
+			pBucket->m_version.store(version + 2, std::memory_order_release);
+		}
+		// Find the bucket holding the key, or the bucket to insert it, nullptr if neither exists
+		_mapBucket* find_for_write(const K& key, bool* pFound) const {
+			*pFound = false;
+			_mapBucket* pErased = nullptr;
+			nuint index = this->get_index(key);
+			for (nuint probe = 0; probe <= this->m_mask; ++probe) {
+				_mapBucket* pBucket = &this->m_buckets[(index + probe) & this->m_mask];
+				uint32_t state = pBucket->m_state.load(std::memory_order_relaxed);
+				if (state == BUCKET_EMPTY) {
+					return pErased ? pErased : pBucket;
+				}
+				if (state == BUCKET_FULL && KeyEqual{}(pBucket->m_key, key)) {
+					*pFound = true;
+					return pBucket;
+				}
+				if (state == BUCKET_ERASED && !pErased) {
+					pErased = pBucket;
+				}
+			}
+			return pErased;
+		}
+	public:
+		// capacity is the count of keys the map can hold
+		static SharedHashMap Create(const std::string& name, nuint capacity, const SharedMemoryManager::SharedMemoryOptions& options = {}) {
+			nuint bucket_count = get_bucket_count(capacity);
+			SharedMemoryManager::SharedMemoryOptions create_options = options;
+			create_options.defer_ready = true;
+			return SharedHashMap(SharedMemoryManager::CreateSharedMemory(name, get_segment_size(bucket_count), create_options), true, bucket_count);
+		}
+		// Readers may open it read only, then only TryGet, Contains and size can be used
+		static SharedHashMap Open(const std::string& name, uint accessFlag = SharedMemoryManager::ACCESS_READWRITE, const SharedMemoryManager::SharedMemoryOptions& options = {}) {
+			return SharedHashMap(SharedMemoryManager::OpenSharedMemory(accessFlag, name, options), false, 0);
+		}
+
+		SharedHashMap() = default;
+		SharedHashMap(const SharedHashMap&) = delete;
+		SharedHashMap& operator=(const SharedHashMap&) = delete;
+		SharedHashMap(SharedHashMap&& other) noexcept { *this = std::move(other); }
+		SharedHashMap& operator=(SharedHashMap&& other) noexcept {
+			if (this == &other) { return *this; }
+			this->m_holder = std::move(other.m_holder);
+			this->m_header = other.m_header;
+			this->m_buckets = other.m_buckets;
+			this->m_mask = other.m_mask;
+			other.m_header = nullptr;
+			other.m_buckets = nullptr;
+			other.m_mask = 0;
+			return *this;
+		}
+
+		bool is_valid() const { return this->m_header != nullptr; }
+		nuint size() const { return this->m_header ? static_cast<nuint>(this->m_header->m_size.load(std::memory_order_relaxed)) : 0; }
+		nuint bucket_count() const { return this->m_header ? this->m_mask + 1 : 0; }
+		nuint capacity() const { return this->m_header ? this->bucket_count() - this->bucket_count() / 8 : 0; }
+
+		// Copy the value of key to *pValue, return false if not found
+		// Also return false if a bucket on the way stays being written for timeout_millis, see above
+		// *pValue may be changed even if false is returned
+		bool TryGet(const K& key, V* pValue, uint timeout_millis = SharedSync::SEQLOCK_TIMEOUT_MILLIS) const {
+			if (!this->m_header) { return false; }
+			nuint index = this->get_index(key);
+			for (nuint probe = 0; probe <= this->m_mask; ++probe) {
+				const _mapBucket& bucket = this->m_buckets[(index + probe) & this->m_mask];
+				while (true) {
+					uint32_t version{};
+					if (!SharedSyncInternal::ReadSeqlockVersion(&bucket.m_version, &version, timeout_millis)) { return false; }
+					uint32_t state = bucket.m_state.load(std::memory_order_relaxed);
+					K current_key;
+					memcpy(&current_key, &bucket.m_key, sizeof(K));
+					bool matched = state == BUCKET_FULL && KeyEqual{}(current_key, key);
+					if (matched && pValue) {
+						memcpy(pValue, &bucket.m_value, sizeof(V));
+					}
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (bucket.m_version.load(std::memory_order_relaxed) != version) { continue; }
+					if (state == BUCKET_EMPTY) { return false; }
+					if (matched) { return true; }
+					break;
+				}
+			}
+			return false;
+		}
+		bool Contains(const K& key) const {
+			return this->TryGet(key, nullptr);
+		}
+
+		// Insert the key or replace its value, return false if the map is full
+		bool Insert(const K& key, const V& value) {
+			if (!this->m_header) { return false; }
+			this->m_header->m_writer.Lock();
+			bool found{};
+			_mapBucket* pBucket = this->find_for_write(key, &found);
+			bool reuse_erased = pBucket && pBucket->m_state.load(std::memory_order_relaxed) == BUCKET_ERASED;
+			if (!pBucket || (!found && !reuse_erased && this->m_header->m_used >= this->capacity())) {
+				this->m_header->m_writer.Unlock();
+				return false;
+			}
+			write_bucket(pBucket, [&](_mapBucket* pTarget) {
+				if (!found) {
+					memcpy(&pTarget->m_key, &key, sizeof(K));
+					pTarget->m_state.store(BUCKET_FULL, std::memory_order_relaxed);
+				}
+				memcpy(&pTarget->m_value, &value, sizeof(V));
+			});
+			if (!found) {
+				if (!reuse_erased) { ++this->m_header->m_used; }
+				this->m_header->m_size.fetch_add(1, std::memory_order_relaxed);
+			}
+			this->m_header->m_writer.Unlock();
+			return true;
+		}
+		// Return false if the key is not found
+		// The bucket is only reused by keys probing through it, a map with heavy churn should be rebuilt
+		bool Erase(const K& key) {
+			if (!this->m_header) { return false; }
+			this->m_header->m_writer.Lock();
+			bool found{};
+			_mapBucket* pBucket = this->find_for_write(key, &found);
+			if (found) {
+				write_bucket(pBucket, [](_mapBucket* pTarget) {
+					pTarget->m_state.store(BUCKET_ERASED, std::memory_order_relaxed);
+				});
+				this->m_header->m_size.fetch_sub(1, std::memory_order_relaxed);
+			}
+			this->m_header->m_writer.Unlock();
+			return found;
+		}
+	};
+};
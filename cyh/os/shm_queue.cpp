@@ -0,0 +1,163 @@
+#include "shm_queue.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+namespace cyh::os {
+	static constexpr uint32_t QUEUE_MAGIC = 0x51434D4D; // "MMCQ"
+	static constexpr uint32_t QUEUE_VERSION = 1;
+	static constexpr nuint QUEUE_ALIGNMENT = 64;
+
+	struct SharedMpmcQueue::_queueHeader {
+		std::atomic<uint32_t> m_magic;
+		uint32_t m_version;
+		uint64_t m_slot_count;
+		uint64_t m_slot_size;
+		alignas(QUEUE_ALIGNMENT) std::atomic<uint64_t> m_enqueue_position;
+		alignas(QUEUE_ALIGNMENT) std::atomic<uint64_t> m_dequeue_position;
+	};
+	// A slot is published to consumers when sequence == position + 1,
+	// and returned to producers when sequence == position + slot_count
+	struct SharedMpmcQueue::_queueSlot {
+		std::atomic<uint64_t> m_sequence;
+		uint64_t m_length;
+		unsigned char* payload() { return reinterpret_cast<unsigned char*>(this + 1); }
+	};
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared queue requires lock free 64 bit atomics");
+
+	static nuint align_queue_size(nuint size) {
+		return (size + QUEUE_ALIGNMENT - 1) & ~(QUEUE_ALIGNMENT - 1);
+	}
+	static nuint round_up_slot_count(nuint value) {
+		nuint result = 2;
+		while (result < value) { result <<= 1; }
+		return result;
+	}
+
+	SharedMpmcQueue::SharedMpmcQueue(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize, nuint slot_count, nuint slot_size) : m_holder(std::move(holder)) {
+		if (!this->m_holder.data()) { return; }
+		auto data = static_cast<unsigned char*>(this->m_holder.data());
+		unsigned char* base = reinterpret_cast<unsigned char*>(align_queue_size(reinterpret_cast<uintptr_t>(data)));
+		nuint usable = this->m_holder.capacity() - static_cast<nuint>(base - data);
+		auto header = reinterpret_cast<_queueHeader*>(base);
+		if (!initialize) {
+			if (header->m_magic.load(std::memory_order_acquire) != QUEUE_MAGIC || header->m_version != QUEUE_VERSION) { return; }
+			slot_count = static_cast<nuint>(header->m_slot_count);
+			slot_size = static_cast<nuint>(header->m_slot_size);
+		}
+		nuint slot_stride = align_queue_size(sizeof(_queueSlot) + slot_size);
+		if (align_queue_size(sizeof(_queueHeader)) + slot_count * slot_stride > usable) { return; }
+
+		this->m_slots = base + align_queue_size(sizeof(_queueHeader));
+		this->m_slot_count = slot_count;
+		this->m_slot_size = slot_size;
+		this->m_slot_stride = slot_stride;
+		if (initialize) {
+			header = new (base) _queueHeader{};
+			header->m_version = QUEUE_VERSION;
+			header->m_slot_count = slot_count;
+			header->m_slot_size = slot_size;
+			for (nuint i = 0; i < slot_count; ++i) {
+				auto slot = new (this->m_slots + i * slot_stride) _queueSlot{};
+				slot->m_sequence.store(i, std::memory_order_relaxed);
+			}
+			header->m_magic.store(QUEUE_MAGIC, std::memory_order_release);
+			this->m_holder.MarkReady();
+		}
+		this->m_header = header;
+	}
+	SharedMpmcQueue::SharedMpmcQueue(SharedMpmcQueue&& other) noexcept {
+		*this = std::move(other);
+	}
+	SharedMpmcQueue& SharedMpmcQueue::operator=(SharedMpmcQueue&& other) noexcept {
+		if (this == &other) { return *this; }
+		this->m_holder = std::move(other.m_holder);
+		this->m_header = other.m_header;
+		this->m_slots = other.m_slots;
+		this->m_slot_count = other.m_slot_count;
+		this->m_slot_size = other.m_slot_size;
+		this->m_slot_stride = other.m_slot_stride;
+		other.m_header = nullptr;
+		other.m_slots = nullptr;
+		other.m_slot_count = 0;
+		return *this;
+	}
+
+	SharedMpmcQueue SharedMpmcQueue::Create(const std::string& name, nuint slot_count, nuint slot_size) {
+		slot_count = round_up_slot_count(slot_count);
+		nuint byteSize = QUEUE_ALIGNMENT + align_queue_size(sizeof(_queueHeader)) + slot_count * align_queue_size(sizeof(_queueSlot) + slot_size);
+		SharedMemoryManager::SharedMemoryOptions options{};
+		options.defer_ready = true;
+		return SharedMpmcQueue(SharedMemoryManager::CreateSharedMemory(name, byteSize, options), true, slot_count, slot_size);
+	}
+	SharedMpmcQueue SharedMpmcQueue::Open(const std::string& name, uint wait_millis) {
+		SharedMemoryManager::SharedMemoryOptions options{};
+		options.wait_ready_millis = wait_millis;
+		return SharedMpmcQueue(SharedMemoryManager::OpenSharedMemory(SharedMemoryManager::ACCESS_READWRITE, name, options), false, 0, 0);
+	}
+
+	SharedMpmcQueue::_queueSlot* SharedMpmcQueue::get_slot(nuint position) const {
+		return reinterpret_cast<_queueSlot*>(this->m_slots + (position & (this->m_slot_count - 1)) * this->m_slot_stride);
+	}
+	bool SharedMpmcQueue::is_valid() const {
+		return this->m_header != nullptr;
+	}
+	nuint SharedMpmcQueue::slot_count() const {
+		return this->m_slot_count;
+	}
+	nuint SharedMpmcQueue::slot_size() const {
+		return this->m_slot_size;
+	}
+	nuint SharedMpmcQueue::size() const {
+		if (!this->m_header) { return 0; }
+		auto dequeue = this->m_header->m_dequeue_position.load(std::memory_order_relaxed);
+		auto enqueue = this->m_header->m_enqueue_position.load(std::memory_order_relaxed);
+		return enqueue > dequeue ? static_cast<nuint>(enqueue - dequeue) : 0;
+	}
+
+	bool SharedMpmcQueue::TryPush(const void* data, nuint size) {
+		if (!this->m_header || size > this->m_slot_size) { return false; }
+		uint64_t position = this->m_header->m_enqueue_position.load(std::memory_order_relaxed);
+		while (true) {
+			_queueSlot* slot = this->get_slot(position);
+			uint64_t sequence = slot->m_sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<int64_t>(sequence - position);
+			if (diff == 0) {
+				if (this->m_header->m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					slot->m_length = size;
+					memcpy(slot->payload(), data, size);
+					slot->m_sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				// the slot still holds a record of the previous round
+				return false;
+			} else {
+				position = this->m_header->m_enqueue_position.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	bool SharedMpmcQueue::TryPop(void* buffer, nuint buffer_size, nuint* pSize) {
+		if (!this->m_header || buffer_size < this->m_slot_size) { return false; }
+		uint64_t position = this->m_header->m_dequeue_position.load(std::memory_order_relaxed);
+		while (true) {
+			_queueSlot* slot = this->get_slot(position);
+			uint64_t sequence = slot->m_sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<int64_t>(sequence - (position + 1));
+			if (diff == 0) {
+				if (this->m_header->m_dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					nuint size = static_cast<nuint>(slot->m_length);
+					memcpy(buffer, slot->payload(), size);
+					if (pSize) { *pSize = size; }
+					slot->m_sequence.store(position + this->m_slot_count, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				// the slot is not published yet
+				return false;
+			} else {
+				position = this->m_header->m_dequeue_position.load(std::memory_order_relaxed);
+			}
+		}
+	}
+};
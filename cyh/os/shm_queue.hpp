@@ -0,0 +1,47 @@
+#pragma once
+#include "shmem_mgr.hpp"
+namespace cyh::os {
+	// Multi producer multi consumer bounded queue in a shared memory, records are copied into fixed size slots
+	// Each slot carries a sequence number, so producers and consumers only contend on their own position counter
+	//
+	// Crash tolerance:
+	// A process killed outside of TryPush/TryPop leaves the queue consistent.
+	// A process killed after claiming a position but before publishing its slot leaves that slot unpublished,
+	// consumers then see the queue empty at that position and producers see it full once they wrap around to it.
+	// The queue cannot detect this case, the owner should recreate the segment if it stops making progress.
+	class SharedMpmcQueue {
+		struct _queueHeader;
+		struct _queueSlot;
+		SharedMemoryManager::SharedMemoryHolder m_holder;
+		_queueHeader* m_header{};
+		unsigned char* m_slots{};
+		nuint m_slot_count{};
+		nuint m_slot_size{};
+		nuint m_slot_stride{};
+
+		SharedMpmcQueue(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize, nuint slot_count, nuint slot_size);
+		_queueSlot* get_slot(nuint position) const;
+	public:
+		// slot_count is rounded up to a power of 2, slot_size is the largest record in bytes
+		static SharedMpmcQueue Create(const std::string& name, nuint slot_count, nuint slot_size);
+		// Wait up to wait_millis for the creator to initialize it
+		static SharedMpmcQueue Open(const std::string& name, uint wait_millis = 0);
+
+		SharedMpmcQueue() = default;
+		SharedMpmcQueue(const SharedMpmcQueue&) = delete;
+		SharedMpmcQueue& operator=(const SharedMpmcQueue&) = delete;
+		SharedMpmcQueue(SharedMpmcQueue&& other) noexcept;
+		SharedMpmcQueue& operator=(SharedMpmcQueue&& other) noexcept;
+
+		bool is_valid() const;
+		nuint slot_count() const;
+		nuint slot_size() const;
+		// Approximate count of records in the queue
+		nuint size() const;
+
+		// Return false if the queue is full or size is larger than slot_size()
+		bool TryPush(const void* data, nuint size);
+		// Return false if the queue is empty or buffer_size is smaller than slot_size()
+		bool TryPop(void* buffer, nuint buffer_size, nuint* pSize);
+	};
+};
@@ -0,0 +1,224 @@
+#include "shm_ring.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+namespace cyh::os {
+	static constexpr uint32_t RING_MAGIC = 0x474E5252; // "RRNG"
+	static constexpr uint32_t RING_VERSION = 2;
+	static constexpr nuint RING_ALIGNMENT = 64;
+	// Length prefix of a record
+	static constexpr nuint RING_RECORD_HEADER = sizeof(uint32_t);
+	static constexpr nuint RING_RECORD_ALIGNMENT = 8;
+	// The length of a record which only pads to the end of the data area
+	static constexpr uint32_t RING_PADDING_RECORD = ~uint32_t();
+
+	// Layout at the beginning of the segment, head and tail are on their own cache lines
+	struct SharedRingBuffer::_ringHeader {
+		std::atomic<uint32_t> m_magic;
+		uint32_t m_version;
+		uint64_t m_capacity;
+		// position of the next byte to pop, only written by the consumer
+		alignas(RING_ALIGNMENT) std::atomic<uint64_t> m_head;
+		// position of the next byte to push, only written by the producer
+		alignas(RING_ALIGNMENT) std::atomic<uint64_t> m_tail;
+		// notified by the producer after publishing records
+		alignas(RING_ALIGNMENT) SharedCondition m_readable;
+	};
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared ring buffer requires lock free 64 bit atomics");
+
+	static nuint align_ring_size(nuint size, nuint alignment) {
+		return (size + alignment - 1) & ~(alignment - 1);
+	}
+	static nuint round_up_power_of_2(nuint value) {
+		nuint result = RING_ALIGNMENT;
+		while (result < value) { result <<= 1; }
+		return result;
+	}
+	// The header is placed at the first aligned address of the shared memory
+	static unsigned char* get_aligned_ring_address(void* data) {
+		auto address = reinterpret_cast<uintptr_t>(data);
+		return reinterpret_cast<unsigned char*>(align_ring_size(address, RING_ALIGNMENT));
+	}
+
+	SharedRingBuffer::SharedRingBuffer(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize, nuint capacity) : m_holder(std::move(holder)) {
+		if (!this->m_holder.data()) { return; }
+		unsigned char* base = get_aligned_ring_address(this->m_holder.data());
+		nuint usable = this->m_holder.capacity() - static_cast<nuint>(base - (unsigned char*)this->m_holder.data());
+		auto header = reinterpret_cast<_ringHeader*>(base);
+		if (initialize) {
+			header = new (base) _ringHeader{};
+			header->m_version = RING_VERSION;
+			header->m_capacity = capacity;
+			header->m_magic.store(RING_MAGIC, std::memory_order_release);
+		} else {
+			if (header->m_magic.load(std::memory_order_acquire) != RING_MAGIC || header->m_version != RING_VERSION) { return; }
+			capacity = static_cast<nuint>(header->m_capacity);
+		}
+		if (sizeof(_ringHeader) + capacity > usable) { return; }
+		this->m_header = header;
+		this->m_data = base + align_ring_size(sizeof(_ringHeader), RING_ALIGNMENT);
+		this->m_capacity = capacity;
+		this->m_local_head = this->m_cached_head = header->m_head.load(std::memory_order_acquire);
+		this->m_local_tail = this->m_cached_tail = header->m_tail.load(std::memory_order_acquire);
+		if (initialize) {
+			this->m_holder.MarkReady();
+		}
+	}
+	SharedRingBuffer::SharedRingBuffer(SharedRingBuffer&& other) noexcept {
+		*this = std::move(other);
+	}
+	SharedRingBuffer& SharedRingBuffer::operator=(SharedRingBuffer&& other) noexcept {
+		if (this == &other) { return *this; }
+		this->m_holder = std::move(other.m_holder);
+		this->m_header = other.m_header;
+		this->m_data = other.m_data;
+		this->m_capacity = other.m_capacity;
+		this->m_local_head = other.m_local_head;
+		this->m_local_tail = other.m_local_tail;
+		this->m_cached_head = other.m_cached_head;
+		this->m_cached_tail = other.m_cached_tail;
+		other.m_header = nullptr;
+		other.m_data = nullptr;
+		other.m_capacity = 0;
+		return *this;
+	}
+
+	SharedRingBuffer SharedRingBuffer::Create(const std::string& name, nuint capacity) {
+		capacity = round_up_power_of_2(capacity);
+		nuint byteSize = RING_ALIGNMENT + align_ring_size(sizeof(_ringHeader), RING_ALIGNMENT) + capacity;
+		SharedMemoryManager::SharedMemoryOptions options{};
+		options.defer_ready = true;
+		return SharedRingBuffer(SharedMemoryManager::CreateSharedMemory(name, byteSize, options), true, capacity);
+	}
+	SharedRingBuffer SharedRingBuffer::Open(const std::string& name, uint wait_millis) {
+		SharedMemoryManager::SharedMemoryOptions options{};
+		options.wait_ready_millis = wait_millis;
+		return SharedRingBuffer(SharedMemoryManager::OpenSharedMemory(SharedMemoryManager::ACCESS_READWRITE, name, options), false, 0);
+	}
+
+	bool SharedRingBuffer::is_valid() const {
+		return this->m_header != nullptr;
+	}
+	nuint SharedRingBuffer::capacity() const {
+		return this->m_capacity;
+	}
+	nuint SharedRingBuffer::max_record_size() const {
+		// a record may need to skip the tail of the data area, so at most half of it is guaranteed contiguous
+		if (this->m_capacity < RING_ALIGNMENT) { return 0; }
+		return this->m_capacity / 2 - RING_RECORD_HEADER;
+	}
+	bool SharedRingBuffer::empty() const {
+		if (!this->m_header) { return true; }
+		return this->m_header->m_head.load(std::memory_order_acquire) == this->m_header->m_tail.load(std::memory_order_acquire);
+	}
+
+	bool SharedRingBuffer::write_record(const void* data, nuint size) {
+		if (size > this->max_record_size()) { return false; }
+		nuint required = align_ring_size(RING_RECORD_HEADER + size, RING_RECORD_ALIGNMENT);
+		nuint offset = this->m_local_tail & (this->m_capacity - 1);
+		nuint contiguous = this->m_capacity - offset;
+		nuint total = required <= contiguous ? required : contiguous + required;
+		if (this->m_local_tail + total - this->m_cached_head > this->m_capacity) {
+			this->m_cached_head = this->m_header->m_head.load(std::memory_order_acquire);
+			if (this->m_local_tail + total - this->m_cached_head > this->m_capacity) { return false; }
+		}
+		if (required > contiguous) {
+			uint32_t padding = RING_PADDING_RECORD;
+			memcpy(this->m_data + offset, &padding, sizeof(padding));
+			this->m_local_tail += contiguous;
+			offset = 0;
+		}
+		uint32_t length = static_cast<uint32_t>(size);
+		memcpy(this->m_data + offset, &length, sizeof(length));
+		memcpy(this->m_data + offset + RING_RECORD_HEADER, data, size);
+		this->m_local_tail += required;
+		return true;
+	}
+	bool SharedRingBuffer::TryPush(const void* data, nuint size) {
+		if (!this->m_header) { return false; }
+		this->m_local_tail = this->m_header->m_tail.load(std::memory_order_relaxed);
+		if (!this->write_record(data, size)) { return false; }
+		this->m_header->m_tail.store(this->m_local_tail, std::memory_order_release);
+		this->m_header->m_readable.NotifyAll();
+		return true;
+	}
+	nuint SharedRingBuffer::TryPushBatch(const void* const* datas, const nuint* sizes, nuint count) {
+		if (!this->m_header || !datas || !sizes) { return 0; }
+		this->m_local_tail = this->m_header->m_tail.load(std::memory_order_relaxed);
+		nuint pushed = 0;
+		while (pushed < count && this->write_record(datas[pushed], sizes[pushed])) {
+			++pushed;
+		}
+		if (pushed) {
+			this->m_header->m_tail.store(this->m_local_tail, std::memory_order_release);
+			this->m_header->m_readable.NotifyAll();
+		}
+		return pushed;
+	}
+
+	const unsigned char* SharedRingBuffer::peek_record(nuint* pHead, nuint* pSize) {
+		nuint head = *pHead;
+		while (true) {
+			if (head >= this->m_cached_tail) {
+				this->m_cached_tail = this->m_header->m_tail.load(std::memory_order_acquire);
+				if (head >= this->m_cached_tail) { break; }
+			}
+			nuint offset = head & (this->m_capacity - 1);
+			uint32_t length{};
+			memcpy(&length, this->m_data + offset, sizeof(length));
+			if (length == RING_PADDING_RECORD) {
+				head += this->m_capacity - offset;
+				continue;
+			}
+			*pHead = head;
+			*pSize = length;
+			return this->m_data + offset + RING_RECORD_HEADER;
+		}
+		*pHead = head;
+		return nullptr;
+	}
+	void SharedRingBuffer::release_records(nuint head) {
+		if (head != this->m_local_head) {
+			this->m_local_head = head;
+			this->m_header->m_head.store(head, std::memory_order_release);
+		}
+	}
+	bool SharedRingBuffer::WaitForData(uint timeout_millis, uint spin_count) {
+		if (!this->m_header) { return false; }
+		return this->m_header->m_readable.WaitFor([this] { return !this->empty(); }, timeout_millis, spin_count);
+	}
+	bool SharedRingBuffer::TryPop(void* buffer, nuint buffer_size, nuint* pSize) {
+		if (!this->m_header) { return false; }
+		nuint head = this->m_local_head = this->m_header->m_head.load(std::memory_order_relaxed);
+		nuint size = 0;
+		const unsigned char* record = this->peek_record(&head, &size);
+		if (pSize) { *pSize = size; }
+		bool result = false;
+		// the record stays in the ring if it does not fit into the buffer
+		if (record && size <= buffer_size) {
+			memcpy(buffer, record, size);
+			head += align_ring_size(RING_RECORD_HEADER + size, RING_RECORD_ALIGNMENT);
+			result = true;
+		}
+		this->release_records(head);
+		return result;
+	}
+	nuint SharedRingBuffer::TryPopBatch(const FnRecord& fn, nuint max_count) {
+		if (!this->m_header) { return 0; }
+		nuint popped = 0;
+		nuint head = this->m_local_head = this->m_header->m_head.load(std::memory_order_relaxed);
+		nuint size = 0;
+		while (popped < max_count) {
+			const unsigned char* record = this->peek_record(&head, &size);
+			if (!record) { break; }
+			if (fn) {
+				fn(record, size);
+			}
+			++popped;
+			head += align_ring_size(RING_RECORD_HEADER + size, RING_RECORD_ALIGNMENT);
+		}
+		this->release_records(head);
+		return popped;
+	}
+};
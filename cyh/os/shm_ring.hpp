@@ -0,0 +1,66 @@
+#pragma once
+#include "shmem_mgr.hpp"
+#include "shm_sync.hpp"
+#include <functional>
+namespace cyh::os {
+	// Single producer single consumer ring buffer of variable length records in a shared memory
+	// One process pushes and one process pops, the fast path is lock free and without system calls
+	class SharedRingBuffer {
+		struct _ringHeader;
+		SharedMemoryManager::SharedMemoryHolder m_holder;
+		_ringHeader* m_header{};
+		unsigned char* m_data{};
+		nuint m_capacity{};
+		// the index owned by this side, reloaded before and published after each push/pop
+		// so the role of producer or consumer can be handed over to another process
+		nuint m_local_head{};
+		nuint m_local_tail{};
+		// the last seen index owned by the other side, to avoid touching its cache line on every call
+		nuint m_cached_head{};
+		nuint m_cached_tail{};
+
+		SharedRingBuffer(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize, nuint capacity);
+		// Reserve space and copy the record at the local tail, return false if full
+		bool write_record(const void* data, nuint size);
+		// Find the next record from *pHead, skipping the padding, return nullptr if empty
+		const unsigned char* peek_record(nuint* pHead, nuint* pSize);
+		// Publish the consumed position to the producer
+		void release_records(nuint head);
+	public:
+		// Called with the payload of each record popped, the memory is only valid during the call
+		using FnRecord = std::function<void(const void* data, nuint size)>;
+
+		// capacity is rounded up to a power of 2
+		static SharedRingBuffer Create(const std::string& name, nuint capacity);
+		// Wait up to wait_millis for the creator to initialize it
+		static SharedRingBuffer Open(const std::string& name, uint wait_millis = 0);
+
+		SharedRingBuffer() = default;
+		SharedRingBuffer(const SharedRingBuffer&) = delete;
+		SharedRingBuffer& operator=(const SharedRingBuffer&) = delete;
+		SharedRingBuffer(SharedRingBuffer&& other) noexcept;
+		SharedRingBuffer& operator=(SharedRingBuffer&& other) noexcept;
+
+		bool is_valid() const;
+		// Bytes of the data area
+		nuint capacity() const;
+		// The largest payload a record can hold
+		nuint max_record_size() const;
+		bool empty() const;
+
+		// Producer side, return false if there is not enough space
+		bool TryPush(const void* data, nuint size);
+		// Producer side, push records in order and publish them at once, return the count pushed
+		nuint TryPushBatch(const void* const* datas, const nuint* sizes, nuint count);
+
+		// Consumer side, block until a record is available, return false on timeout
+		// Producers only make a system call to wake the consumer while it is blocked
+		bool WaitForData(uint timeout_millis = SharedSync::INFINITE_WAIT, uint spin_count = SharedSync::DEFAULT_SPIN_COUNT);
+
+		// Consumer side, copy a record into buffer and set *pSize to its size
+		// Return false if empty, or if buffer_size is too small ( then *pSize is the size required )
+		bool TryPop(void* buffer, nuint buffer_size, nuint* pSize);
+		// Consumer side, read up to max_count records in place and release them at once, return the count popped
+		nuint TryPopBatch(const FnRecord& fn, nuint max_count = ~nuint());
+	};
+};
@@ -0,0 +1,238 @@
+#include "shm_slab.hpp"
+#include "shm_sync.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <vector>
+namespace cyh::os {
+	static constexpr uint32_t SLAB_MAGIC = 0x42414C53; // "SLAB"
+	static constexpr uint32_t SLAB_VERSION = 1;
+	static constexpr nuint SLAB_ALIGNMENT = 64;
+	static constexpr uint SLAB_TAG_SHIFT = 32;
+	static constexpr uint64_t SLAB_INDEX_MASK = (uint64_t(1) << SLAB_TAG_SHIFT) - 1;
+
+	struct SharedSlabPool::_poolHeader {
+		std::atomic<uint32_t> m_magic;
+		uint32_t m_version;
+		uint32_t m_slab_count;
+		uint32_t m_max_references;
+		uint64_t m_slab_size;
+		// index + 1 of the first free slab in the low 32 bits, an ABA tag in the high 32 bits
+		alignas(SLAB_ALIGNMENT) std::atomic<uint64_t> m_free_head;
+		std::atomic<uint32_t> m_free_count;
+	};
+	struct SharedSlabPool::_slabState {
+		std::atomic<uint32_t> m_refcount;
+		// index + 1 of the next free slab while in the free list
+		std::atomic<uint32_t> m_next;
+		// process id owning each reference, 0 for an unused entry
+		std::atomic<uint32_t> m_owners[MAX_REFERENCES];
+	};
+	static_assert(sizeof(SharedSlabPool::INVALID_SLAB) == sizeof(uint32_t), "slab index must fit the free list");
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "slab pool requires lock free 64 bit atomics");
+
+	static nuint align_slab_size(nuint size) {
+		return (size + SLAB_ALIGNMENT - 1) & ~(SLAB_ALIGNMENT - 1);
+	}
+	static uint64_t make_tagged_index(uint64_t tagged, uint64_t index_plus_one) {
+		uint64_t tag = (tagged >> SLAB_TAG_SHIFT) + 1;
+		return (tag << SLAB_TAG_SHIFT) | (index_plus_one & SLAB_INDEX_MASK);
+	}
+
+	SharedSlabPool::SharedSlabPool(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize, uint slab_count, nuint slab_size) : m_holder(std::move(holder)) {
+		if (!this->m_holder.data()) { return; }
+		auto data = static_cast<unsigned char*>(this->m_holder.data());
+		unsigned char* base = reinterpret_cast<unsigned char*>(align_slab_size(reinterpret_cast<uintptr_t>(data)));
+		nuint usable = this->m_holder.capacity() - static_cast<nuint>(base - data);
+		auto header = reinterpret_cast<_poolHeader*>(base);
+		if (!initialize) {
+			if (header->m_magic.load(std::memory_order_acquire) != SLAB_MAGIC || header->m_version != SLAB_VERSION) { return; }
+			if (header->m_max_references != MAX_REFERENCES) { return; }
+			slab_count = header->m_slab_count;
+			slab_size = static_cast<nuint>(header->m_slab_size);
+		}
+		nuint states_offset = align_slab_size(sizeof(_poolHeader));
+		nuint slabs_offset = states_offset + align_slab_size(slab_count * sizeof(_slabState));
+		if (slabs_offset + slab_count * slab_size > usable) { return; }
+
+		this->m_states = reinterpret_cast<_slabState*>(base + states_offset);
+		this->m_slabs = base + slabs_offset;
+		this->m_slab_count = slab_count;
+		this->m_slab_size = slab_size;
+		if (initialize) {
+			header = new (base) _poolHeader{};
+			header->m_version = SLAB_VERSION;
+			header->m_slab_count = slab_count;
+			header->m_max_references = MAX_REFERENCES;
+			header->m_slab_size = slab_size;
+			// chain every slab into the free list in order
+			for (uint i = 0; i < slab_count; ++i) {
+				auto state = new (this->m_states + i) _slabState{};
+				state->m_next.store(i + 1 < slab_count ? i + 2 : 0, std::memory_order_relaxed);
+			}
+			header->m_free_head.store(slab_count ? 1 : 0, std::memory_order_relaxed);
+			header->m_free_count.store(slab_count, std::memory_order_relaxed);
+			header->m_magic.store(SLAB_MAGIC, std::memory_order_release);
+			this->m_holder.MarkReady();
+		}
+		this->m_header = header;
+	}
+	SharedSlabPool::SharedSlabPool(SharedSlabPool&& other) noexcept {
+		*this = std::move(other);
+	}
+	SharedSlabPool& SharedSlabPool::operator=(SharedSlabPool&& other) noexcept {
+		if (this == &other) { return *this; }
+		this->m_holder = std::move(other.m_holder);
+		this->m_header = other.m_header;
+		this->m_states = other.m_states;
+		this->m_slabs = other.m_slabs;
+		this->m_slab_count = other.m_slab_count;
+		this->m_slab_size = other.m_slab_size;
+		other.m_header = nullptr;
+		other.m_states = nullptr;
+		other.m_slabs = nullptr;
+		other.m_slab_count = 0;
+		return *this;
+	}
+
+	SharedSlabPool SharedSlabPool::Create(const std::string& name, uint slab_count, nuint slab_size, const SharedMemoryManager::SharedMemoryOptions& options) {
+		slab_size = align_slab_size(slab_size ? slab_size : 1);
+		if (slab_count == INVALID_SLAB) { return SharedSlabPool{}; }
+		nuint byteSize = SLAB_ALIGNMENT + align_slab_size(sizeof(_poolHeader)) + align_slab_size(slab_count * sizeof(_slabState)) + slab_count * slab_size;
+		SharedMemoryManager::SharedMemoryOptions create_options = options;
+		create_options.defer_ready = true;
+		return SharedSlabPool(SharedMemoryManager::CreateSharedMemory(name, byteSize, create_options), true, slab_count, slab_size);
+	}
+	SharedSlabPool SharedSlabPool::Open(const std::string& name, const SharedMemoryManager::SharedMemoryOptions& options) {
+		return SharedSlabPool(SharedMemoryManager::OpenSharedMemory(SharedMemoryManager::ACCESS_READWRITE, name, options), false, 0, 0);
+	}
+
+	SharedSlabPool::_slabState* SharedSlabPool::get_state(uint index) const {
+		if (!this->m_header || index >= this->m_slab_count) { return nullptr; }
+		return this->m_states + index;
+	}
+	uint SharedSlabPool::pop_free_slab() {
+		auto& head = this->m_header->m_free_head;
+		uint64_t tagged = head.load(std::memory_order_acquire);
+		while (true) {
+			uint64_t index_plus_one = tagged & SLAB_INDEX_MASK;
+			if (!index_plus_one) { return INVALID_SLAB; }
+			// the slab may be popped and pushed again by another process meanwhile, then the tag makes the exchange fail
+			uint64_t next = this->m_states[index_plus_one - 1].m_next.load(std::memory_order_relaxed);
+			if (head.compare_exchange_weak(tagged, make_tagged_index(tagged, next), std::memory_order_acquire, std::memory_order_acquire)) {
+				this->m_header->m_free_count.fetch_sub(1, std::memory_order_relaxed);
+				return static_cast<uint>(index_plus_one - 1);
+			}
+		}
+	}
+	void SharedSlabPool::push_free_slab(uint index) {
+		auto& head = this->m_header->m_free_head;
+		auto& state = this->m_states[index];
+		uint64_t tagged = head.load(std::memory_order_relaxed);
+		do {
+			state.m_next.store(static_cast<uint32_t>(tagged & SLAB_INDEX_MASK), std::memory_order_relaxed);
+		} while (!head.compare_exchange_weak(tagged, make_tagged_index(tagged, uint64_t(index) + 1), std::memory_order_release, std::memory_order_relaxed));
+		this->m_header->m_free_count.fetch_add(1, std::memory_order_relaxed);
+	}
+	bool SharedSlabPool::add_reference(uint index, uint pid) {
+		auto state = this->get_state(index);
+		if (!state || !pid) { return false; }
+		// count first, a process killed before recording the owner leaks the reference instead of freeing a used slab
+		state->m_refcount.fetch_add(1, std::memory_order_relaxed);
+		for (auto& owner : state->m_owners) {
+			uint32_t expected = 0;
+			if (owner.load(std::memory_order_relaxed) == 0 && owner.compare_exchange_strong(expected, pid, std::memory_order_relaxed)) {
+				return true;
+			}
+		}
+		// the caller holds a reference, so this never drops the last one
+		state->m_refcount.fetch_sub(1, std::memory_order_relaxed);
+		return false;
+	}
+	bool SharedSlabPool::drop_reference(uint index, nuint entry, uint pid) {
+		auto& state = this->m_states[index];
+		uint32_t expected = pid;
+		// only one of the owner and a reclaimer clears the entry
+		if (!state.m_owners[entry].compare_exchange_strong(expected, 0, std::memory_order_relaxed)) { return false; }
+		// the writes to the slab happen before it is freed and reused
+		if (state.m_refcount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			this->push_free_slab(index);
+		}
+		return true;
+	}
+
+	bool SharedSlabPool::is_valid() const {
+		return this->m_header != nullptr;
+	}
+	uint SharedSlabPool::slab_count() const {
+		return this->m_slab_count;
+	}
+	nuint SharedSlabPool::slab_size() const {
+		return this->m_slab_size;
+	}
+	uint SharedSlabPool::free_count() const {
+		if (!this->m_header) { return 0; }
+		return this->m_header->m_free_count.load(std::memory_order_relaxed);
+	}
+	uint SharedSlabPool::use_count(uint index) const {
+		auto state = this->get_state(index);
+		if (!state) { return 0; }
+		return state->m_refcount.load(std::memory_order_relaxed);
+	}
+	void* SharedSlabPool::data(uint index) const {
+		if (!this->m_header || index >= this->m_slab_count) { return nullptr; }
+		return this->m_slabs + index * this->m_slab_size;
+	}
+
+	uint SharedSlabPool::Allocate() {
+		if (!this->m_header) { return INVALID_SLAB; }
+		uint index = this->pop_free_slab();
+		if (index == INVALID_SLAB) { return INVALID_SLAB; }
+		// nobody else can see a free slab, its owner entries are all 0
+		auto& state = this->m_states[index];
+		state.m_refcount.store(1, std::memory_order_relaxed);
+		state.m_owners[0].store(SharedSyncInternal::GetCurrentPid(), std::memory_order_relaxed);
+		return index;
+	}
+	bool SharedSlabPool::AddRef(uint index, uint pid) {
+		return this->add_reference(index, pid ? pid : SharedSyncInternal::GetCurrentPid());
+	}
+	bool SharedSlabPool::Release(uint index) {
+		auto state = this->get_state(index);
+		if (!state) { return false; }
+		uint pid = SharedSyncInternal::GetCurrentPid();
+		for (nuint entry = 0; entry < MAX_REFERENCES; ++entry) {
+			if (state->m_owners[entry].load(std::memory_order_relaxed) == pid && this->drop_reference(index, entry, pid)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	uint SharedSlabPool::ReclaimDeadReferences() {
+		if (!this->m_header) { return 0; }
+		// each owner is only checked once per call
+		std::vector<uint> alive;
+		std::vector<uint> dead;
+		uint reclaimed{};
+		for (uint index = 0; index < this->m_slab_count; ++index) {
+			auto& state = this->m_states[index];
+			if (state.m_refcount.load(std::memory_order_relaxed) == 0) { continue; }
+			for (nuint entry = 0; entry < MAX_REFERENCES; ++entry) {
+				uint pid = state.m_owners[entry].load(std::memory_order_relaxed);
+				if (!pid || std::find(alive.begin(), alive.end(), pid) != alive.end()) { continue; }
+				if (std::find(dead.begin(), dead.end(), pid) == dead.end()) {
+					if (SharedSyncInternal::IsProcessAlive(pid)) {
+						alive.push_back(pid);
+						continue;
+					}
+					dead.push_back(pid);
+				}
+				if (this->drop_reference(index, entry, pid)) {
+					++reclaimed;
+				}
+			}
+		}
+		return reclaimed;
+	}
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include "shmem_mgr.hpp"
+namespace cyh::os {
+	// Pool of fixed size buffers ( slabs ) in a shared memory, for passing large payloads without copying them
+	// A producer allocates a slab, fills it in place and passes only its index, for example through a SharedMpmcQueue,
+	// consumers read the slab in place and release it, the slab returns to a lock free free list with its last reference
+	//
+	// Every reference is recorded with the id of the process owning it, at most MAX_REFERENCES per slab,
+	// so ReclaimDeadReferences can drop the references of crashed processes.
+	// A process killed while adding or dropping a reference may leak that reference, then the slab is never reused,
+	// but a slab is never reused while it is referenced.
+	class SharedSlabPool {
+		struct _poolHeader;
+		struct _slabState;
+		SharedMemoryManager::SharedMemoryHolder m_holder;
+		_poolHeader* m_header{};
+		_slabState* m_states{};
+		unsigned char* m_slabs{};
+		uint m_slab_count{};
+		nuint m_slab_size{};
+
+		SharedSlabPool(SharedMemoryManager::SharedMemoryHolder&& holder, bool initialize, uint slab_count, nuint slab_size);
+		_slabState* get_state(uint index) const;
+		bool add_reference(uint index, uint pid);
+		// Drop the reference in the entry if it is still owned by pid, free the slab with the last reference
+		bool drop_reference(uint index, nuint entry, uint pid);
+		uint pop_free_slab();
+		void push_free_slab(uint index);
+	public:
+		static constexpr uint INVALID_SLAB = ~uint();
+		static constexpr uint MAX_REFERENCES = 14;
+
+		// slab_size is rounded up to 64 bytes
+		static SharedSlabPool Create(const std::string& name, uint slab_count, nuint slab_size, const SharedMemoryManager::SharedMemoryOptions& options = {});
+		static SharedSlabPool Open(const std::string& name, const SharedMemoryManager::SharedMemoryOptions& options = {});
+
+		SharedSlabPool() = default;
+		SharedSlabPool(const SharedSlabPool&) = delete;
+		SharedSlabPool& operator=(const SharedSlabPool&) = delete;
+		SharedSlabPool(SharedSlabPool&& other) noexcept;
+		SharedSlabPool& operator=(SharedSlabPool&& other) noexcept;
+
+		bool is_valid() const;
+		uint slab_count() const;
+		nuint slab_size() const;
+		// Approximate count of free slabs
+		uint free_count() const;
+		// Count of references to the slab, 0 if it is free
+		uint use_count(uint index) const;
+		// The address of the slab in this process, nullptr if index is out of range
+		void* data(uint index) const;
+
+		// Take a free slab referenced once by the calling process, INVALID_SLAB if none is free
+		uint Allocate();
+		// Add a reference owned by the process pid, 0 for the calling process
+		// The caller must hold a reference, so the slab can not be freed meanwhile
+		// Return false if the slab already has MAX_REFERENCES
+		bool AddRef(uint index, uint pid = 0);
+		// Drop a reference owned by the calling process, return false if it owns none
+		bool Release(uint index);
+		// Drop the references owned by processes which are no longer alive, return the count dropped
+		// It can run concurrently with the other operations, for example periodically in a supervisor
+		uint ReclaimDeadReferences();
+	};
+};
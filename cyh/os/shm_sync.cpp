@@ -0,0 +1,221 @@
+#include "shm_sync.hpp"
+#include "os_internal.hpp"
+#include <chrono>
+#include <climits>
+#include <thread>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define __CYH_X86__
+#endif
+#ifndef __WINDOWS_PLATFORM__
+#include <cerrno>
+#include <csignal>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+namespace cyh::os {
+	static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32 bit integer");
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared synchronization requires lock free 32 bit atomics");
+
+	static uint64_t get_steady_millis() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+	// Block while *pWord == expected, return false on timeout
+	// It may return true spuriously, callers check their condition again
+	static bool wait_on_address(std::atomic<uint32_t>* pWord, uint32_t expected, uint timeout_millis) {
+#ifdef __WINDOWS_PLATFORM__
+		if (pWord->load() != expected) { return true; }
+		if (timeout_millis == 0) { return false; }
+		Sleep(1);
+		return true;
+#else
+		timespec timeout{};
+		timespec* pTimeout = nullptr;
+		if (timeout_millis != SharedSync::INFINITE_WAIT) {
+			timeout.tv_sec = timeout_millis / 1000;
+			timeout.tv_nsec = static_cast<long>(timeout_millis % 1000) * 1000000L;
+			pTimeout = &timeout;
+		}
+		// no FUTEX_PRIVATE_FLAG, the word is shared between processes
+		long result = syscall(SYS_futex, reinterpret_cast<uint32_t*>(pWord), FUTEX_WAIT, expected, pTimeout, nullptr, 0);
+		return !(result == -1 && errno == ETIMEDOUT);
+#endif
+	}
+	static void wake_on_address(std::atomic<uint32_t>* pWord, int count) {
+#ifndef __WINDOWS_PLATFORM__
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(pWord), FUTEX_WAKE, count, nullptr, nullptr, 0);
+#endif
+	}
+	// Wait until *pWord != value or timeout, the count of waiters is kept for the waker
+	static bool wait_while_equal(std::atomic<uint32_t>* pWord, std::atomic<uint32_t>* pWaiters, uint32_t value, uint timeout_millis) {
+		uint64_t deadline = SharedSyncInternal::GetDeadlineMillis(timeout_millis);
+		bool result = true;
+		pWaiters->fetch_add(1);
+		while (pWord->load() == value) {
+			uint remain = SharedSyncInternal::GetRemainingMillis(deadline);
+			if (remain == 0 || !wait_on_address(pWord, value, remain)) {
+				result = pWord->load() != value;
+				break;
+			}
+		}
+		pWaiters->fetch_sub(1);
+		return result;
+	}
+
+	bool SharedSyncInternal::WaitOnAddress(std::atomic<uint32_t>* pWord, uint32_t expected, uint timeout_millis) {
+		return wait_on_address(pWord, expected, timeout_millis);
+	}
+	void SharedSyncInternal::WakeOnAddress(std::atomic<uint32_t>* pWord, int count) {
+		wake_on_address(pWord, count);
+	}
+	void SharedSyncInternal::CpuRelax() {
+#ifdef __CYH_X86__
+		_mm_pause();
+#else
+		std::this_thread::yield();
+#endif
+	}
+	uint SharedSyncInternal::GetRemainingMillis(uint64_t deadline_millis) {
+		if (deadline_millis == ~uint64_t()) { return SharedSync::INFINITE_WAIT; }
+		uint64_t now = get_steady_millis();
+		if (now >= deadline_millis) { return 0; }
+		uint64_t remain = deadline_millis - now;
+		return remain >= SharedSync::INFINITE_WAIT ? SharedSync::INFINITE_WAIT - 1 : static_cast<uint>(remain);
+	}
+	uint64_t SharedSyncInternal::GetDeadlineMillis(uint timeout_millis) {
+		if (timeout_millis == SharedSync::INFINITE_WAIT) { return ~uint64_t(); }
+		return get_steady_millis() + timeout_millis;
+	}
+	uint SharedSyncInternal::GetCurrentPid() {
+#ifdef __WINDOWS_PLATFORM__
+		return static_cast<uint>(GetCurrentProcessId());
+#else
+		return static_cast<uint>(getpid());
+#endif
+	}
+	bool SharedSyncInternal::IsProcessAlive(uint pid) {
+		if (!pid) { return false; }
+#ifdef __WINDOWS_PLATFORM__
+		HANDLE handle = OpenProcess(SYNCHRONIZE, FALSE, pid);
+		if (!handle) { return GetLastError() == ERROR_ACCESS_DENIED; }
+		bool alive = WaitForSingleObject(handle, 0) == WAIT_TIMEOUT;
+		CloseHandle(handle);
+		return alive;
+#else
+		// EPERM means the process exists but belongs to another user
+		return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#endif
+	}
+
+	void SharedEvent::Set() {
+		this->m_state.store(1);
+		if (this->m_waiters.load()) {
+			wake_on_address(&this->m_state, INT_MAX);
+		}
+	}
+	void SharedEvent::Reset() {
+		this->m_state.store(0);
+	}
+	bool SharedEvent::IsSet() const {
+		return this->m_state.load(std::memory_order_acquire) != 0;
+	}
+	bool SharedEvent::Wait(uint timeout_millis, uint spin_count) {
+		for (uint i = 0; i < spin_count; ++i) {
+			if (this->IsSet()) { return true; }
+			SharedSyncInternal::CpuRelax();
+		}
+		return wait_while_equal(&this->m_state, &this->m_waiters, 0, timeout_millis);
+	}
+
+	void SharedSemaphore::Post(uint32_t count) {
+		this->m_count.fetch_add(count);
+		if (this->m_waiters.load()) {
+			wake_on_address(&this->m_count, count > INT_MAX ? INT_MAX : static_cast<int>(count));
+		}
+	}
+	bool SharedSemaphore::TryWait() {
+		uint32_t count = this->m_count.load(std::memory_order_relaxed);
+		while (count) {
+			if (this->m_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	bool SharedSemaphore::Wait(uint timeout_millis, uint spin_count) {
+		for (uint i = 0; i < spin_count; ++i) {
+			if (this->TryWait()) { return true; }
+			SharedSyncInternal::CpuRelax();
+		}
+		uint64_t deadline = SharedSyncInternal::GetDeadlineMillis(timeout_millis);
+		while (!this->TryWait()) {
+			// another waiter may take the count between the wake up and TryWait, so wait again
+			if (!wait_while_equal(&this->m_count, &this->m_waiters, 0, SharedSyncInternal::GetRemainingMillis(deadline))) {
+				return this->TryWait();
+			}
+		}
+		return true;
+	}
+
+	bool SharedMutex::TryLock() {
+		uint32_t expected = 0;
+		return this->m_state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+	}
+	bool SharedMutex::Lock(uint timeout_millis, uint spin_count) {
+		for (uint i = 0; i < spin_count; ++i) {
+			if (this->TryLock()) { return true; }
+			SharedSyncInternal::CpuRelax();
+		}
+		uint64_t deadline = SharedSyncInternal::GetDeadlineMillis(timeout_millis);
+		// mark the lock contended, so the owner wakes a waiter when unlocking
+		while (this->m_state.exchange(2, std::memory_order_acquire) != 0) {
+			uint remain = SharedSyncInternal::GetRemainingMillis(deadline);
+			if (remain == 0) { return false; }
+			wait_on_address(&this->m_state, 2, remain);
+		}
+		return true;
+	}
+	void SharedMutex::Unlock() {
+		if (this->m_state.exchange(0, std::memory_order_release) == 2) {
+			wake_on_address(&this->m_state, 1);
+		}
+	}
+
+	uint32_t SharedCondition::PrepareWait() {
+		this->m_waiters.fetch_add(1);
+		// order the count of waiters before the caller reads the data
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return this->m_sequence.load();
+	}
+	void SharedCondition::CancelWait() {
+		this->m_waiters.fetch_sub(1);
+	}
+	bool SharedCondition::Wait(uint32_t ticket, uint timeout_millis) {
+		uint64_t deadline = SharedSyncInternal::GetDeadlineMillis(timeout_millis);
+		bool result = true;
+		while (this->m_sequence.load() == ticket) {
+			uint remain = SharedSyncInternal::GetRemainingMillis(deadline);
+			if (remain == 0 || !wait_on_address(&this->m_sequence, ticket, remain)) {
+				result = this->m_sequence.load() != ticket;
+				break;
+			}
+		}
+		this->m_waiters.fetch_sub(1);
+		return result;
+	}
+	void SharedCondition::NotifyOne() {
+		// order the change of data before reading the count of waiters
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (this->m_waiters.load()) {
+			this->m_sequence.fetch_add(1);
+			wake_on_address(&this->m_sequence, 1);
+		}
+	}
+	void SharedCondition::NotifyAll() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (this->m_waiters.load()) {
+			this->m_sequence.fetch_add(1);
+			wake_on_address(&this->m_sequence, INT_MAX);
+		}
+	}
+};
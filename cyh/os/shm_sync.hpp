@@ -0,0 +1,131 @@
+#pragma once
+#include "os_.hpp"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+namespace cyh::os {
+	// Synchronization objects to be placed inside a shared memory segment and used by several processes
+	// They contain only 32 bit atomics, so zero filled memory is a valid initial state
+	// On unix a waiter spins spin_count times, then blocks in futex(2) without FUTEX_PRIVATE_FLAG
+	// On windows a waiter polls with sleeps after spinning, because WaitOnAddress does not work across processes
+	// timeout_millis of ~uint() waits forever
+	struct SharedSync {
+		static constexpr uint INFINITE_WAIT = ~uint();
+		static constexpr uint DEFAULT_SPIN_COUNT = 128;
+		// A seqlock version odd for longer than this is left by a writer that died while writing
+		static constexpr uint SEQLOCK_TIMEOUT_MILLIS = 100;
+	};
+
+	// Manual reset event
+	class SharedEvent {
+		std::atomic<uint32_t> m_state{};
+		std::atomic<uint32_t> m_waiters{};
+	public:
+		void Set();
+		void Reset();
+		bool IsSet() const;
+		// Return false on timeout
+		bool Wait(uint timeout_millis = SharedSync::INFINITE_WAIT, uint spin_count = SharedSync::DEFAULT_SPIN_COUNT);
+	};
+
+	// Counting semaphore
+	class SharedSemaphore {
+		std::atomic<uint32_t> m_count{};
+		std::atomic<uint32_t> m_waiters{};
+	public:
+		void Post(uint32_t count = 1);
+		bool TryWait();
+		// Return false on timeout
+		bool Wait(uint timeout_millis = SharedSync::INFINITE_WAIT, uint spin_count = SharedSync::DEFAULT_SPIN_COUNT);
+	};
+
+	// Mutual exclusion between processes
+	// It is not robust, a process killed while holding the lock leaves it locked
+	class SharedMutex {
+		// 0 unlocked, 1 locked, 2 locked and someone may be waiting
+		std::atomic<uint32_t> m_state{};
+	public:
+		bool TryLock();
+		// Return false on timeout
+		bool Lock(uint timeout_millis = SharedSync::INFINITE_WAIT, uint spin_count = SharedSync::DEFAULT_SPIN_COUNT);
+		void Unlock();
+	};
+
+	// Condition for waiting on a predicate of lock free data in the segment ( an event count )
+	// The waiter calls PrepareWait(), checks the predicate, then calls Wait() or CancelWait()
+	// The notifier changes the data, then calls Notify, which is only a load if nobody is waiting
+	class SharedCondition {
+		std::atomic<uint32_t> m_sequence{};
+		std::atomic<uint32_t> m_waiters{};
+	public:
+		uint32_t PrepareWait();
+		void CancelWait();
+		// Wait until notified after the ticket from PrepareWait was taken, return false on timeout
+		bool Wait(uint32_t ticket, uint timeout_millis = SharedSync::INFINITE_WAIT);
+		void NotifyOne();
+		void NotifyAll();
+
+		// Wait until pred() returns true, return the last result of pred()
+		template<class Pred>
+		bool WaitFor(Pred&& pred, uint timeout_millis = SharedSync::INFINITE_WAIT, uint spin_count = SharedSync::DEFAULT_SPIN_COUNT);
+	};
+
+	struct SharedSyncInternal {
+		static void CpuRelax();
+		// Block while *pWord == expected, return false on timeout, it may return true spuriously
+		// Only reads the word, so it works on a read only mapping
+		static bool WaitOnAddress(std::atomic<uint32_t>* pWord, uint32_t expected, uint timeout_millis);
+		static void WakeOnAddress(std::atomic<uint32_t>* pWord, int count);
+		// Milliseconds left to the deadline, ~uint() for no deadline
+		static uint GetRemainingMillis(uint64_t deadline_millis);
+		static uint64_t GetDeadlineMillis(uint timeout_millis);
+		static uint GetCurrentPid();
+		// Indicate whether a process with the id exists, a reused id of a dead process is not detected
+		static bool IsProcessAlive(uint pid);
+		// Wait until the seqlock version is even and get it, return false if it stays odd for timeout_millis
+		template<class T>
+		static bool ReadSeqlockVersion(const std::atomic<T>* pVersion, T* pValue, uint timeout_millis = SharedSync::SEQLOCK_TIMEOUT_MILLIS);
+	};
+
+	template<class T>
+	bool SharedSyncInternal::ReadSeqlockVersion(const std::atomic<T>* pVersion, T* pValue, uint timeout_millis) {
+		uint64_t deadline = 0;
+		for (uint spin = 0; ; ++spin) {
+			T value = pVersion->load(std::memory_order_acquire);
+			if (!(value & 1)) {
+				*pValue = value;
+				return true;
+			}
+			if (spin < SharedSync::DEFAULT_SPIN_COUNT) {
+				CpuRelax();
+				continue;
+			}
+			// the writer may be preempted, so read the clock only after spinning
+			if (!deadline) {
+				deadline = GetDeadlineMillis(timeout_millis);
+			} else if (!GetRemainingMillis(deadline)) {
+				return false;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	template<class Pred>
+	bool SharedCondition::WaitFor(Pred&& pred, uint timeout_millis, uint spin_count) {
+		for (uint i = 0; i < spin_count; ++i) {
+			if (pred()) { return true; }
+			SharedSyncInternal::CpuRelax();
+		}
+		uint64_t deadline = SharedSyncInternal::GetDeadlineMillis(timeout_millis);
+		while (true) {
+			uint32_t ticket = this->PrepareWait();
+			if (pred()) {
+				this->CancelWait();
+				return true;
+			}
+			if (!this->Wait(ticket, SharedSyncInternal::GetRemainingMillis(deadline))) {
+				return pred();
+			}
+		}
+	}
+};
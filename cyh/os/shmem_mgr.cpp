@@ -1,30 +1,83 @@
 #include "shmem_mgr.hpp"
 #include "os_internal.hpp"
 #include "res_mon.hpp"
+#include "shm_sync.hpp"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#ifndef __WINDOWS_PLATFORM__
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <linux/magic.h>
+#include <linux/mempolicy.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#endif
 
 namespace cyh::os {
-	struct _MemBlock {
-		nuint m_size{};
-		void* m_data{};
+	using PageMode = SharedMemoryManager::PageMode;
+	using SharedMemoryOptions = SharedMemoryManager::SharedMemoryOptions;
+	using NumaPolicy = SharedMemoryManager::NumaPolicy;
+
+	static constexpr uint32_t SEGMENT_MAGIC = 0x4D485343; // "CSHM"
+	static constexpr uint32_t SEGMENT_VERSION = 1;
+	// The data follows the header at this offset
+	static constexpr nuint SEGMENT_HEADER_SIZE = 64;
+
+	// Header at the beginning of every shared memory
+	struct _segmentHeader {
+		std::atomic<uint32_t> m_magic;
+		uint32_t m_version;
+		// bytes of the segment including the header, only grows
+		std::atomic<uint64_t> m_size;
+		uint64_t m_creator_pid;
+		// 1 once the creator has initialized the content
+		std::atomic<uint32_t> m_ready;
+		// increased after every growth, m_size is stored before it
+		std::atomic<uint64_t> m_generation;
 	};
-	// Write the size of block to it's first address
-	static void write_size_header(void* head_of_block, nuint size) {
-		if (!head_of_block) { return; }
-		nuint* pSize = (nuint*)head_of_block;
-		*pSize = size;
-	}
-	// Read the size stored in the first address of block
-	static nuint read_size_header(void* head_of_block) {
-		if (!head_of_block) { return 0; }
-		nuint* pSize = (nuint*)head_of_block;
-		return *pSize;
+	static_assert(sizeof(_segmentHeader) <= SEGMENT_HEADER_SIZE, "segment header must fit before the data");
+
+	static uint get_current_pid() {
+#ifdef __WINDOWS_PLATFORM__
+		return static_cast<uint>(GetCurrentProcessId());
+#else
+		return static_cast<uint>(getpid());
+#endif
+	}
+	// Initialize the header of a new segment, the magic is published last
+	static void init_segment_header(void* head_of_block, nuint size, bool ready) {
+		auto header = new (head_of_block) _segmentHeader{};
+		header->m_version = SEGMENT_VERSION;
+		header->m_size.store(size, std::memory_order_relaxed);
+		header->m_creator_pid = get_current_pid();
+		header->m_ready.store(ready ? 1 : 0, std::memory_order_relaxed);
+		header->m_magic.store(SEGMENT_MAGIC, std::memory_order_release);
+	}
+	static _segmentHeader* get_segment_header(void* head_of_block) {
+		return reinterpret_cast<_segmentHeader*>(head_of_block);
+	}
+	// Indicate whether the mapping holds an initialized header
+	static bool is_valid_segment(void* head_of_block) {
+		auto header = get_segment_header(head_of_block);
+		if (header->m_magic.load(std::memory_order_acquire) != SEGMENT_MAGIC || header->m_version != SEGMENT_VERSION) { return false; }
+		return header->m_size.load(std::memory_order_relaxed) >= SEGMENT_HEADER_SIZE;
 	}
 	// For windows, this only work if the input handle is the last handle link to the shared memory in global
-	static void try_stop_sharing(void* handle, const char* name) {
+	static void try_stop_sharing(void* handle, const char* name, bool is_file) {
 #ifdef __WINDOWS_PLATFORM__
 		CloseHandle(handle);
 #else
-		shm_unlink(name);
+		if (is_file) {
+			unlink(name);
+		} else {
+			shm_unlink(name);
+		}
 #endif
 	}
 	// Unmap the address of current process which is mapped to the shared memory
@@ -37,17 +90,37 @@ namespace cyh::os {
 #endif
 		}
 	}
+	// The handle of no shared memory, descriptor 0 is a valid handle on unix
+	static void* const NO_SHM_HANDLE =
+#ifdef __WINDOWS_PLATFORM__
+		nullptr;
+#else
+		(void*)intptr_t(-1);
+#endif
 	// Indicate wether the input handle is valid
 	static bool is_valid_shm_handle(void* handle) {
 		return
 #ifdef __WINDOWS_PLATFORM__
 			handle != nullptr;
 #else
-			(int)handle > 0;
+			(int)handle >= 0;
 #endif
 	}
+	// Round the size up to a multiple of page_size
+	static nuint round_up_size(nuint size, nuint page_size) {
+		if (!page_size) { return size; }
+		return (size + page_size - 1) / page_size * page_size;
+	}
+	// The path of the file backing a shared memory in hugetlbfs
+	static std::string get_hugetlbfs_path(const std::string& mount, const std::string& name) {
+		if (!name.empty() && name[0] == '/') {
+			return mount + name;
+		}
+		return mount + "/" + name;
+	}
 	// Create a shared memory in host os and create a handle link to the shared memory
-	static void* create_shared_memory(const char* name, nuint alloc_size) {
+	// For hugetlbfs, the name is the path of backing file
+	static void* create_shared_memory(const char* name, nuint alloc_size, bool is_file) {
 		return
 #ifdef __WINDOWS_PLATFORM__
 			CreateFileMappingA(
@@ -59,18 +132,80 @@ namespace cyh::os {
 				name
 			);
 #else
-			(void*)shm_open(name, O_CREAT | O_RDWR, 0666);
+			(void*)(is_file ? open(name, O_CREAT | O_RDWR, 0666) : shm_open(name, O_CREAT | O_RDWR, 0666));
 #endif
 	}
 	// Create a handle to an exists shared memory
-	static void* get_exist_shm_handle(const char* name, uint accessFlag) {
+	static void* get_exist_shm_handle(const char* name, uint accessFlag, bool is_file) {
 		return
 #ifdef __WINDOWS_PLATFORM__
 			OpenFileMapping(accessFlag, FALSE, name);
 #else
-			shm_open(name, O_RDWR, 0666);
+			// a read only opener needs no write permission on the memory
+			(void*)(is_file ? open(name, (accessFlag & PROT_WRITE) ? O_RDWR : O_RDONLY) : shm_open(name, (accessFlag & PROT_WRITE) ? O_RDWR : O_RDONLY, 0666));
+#endif
+	}
+#ifndef __WINDOWS_PLATFORM__
+	// Get the size to map an exists shared memory, 0 if the creator has not sized it yet
+	static nuint get_shm_mapping_size(void* handle) {
+		struct stat file_stat {};
+		if (fstat((int)handle, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(SEGMENT_HEADER_SIZE)) {
+			return 0;
+		}
+		return static_cast<nuint>(file_stat.st_size);
+	}
+#endif
+#ifndef __WINDOWS_PLATFORM__
+	// Set the policy of the shared memory behind the mapping, it only affects pages faulted in later
+	// The policy is a hint, it is left as default if mbind fails
+	static void apply_numa_policy(void* ptr, nuint size, const SharedMemoryOptions& options) {
+		// nothing to place on a single node host
+		if (!options.numa_nodes || SharedMemoryManager::GetNumaNodeCount() < 2) { return; }
+		int mode = MPOL_DEFAULT;
+		switch (options.numa_policy) {
+		case NumaPolicy::Bind:
+			mode = MPOL_BIND;
+			break;
+		case NumaPolicy::Interleave:
+			mode = MPOL_INTERLEAVE;
+			break;
+		case NumaPolicy::Preferred:
+			mode = MPOL_PREFERRED;
+			break;
+		default:
+			return;
+		}
+		unsigned long node_mask[(sizeof(options.numa_nodes) + sizeof(unsigned long) - 1) / sizeof(unsigned long)]{};
+		memcpy(node_mask, &options.numa_nodes, sizeof(options.numa_nodes));
+		// the kernel reads maxnode - 1 bits of the mask
+		syscall(SYS_mbind, ptr, size, mode, node_mask, sizeof(options.numa_nodes) * 8 + 1, 0);
+	}
+	// Set the huge page hint and the numa policy of the options on a mapping, before its pages are faulted in
+	static void apply_mapping_policy(void* ptr, nuint size, const SharedMemoryOptions& options) {
+		if (options.page_mode == PageMode::Transparent) {
+			madvise(ptr, size, MADV_HUGEPAGE);
+		}
+		if (options.numa_policy != NumaPolicy::Default) {
+			apply_numa_policy(ptr, size, options);
+		}
+	}
+	// Fault in the pages of mapping
+	static void prefault_pages(void* ptr, nuint size, bool writable) {
+#ifdef MADV_POPULATE_WRITE
+		if (madvise(ptr, size, writable ? MADV_POPULATE_WRITE : MADV_POPULATE_READ) == 0) { return; }
 #endif
+		// kernel before 5.14, touch one byte of each page, an atomic add of 0 takes the write fault without changing the data of other processes
+		nuint page_size = static_cast<nuint>(sysconf(_SC_PAGESIZE));
+		unsigned char* pBytes = (unsigned char*)ptr;
+		for (nuint offset = 0; offset < size; offset += page_size) {
+			if (writable) {
+				std::atomic_ref<unsigned char>(pBytes[offset]).fetch_add(0, std::memory_order_relaxed);
+			} else {
+				(void)*(volatile unsigned char*)(pBytes + offset);
+			}
+		}
 	}
+#endif
 	// For windows, this will stop sharing memory if this is the last handle bound to the shared memory
 	static void close_shm_handle(void* handle) {
 #ifdef __WINDOWS_PLATFORM__
@@ -79,54 +214,196 @@ namespace cyh::os {
 		close((int)handle);
 #endif
 	}
-	// This function will mark the alloc_size at the starting address of shared memory if the input handle existing a bound shared memory
-	static void* init_and_get_shm_address(void* handle, nuint alloc_size) {
+#ifndef __WINDOWS_PLATFORM__
+	// Extend a mapping to the grown size of memory, the address may change, nullptr if failed and the old mapping is kept
+	// A valid anonymous_handle is used instead of opening the memory by name
+	// The policy of options is set again, the grown pages or a new mapping do not have it
+	static void* remap_grown_segment(void* head_of_block, nuint old_size, nuint new_size, void* anonymous_handle, const std::string& name, bool is_file, uint accessFlag, const SharedMemoryOptions& options) {
+		void* ptr = mremap(head_of_block, old_size, new_size, MREMAP_MAYMOVE);
+		if (ptr != MAP_FAILED) {
+			apply_mapping_policy(ptr, new_size, options);
+			return ptr;
+		}
+		// mappings of hugetlbfs can not be extended, map the whole memory again
+		bool reopen = !is_valid_shm_handle(anonymous_handle);
+		auto handle = reopen ? get_exist_shm_handle(name.c_str(), accessFlag, is_file) : anonymous_handle;
+		if (!is_valid_shm_handle(handle)) { return nullptr; }
+		ptr = mmap(nullptr, new_size, accessFlag, MAP_SHARED, (int)handle, 0);
+		if (reopen) {
+			close_shm_handle(handle);
+		}
+		if (ptr == MAP_FAILED) { return nullptr; }
+		munmap(head_of_block, old_size);
+		apply_mapping_policy(ptr, new_size, options);
+		return ptr;
+	}
+#endif
+	// Map the shared memory to the address in current process and get the pointer, nullptr if failed
+	static void* get_shm_address(void* handle, uint accessFlag, nuint size_to_mapping, const SharedMemoryOptions& options) {
 		void* ptr;
 #ifdef __WINDOWS_PLATFORM__
-		ptr = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, alloc_size);
+		ptr = MapViewOfFile(handle, accessFlag, 0, 0, size_to_mapping);
 #else
-		ftruncate((int)handle, alloc_size);
-		ptr = mmap(0, alloc_size, PROT_READ | PROT_WRITE, MAP_SHARED, (int)handle, 0);
-#endif
-		if (ptr) {
-			write_size_header(ptr, alloc_size);
+		bool is_transparent = options.page_mode == PageMode::Transparent;
+		bool is_writable = accessFlag & PROT_WRITE;
+		bool is_placed = options.numa_policy != NumaPolicy::Default;
+		// huge pages and numa policy must be set before the first fault, so such pages are populated after madvise and mbind
+		// MAP_POPULATE only read faults a shared mapping, the first write to each page still faults
+		bool populate_later = options.prefault && (is_transparent || is_writable || is_placed);
+		int flags = MAP_SHARED;
+		if (options.prefault && !populate_later) {
+			flags |= MAP_POPULATE;
+		}
+		ptr = mmap(0, size_to_mapping, accessFlag, flags, (int)handle, 0);
+		if (ptr == MAP_FAILED) {
+			return nullptr;
 		}
+		apply_mapping_policy(ptr, size_to_mapping, options);
+		if (options.will_need) {
+			madvise(ptr, size_to_mapping, MADV_WILLNEED);
+		}
+		if (populate_later) {
+			prefault_pages(ptr, size_to_mapping, is_writable);
+		}
+#endif
 		return ptr;
 	}
-	// Map the shared memory to the address in current process and get the pointer
-	static void* get_shm_address(void* handle, uint accessFlag, nuint size_to_mapping) {
+	// This function will mark the alloc_size at the starting address of shared memory if the input handle existing a bound shared memory
+	static void* init_and_get_shm_address(void* handle, nuint alloc_size, const SharedMemoryOptions& options) {
 		void* ptr;
 #ifdef __WINDOWS_PLATFORM__
-		ptr = MapViewOfFile(handle, accessFlag, 0, 0, size_to_mapping);
+		ptr = get_shm_address(handle, FILE_MAP_ALL_ACCESS, alloc_size, options);
 #else
-		ptr = mmap(0, size_to_mapping, accessFlag, MAP_SHARED, (int)handle, 0);
+		if (ftruncate((int)handle, alloc_size) != 0) {
+			return nullptr;
+		}
+		ptr = get_shm_address(handle, PROT_READ | PROT_WRITE, alloc_size, options);
 #endif
+		if (ptr) {
+			init_segment_header(ptr, alloc_size, !options.defer_ready);
+		}
 		return ptr;
 	}
 	// Create an object automatically managed the lifetime of shared memory
 	// The input handle and block will managed by SharedMemoryHolder after calling this function
 	static SharedMemoryManager::SharedMemoryHolder create_shm_holder(void*& handle, void* block, const char* name, bool is_owner) {
 		void* temp = handle;
-		handle = 0;
+		handle = NO_SHM_HANDLE;
 		return SharedMemoryManager::SharedMemoryHolder(temp, block, name, is_owner);
 	}
+	// The policy belongs to the memory and is set by its creator, openers do not change it
+	static SharedMemoryOptions get_open_options(const SharedMemoryOptions& options) {
+		SharedMemoryOptions open_options = options;
+		open_options.numa_policy = NumaPolicy::Default;
+		return open_options;
+	}
+	// A mapping of an exists shared memory
+	struct _segmentMapping {
+		void* m_block;
+		nuint m_mapped_size;
+		nuint m_segment_size;
+		uint64_t m_generation;
+	};
+	// Map an exists shared memory and wait until it is ready, return false if failed before the deadline
+	// The size and header are only available after the creator mapped the memory
+	static bool map_exist_segment(void* handle, uint accessFlag, const SharedMemoryOptions& options, uint64_t deadline, _segmentMapping* pMapping) {
+		void* ptr{};
+		nuint mapped_size{};
+		nuint segment_size{};
+		uint64_t generation{};
+		while (true) {
+#ifdef __WINDOWS_PLATFORM__
+			// size 0 maps the whole section
+			ptr = get_shm_address(handle, accessFlag, 0, options);
+#else
+			mapped_size = get_shm_mapping_size(handle);
+			if (mapped_size) {
+				ptr = get_shm_address(handle, accessFlag, mapped_size, options);
+			}
+#endif
+			if (ptr) {
+				auto header = get_segment_header(ptr);
+				if (!mapped_size) {
+					mapped_size = static_cast<nuint>(header->m_size.load(std::memory_order_relaxed));
+				}
+				segment_size = 0;
+				if (is_valid_segment(ptr)) {
+					// the size read after the generation is at least the size of that generation
+					generation = header->m_generation.load(std::memory_order_acquire);
+					segment_size = static_cast<nuint>(header->m_size.load(std::memory_order_relaxed));
+					if (segment_size <= mapped_size) { break; }
+				}
+				unmap_address(ptr, mapped_size);
+				ptr = nullptr;
+				// grown after the size to map was read, map it again at once
+				if (segment_size > mapped_size) { continue; }
+			}
+			if (SharedSyncInternal::GetRemainingMillis(deadline) == 0) {
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		// wait for the content, the ready flag is only read so a read only mapping can wait too
+		auto header = get_segment_header(ptr);
+		while (!header->m_ready.load(std::memory_order_acquire)) {
+			uint remain = SharedSyncInternal::GetRemainingMillis(deadline);
+			if (remain == 0) {
+				unmap_address(ptr, mapped_size);
+				return false;
+			}
+			SharedSyncInternal::WaitOnAddress(&header->m_ready, 0, remain);
+		}
+		pMapping->m_block = ptr;
+		pMapping->m_mapped_size = mapped_size;
+		pMapping->m_segment_size = segment_size;
+		pMapping->m_generation = generation;
+		return true;
+	}
+#ifndef __WINDOWS_PLATFORM__
+	// Apply the seals of options to a memfd, the mappings already made are not affected
+	static bool seal_anonymous_memory(void* handle, const SharedMemoryOptions& options) {
+		int seals{};
+		if (options.seal_size) {
+			seals |= F_SEAL_SHRINK | F_SEAL_GROW;
+		}
+		if (options.seal_future_write) {
+#ifdef F_SEAL_FUTURE_WRITE
+			seals |= F_SEAL_FUTURE_WRITE;
+#else
+			return false;
+#endif
+		}
+		if (!seals) { return true; }
+		return fcntl((int)handle, F_ADD_SEALS, seals | F_SEAL_SEAL) == 0;
+	}
+#endif
 	// Create an useless holder
 	static SharedMemoryManager::SharedMemoryHolder create_invalid_holder() {
-		return SharedMemoryManager::SharedMemoryHolder{ 0, 0, "", false };
+		return SharedMemoryManager::SharedMemoryHolder{ NO_SHM_HANDLE, 0, "", false };
 	}
 
 	void SharedMemoryManager::_ReleaseHolder(SharedMemoryHolder* pholder) {
 		if (!pholder) { return; }
-		if (pholder->m_handle) {
-			try_stop_sharing(pholder->m_handle, pholder->fname.c_str());
+		if (is_valid_shm_handle(pholder->m_handle)) {
+			if (pholder->m_is_anonymous) {
+				// an anonymous memory has no name, it is freed after its last descriptor and mapping
+				close_shm_handle(pholder->m_handle);
+			} else {
+				try_stop_sharing(pholder->m_handle, pholder->fname.c_str(), pholder->m_is_file);
+			}
 		}
 		if (pholder->m_block) {
-			auto alloc_size = read_size_header(pholder->m_block);
-			unmap_address(pholder->m_block, alloc_size);
+			unmap_address(pholder->m_block, pholder->m_mapped_size);
 		}
 		pholder->fname.clear();
+		pholder->m_is_file = false;
+		pholder->m_is_anonymous = false;
 		pholder->m_size = 0;
-		pholder->m_handle = 0;
+		pholder->m_mapped_size = 0;
+		pholder->m_generation = 0;
+		pholder->m_access = 0;
+		pholder->m_options = SharedMemoryOptions{};
+		pholder->m_handle = NO_SHM_HANDLE;
 		pholder->m_block = 0;
 	}
 	void SharedMemoryManager::_MoveHolder(SharedMemoryHolder* pdst, SharedMemoryHolder* psrc) {
@@ -137,9 +414,21 @@ namespace cyh::os {
 		pdst->m_handle = psrc->m_handle;
 		pdst->m_block = psrc->m_block;
 		pdst->m_size = psrc->m_size;
-		psrc->m_handle = 0;
+		pdst->m_mapped_size = psrc->m_mapped_size;
+		pdst->m_generation = psrc->m_generation;
+		pdst->m_access = psrc->m_access;
+		pdst->m_options = std::move(psrc->m_options);
+		pdst->m_is_file = psrc->m_is_file;
+		pdst->m_is_anonymous = psrc->m_is_anonymous;
+		psrc->m_handle = NO_SHM_HANDLE;
 		psrc->m_block = 0;
 		psrc->m_size = 0;
+		psrc->m_mapped_size = 0;
+		psrc->m_generation = 0;
+		psrc->m_access = 0;
+		psrc->m_options = SharedMemoryOptions{};
+		psrc->m_is_file = false;
+		psrc->m_is_anonymous = false;
 #ifdef __WINDOWS_PLATFORM__
 #else
 		pdst->fname = std::move(psrc->fname);
@@ -148,25 +437,124 @@ namespace cyh::os {
 	}
 	void* SharedMemoryManager::SharedMemoryHolder::data() const {
 		if (this->m_block) {
-			return ((_MemBlock*)this->m_block)->m_data;
+			return (unsigned char*)this->m_block + SEGMENT_HEADER_SIZE;
 		}
 		return nullptr;
 	}
 	nuint SharedMemoryManager::SharedMemoryHolder::capacity() const {
 		return this->m_size;
 	}
+	void SharedMemoryManager::SharedMemoryHolder::MarkReady() {
+		if (!this->m_block) { return; }
+		auto header = get_segment_header(this->m_block);
+		header->m_ready.store(1, std::memory_order_release);
+		SharedSyncInternal::WakeOnAddress(&header->m_ready, INT_MAX);
+	}
+	bool SharedMemoryManager::SharedMemoryHolder::is_ready() const {
+		if (!this->m_block) { return false; }
+		return get_segment_header(this->m_block)->m_ready.load(std::memory_order_acquire) != 0;
+	}
+	bool SharedMemoryManager::SharedMemoryHolder::copy_in(nuint offset, const void* src, nuint size) {
+		return this->copy_in(offset, src, size, MemoryCopy::CopyOptions{});
+	}
+	bool SharedMemoryManager::SharedMemoryHolder::copy_in(nuint offset, const void* src, nuint size, const MemoryCopy::CopyOptions& options) {
+		if (!this->m_block || (!src && size)) { return false; }
+		if (offset > this->m_size || size > this->m_size - offset) { return false; }
+		if (this->m_access == SharedMemoryManager::ACCESS_READONLY) { return false; }
+		MemoryCopy::Copy((unsigned char*)this->data() + offset, src, size, options);
+		return true;
+	}
+	bool SharedMemoryManager::SharedMemoryHolder::copy_out(nuint offset, void* dst, nuint size) const {
+		return this->copy_out(offset, dst, size, MemoryCopy::CopyOptions{});
+	}
+	bool SharedMemoryManager::SharedMemoryHolder::copy_out(nuint offset, void* dst, nuint size, const MemoryCopy::CopyOptions& options) const {
+		if (!this->m_block || (!dst && size)) { return false; }
+		if (offset > this->m_size || size > this->m_size - offset) { return false; }
+		MemoryCopy::Copy(dst, (unsigned char*)this->data() + offset, size, options);
+		return true;
+	}
+	uint SharedMemoryManager::SharedMemoryHolder::creator_pid() const {
+		if (!this->m_block) { return 0; }
+		return static_cast<uint>(get_segment_header(this->m_block)->m_creator_pid);
+	}
+	bool SharedMemoryManager::SharedMemoryHolder::Grow(nuint byteSize) {
+		// only the creator keeps the handle of a named memory
+		if (!this->m_block || !is_valid_shm_handle(this->m_handle)) { return false; }
+		if (this->m_is_anonymous && this->creator_pid() != get_current_pid()) { return false; }
+		if (byteSize <= this->m_size) { return true; }
+#ifdef __WINDOWS_PLATFORM__
+		// the size of a section is fixed once created
+		return false;
+#else
+		// the handle of a named memory is closed after mapping, open the memory again to resize it
+		auto handle = this->m_is_anonymous ? this->m_handle : get_exist_shm_handle(this->fname.c_str(), PROT_READ | PROT_WRITE, this->m_is_file);
+		if (!is_valid_shm_handle(handle)) { return false; }
+		// st_blksize is the huge page size in hugetlbfs, which only accepts sizes of whole huge pages
+		struct stat file_stat {};
+		nuint alloc_size{};
+		bool resized = fstat((int)handle, &file_stat) == 0;
+		if (resized) {
+			alloc_size = round_up_size(byteSize + SEGMENT_HEADER_SIZE, static_cast<nuint>(file_stat.st_blksize));
+			resized = ftruncate((int)handle, alloc_size) == 0;
+		}
+		if (!this->m_is_anonymous) {
+			close_shm_handle(handle);
+		}
+		if (!resized) { return false; }
+		// the pages keep their offsets, only the address of the mapping may change
+		void* ptr = remap_grown_segment(this->m_block, this->m_mapped_size, alloc_size, this->m_is_anonymous ? this->m_handle : NO_SHM_HANDLE, this->fname, this->m_is_file, this->m_access, this->m_options);
+		if (!ptr) { return false; }
+		this->m_block = ptr;
+		this->m_mapped_size = alloc_size;
+		this->m_size = alloc_size - SEGMENT_HEADER_SIZE;
+		auto header = get_segment_header(ptr);
+		header->m_size.store(alloc_size, std::memory_order_relaxed);
+		this->m_generation = header->m_generation.fetch_add(1, std::memory_order_release) + 1;
+		return true;
+#endif
+	}
+	bool SharedMemoryManager::SharedMemoryHolder::Refresh() {
+		if (!this->m_block) { return false; }
+		auto header = get_segment_header(this->m_block);
+		uint64_t generation = header->m_generation.load(std::memory_order_acquire);
+		if (generation == this->m_generation) { return true; }
+#ifdef __WINDOWS_PLATFORM__
+		return false;
+#else
+		auto segment_size = static_cast<nuint>(header->m_size.load(std::memory_order_relaxed));
+		if (segment_size > this->m_mapped_size) {
+			void* ptr = remap_grown_segment(this->m_block, this->m_mapped_size, segment_size, this->m_is_anonymous ? this->m_handle : NO_SHM_HANDLE, this->fname, this->m_is_file, this->m_access, this->m_options);
+			if (!ptr) { return false; }
+			this->m_block = ptr;
+			this->m_mapped_size = segment_size;
+		}
+		this->m_size = segment_size - SEGMENT_HEADER_SIZE;
+		this->m_generation = generation;
+		return true;
+#endif
+	}
+	int SharedMemoryManager::SharedMemoryHolder::native_handle() const {
+		return this->m_is_anonymous ? (int)this->m_handle : -1;
+	}
+	bool SharedMemoryManager::SharedMemoryHolder::is_stale() const {
+		if (!this->m_block) { return false; }
+		return get_segment_header(this->m_block)->m_generation.load(std::memory_order_relaxed) != this->m_generation;
+	}
+	uint64_t SharedMemoryManager::SharedMemoryHolder::generation() const {
+		return this->m_generation;
+	}
 	SharedMemoryManager::SharedMemoryHolder::SharedMemoryHolder(void* handle, void* block, const std::string& name, bool is_owner) : m_block(block), fname(name) {
 #ifdef __WINDOWS_PLATFORM__
 		this->m_handle = handle;
 #else
-		close((int)handle);
+		if (is_valid_shm_handle(handle)) { close((int)handle); }
 		if (is_owner) { this->m_handle = handle; }
 #endif
 		if (block) {
-			auto alloc_size = read_size_header(block);
-			if (alloc_size > sizeof(nuint)) {
-				this->m_size = alloc_size - sizeof(nuint);
-			}
+			auto header = get_segment_header(block);
+			this->m_generation = header->m_generation.load(std::memory_order_acquire);
+			this->m_mapped_size = static_cast<nuint>(header->m_size.load(std::memory_order_relaxed));
+			this->m_size = this->m_mapped_size - SEGMENT_HEADER_SIZE;
 		}
 	}
 	SharedMemoryManager::SharedMemoryHolder::SharedMemoryHolder(SharedMemoryHolder&& other) noexcept {
@@ -189,37 +577,410 @@ namespace cyh::os {
 #endif
 
 	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::CreateSharedMemory(const std::string& name, nuint byteSize) {
-		nuint alloc_size = byteSize + sizeof(nuint);
+		return SharedMemoryManager::CreateSharedMemory(name, byteSize, SharedMemoryOptions{});
+	}
+	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::OpenSharedMemory(uint accessFlag, const std::string& name) {
+		return SharedMemoryManager::OpenSharedMemory(accessFlag, name, SharedMemoryOptions{});
+	}
+	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::CreateAnonymousMemory(const std::string& name, nuint byteSize) {
+		return SharedMemoryManager::CreateAnonymousMemory(name, byteSize, SharedMemoryOptions{});
+	}
+	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::OpenAnonymousMemory(int fd, uint accessFlag) {
+		return SharedMemoryManager::OpenAnonymousMemory(fd, accessFlag, SharedMemoryOptions{});
+	}
+	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::ReceiveSharedMemory(int socket, uint accessFlag) {
+		return SharedMemoryManager::ReceiveSharedMemory(socket, accessFlag, SharedMemoryOptions{});
+	}
+	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::CreateSharedMemory(const std::string& name, nuint byteSize, const SharedMemoryOptions& options) {
+		nuint alloc_size = byteSize + SEGMENT_HEADER_SIZE;
+		bool is_file = options.page_mode == PageMode::HugeTlbFs;
+		if (options.page_mode != PageMode::Default) {
+			auto page_size = SharedMemoryManager::GetHugePageSize(options.page_mode, options.hugetlbfs_mount);
+			// transparent huge pages are only a hint, fall back to normal pages if not supported
+			if (!page_size && is_file) {
+				return create_invalid_holder();
+			}
+			alloc_size = round_up_size(alloc_size, page_size);
+		}
+		std::string path = is_file ? get_hugetlbfs_path(options.hugetlbfs_mount, name) : name;
 		auto mstmt = ResourceMonitor::GetMemoryStatus();
 		if (mstmt.Physical.avail > alloc_size) {
-			auto handle = create_shared_memory(name.c_str(), alloc_size);
+			auto handle = create_shared_memory(path.c_str(), alloc_size, is_file);
 			if (is_valid_shm_handle(handle)) {
-				auto addr = init_and_get_shm_address(handle, alloc_size);
+				auto addr = init_and_get_shm_address(handle, alloc_size, options);
 				if (addr) {
-					return create_shm_holder(handle, addr, name.c_str(), true);
+					auto holder = create_shm_holder(handle, addr, path.c_str(), true);
+					holder.m_is_file = is_file;
+					holder.m_access = SharedMemoryManager::ACCESS_READWRITE;
+					holder.m_options = options;
+					return holder;
 				}
 				close_shm_handle(handle);
+#ifndef __WINDOWS_PLATFORM__
+				// the mapping fails if huge pages are exhausted, do not leave an empty file
+				try_stop_sharing(nullptr, path.c_str(), is_file);
+#endif
 			}
 		}
 		return create_invalid_holder();
 	}
-	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::OpenSharedMemory(uint accessFlag, const std::string& name) {
-		auto handle = get_exist_shm_handle(name.c_str(), accessFlag);
-		if (is_valid_shm_handle(handle)) {
-			auto ptr = get_shm_address(handle, SharedMemoryManager::ACCESS_READONLY, sizeof(nuint));
-			if (ptr) {
-				auto alloc_size = *((nuint*)ptr);
-				unmap_address(ptr, sizeof(nuint));
-
-				if (alloc_size) {	
-					ptr = get_shm_address(handle, accessFlag, alloc_size);
-					if (ptr) {
-						return create_shm_holder(handle, ptr, name.c_str(), false);
-					}
-				}	
+	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::OpenSharedMemory(uint accessFlag, const std::string& name, const SharedMemoryOptions& options) {
+		bool is_file = options.page_mode == PageMode::HugeTlbFs;
+		std::string path = is_file ? get_hugetlbfs_path(options.hugetlbfs_mount, name) : name;
+		uint64_t deadline = SharedSyncInternal::GetDeadlineMillis(options.wait_ready_millis);
+		// the memory may not be created yet
+		auto handle = get_exist_shm_handle(path.c_str(), accessFlag, is_file);
+		while (!is_valid_shm_handle(handle)) {
+			if (SharedSyncInternal::GetRemainingMillis(deadline) == 0) {
+				return create_invalid_holder();
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			handle = get_exist_shm_handle(path.c_str(), accessFlag, is_file);
+		}
+		_segmentMapping mapping{};
+		if (!map_exist_segment(handle, accessFlag, get_open_options(options), deadline, &mapping)) {
+			close_shm_handle(handle);
+			return create_invalid_holder();
+		}
+		auto holder = create_shm_holder(handle, mapping.m_block, path.c_str(), false);
+		holder.m_is_file = is_file;
+		holder.m_access = accessFlag;
+		holder.m_options = get_open_options(options);
+		holder.m_mapped_size = mapping.m_mapped_size;
+		holder.m_size = mapping.m_segment_size - SEGMENT_HEADER_SIZE;
+		holder.m_generation = mapping.m_generation;
+		return holder;
+	}
+	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::CreateAnonymousMemory(const std::string& name, nuint byteSize, const SharedMemoryOptions& options) {
+#ifdef __WINDOWS_PLATFORM__
+		return create_invalid_holder();
+#else
+		uint flags = MFD_CLOEXEC;
+		if (options.seal_size || options.seal_future_write) {
+			flags |= MFD_ALLOW_SEALING;
+		}
+		if (options.page_mode == PageMode::HugeTlbFs) {
+			flags |= MFD_HUGETLB;
+		}
+		void* handle = (void*)memfd_create(name.c_str(), flags);
+		if (!is_valid_shm_handle(handle)) {
+			return create_invalid_holder();
+		}
+		nuint alloc_size = byteSize + SEGMENT_HEADER_SIZE;
+		if (options.page_mode == PageMode::HugeTlbFs) {
+			// st_blksize is the default huge page size used by MFD_HUGETLB
+			struct stat file_stat {};
+			if (fstat((int)handle, &file_stat) != 0) {
+				close_shm_handle(handle);
+				return create_invalid_holder();
 			}
+			alloc_size = round_up_size(alloc_size, static_cast<nuint>(file_stat.st_blksize));
+		} else if (options.page_mode == PageMode::Transparent) {
+			alloc_size = round_up_size(alloc_size, SharedMemoryManager::GetHugePageSize(PageMode::Transparent));
+		}
+		auto mstmt = ResourceMonitor::GetMemoryStatus();
+		void* addr = mstmt.Physical.avail > alloc_size ? init_and_get_shm_address(handle, alloc_size, options) : nullptr;
+		if (addr && !seal_anonymous_memory(handle, options)) {
+			unmap_address(addr, alloc_size);
+			addr = nullptr;
+		}
+		if (!addr) {
 			close_shm_handle(handle);
+			return create_invalid_holder();
+		}
+		// the holder keeps the descriptor to send it, the memory is freed with its last descriptor and mapping
+		auto holder = SharedMemoryHolder{ NO_SHM_HANDLE, addr, name, false };
+		holder.m_handle = handle;
+		holder.m_is_anonymous = true;
+		holder.m_access = SharedMemoryManager::ACCESS_READWRITE;
+		holder.m_options = options;
+		return holder;
+#endif
+	}
+	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::OpenAnonymousMemory(int fd, uint accessFlag, const SharedMemoryOptions& options) {
+		void* handle = (void*)fd;
+		if (!is_valid_shm_handle(handle)) {
+			return create_invalid_holder();
 		}
+#ifdef __WINDOWS_PLATFORM__
+		return create_invalid_holder();
+#else
+		_segmentMapping mapping{};
+		if (!map_exist_segment(handle, accessFlag, get_open_options(options), SharedSyncInternal::GetDeadlineMillis(options.wait_ready_millis), &mapping)) {
+			close_shm_handle(handle);
+			return create_invalid_holder();
+		}
+		auto holder = SharedMemoryHolder{ NO_SHM_HANDLE, mapping.m_block, "", false };
+		holder.m_handle = handle;
+		holder.m_is_anonymous = true;
+		holder.m_access = accessFlag;
+		holder.m_options = get_open_options(options);
+		holder.m_mapped_size = mapping.m_mapped_size;
+		holder.m_size = mapping.m_segment_size - SEGMENT_HEADER_SIZE;
+		holder.m_generation = mapping.m_generation;
+		return holder;
+#endif
+	}
+	bool SharedMemoryManager::SendSharedMemory(int socket, const SharedMemoryHolder& holder) {
+		if (!holder.m_block || !holder.m_is_anonymous) { return false; }
+#ifdef __WINDOWS_PLATFORM__
+		return false;
+#else
+		// one byte of data carries the descriptor, a message without data is not delivered on a stream socket
+		char payload = 'M';
+		iovec io{ &payload, sizeof(payload) };
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+		msghdr message{};
+		message.msg_iov = &io;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		cmsghdr* pControl = CMSG_FIRSTHDR(&message);
+		pControl->cmsg_level = SOL_SOCKET;
+		pControl->cmsg_type = SCM_RIGHTS;
+		pControl->cmsg_len = CMSG_LEN(sizeof(int));
+		int fd = (int)holder.m_handle;
+		memcpy(CMSG_DATA(pControl), &fd, sizeof(int));
+		ssize_t sent{};
+		do {
+			sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+		} while (sent < 0 && errno == EINTR);
+		return sent == sizeof(payload);
+#endif
+	}
+	SharedMemoryManager::SharedMemoryHolder SharedMemoryManager::ReceiveSharedMemory(int socket, uint accessFlag, const SharedMemoryOptions& options) {
+#ifdef __WINDOWS_PLATFORM__
 		return create_invalid_holder();
+#else
+		char payload{};
+		iovec io{ &payload, sizeof(payload) };
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))]{};
+		msghdr message{};
+		message.msg_iov = &io;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		ssize_t received{};
+		do {
+			received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+		} while (received < 0 && errno == EINTR);
+		if (received != sizeof(payload)) {
+			return create_invalid_holder();
+		}
+		int fd = -1;
+		for (cmsghdr* pControl = CMSG_FIRSTHDR(&message); pControl; pControl = CMSG_NXTHDR(&message, pControl)) {
+			if (pControl->cmsg_level == SOL_SOCKET && pControl->cmsg_type == SCM_RIGHTS && pControl->cmsg_len == CMSG_LEN(sizeof(int))) {
+				memcpy(&fd, CMSG_DATA(pControl), sizeof(int));
+			}
+		}
+		// a truncated control message has closed the descriptors that did not fit
+		if (fd < 0 || (message.msg_flags & MSG_CTRUNC)) {
+			if (fd >= 0) { close(fd); }
+			return create_invalid_holder();
+		}
+		return SharedMemoryManager::OpenAnonymousMemory(fd, accessFlag, options);
+#endif
+	}
+#ifndef __WINDOWS_PLATFORM__
+	// Ids of the processes of this host from the live /proc, even if ProcfsRoot is set to a recording
+	static std::vector<uint> get_live_process_ids() {
+		std::vector<uint> result;
+		// operator++ throws on a failed readdir, increment reports it instead
+		std::error_code error;
+		std::filesystem::directory_iterator it("/proc", error);
+		for (; !error && it != std::filesystem::directory_iterator(); it.increment(error)) {
+			std::string name = it->path().filename().string();
+			if (!name.empty() && std::all_of(name.begin(), name.end(), ::isdigit)) {
+				result.push_back(static_cast<uint>(std::stoul(name)));
+			}
+		}
+		return result;
+	}
+#endif
+	std::vector<SharedMemoryManager::SharedMemoryInfo> SharedMemoryManager::GetSharedMemoryList(const std::string& directory) {
+		std::vector<SharedMemoryInfo> result;
+#ifndef __WINDOWS_PLATFORM__
+		if (directory.empty()) { return result; }
+		std::error_code error;
+		std::filesystem::directory_iterator it(directory, error);
+		nuint page_size = static_cast<nuint>(sysconf(_SC_PAGESIZE));
+		std::vector<unsigned char> residency;
+		for (; !error && it != std::filesystem::directory_iterator(); it.increment(error)) {
+			const auto& entry = *it;
+			// a memory removed meanwhile is skipped without ending the listing
+			std::error_code entry_error;
+			if (!entry.is_regular_file(entry_error)) { continue; }
+			int fd = open(entry.path().c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0) { continue; }
+			struct stat file_stat {};
+			void* ptr = MAP_FAILED;
+			if (fstat(fd, &file_stat) == 0 && file_stat.st_size >= static_cast<off_t>(SEGMENT_HEADER_SIZE)) {
+				// a hugetlbfs file can only be mapped as a whole, mapping does not fault in any page
+				ptr = mmap(nullptr, static_cast<nuint>(file_stat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+			}
+			close(fd);
+			if (ptr == MAP_FAILED) { continue; }
+			nuint mapped_size = static_cast<nuint>(file_stat.st_size);
+			if (is_valid_segment(ptr)) {
+				auto header = get_segment_header(ptr);
+				SharedMemoryInfo info{};
+				// appended instead of "/" + filename, which gcc flags with -Wrestrict
+				info.name = "/";
+				info.name += entry.path().filename().string();
+				info.size = static_cast<nuint>(header->m_size.load(std::memory_order_relaxed));
+				info.creator_pid = static_cast<uint>(header->m_creator_pid);
+				info.creator_alive = SharedSyncInternal::IsProcessAlive(info.creator_pid);
+				info.is_ready = header->m_ready.load(std::memory_order_acquire) != 0;
+				residency.resize((mapped_size + page_size - 1) / page_size);
+				if (mincore(ptr, mapped_size, residency.data()) == 0) {
+					for (auto page : residency) {
+						if (page & 1) { info.resident_size += page_size; }
+					}
+				}
+				result.push_back(std::move(info));
+			}
+			munmap(ptr, mapped_size);
+		}
+		if (result.empty()) { return result; }
+		// a mapping is listed in /proc/<pid>/maps by its path, with " (deleted)" after it if unlinked
+		std::string prefix = directory.back() == '/' ? directory : directory + "/";
+		std::string content;
+		std::vector<std::string_view> mapped_names;
+		for (auto pid : get_live_process_ids()) {
+			if (!UnixInfoParser::read_file(("/proc/" + std::to_string(pid) + "/maps").c_str(), &content)) { continue; }
+			mapped_names.clear();
+			nuint position = 0;
+			while ((position = content.find(prefix, position)) != std::string::npos) {
+				nuint end = content.find('\n', position);
+				if (end == std::string::npos) { end = content.size(); }
+				std::string_view path(content.data() + position, end - position);
+				position = end;
+				if (path.ends_with(" (deleted)")) { continue; }
+				// a process usually maps a memory once, count it once anyway
+				auto name = path.substr(prefix.size() - 1);
+				if (std::find(mapped_names.begin(), mapped_names.end(), name) != mapped_names.end()) { continue; }
+				mapped_names.push_back(name);
+				for (auto& info : result) {
+					if (info.name == name) {
+						++info.attached_processes;
+						break;
+					}
+				}
+			}
+		}
+#endif
+		return result;
+	}
+	std::vector<std::string> SharedMemoryManager::RemoveOrphanedSharedMemory(const std::string& directory) {
+		std::vector<std::string> result;
+#ifndef __WINDOWS_PLATFORM__
+		if (directory.empty()) { return result; }
+		std::string prefix = directory.back() == '/' ? directory.substr(0, directory.size() - 1) : directory;
+		for (auto& info : SharedMemoryManager::GetSharedMemoryList(directory)) {
+			if (info.creator_alive || info.attached_processes) { continue; }
+			if (unlink((prefix + info.name).c_str()) == 0) {
+				result.push_back(std::move(info.name));
+			}
+		}
+#endif
+		return result;
+	}
+	uint SharedMemoryManager::GetNumaNodeCount() {
+#ifdef __WINDOWS_PLATFORM__
+		ULONG highest_node{};
+		if (!GetNumaHighestNodeNumber(&highest_node)) { return 1; }
+		return static_cast<uint>(highest_node) + 1;
+#else
+		// a list of ranges like "0-1,3", the nodes are counted up to the highest one
+		std::string content;
+		if (!UnixInfoParser::read_file("/sys/devices/system/node/online", &content)) { return 1; }
+		uint highest_node{};
+		const char* pText = content.c_str();
+		while (*pText) {
+			char* pEnd{};
+			auto node = strtoul(pText, &pEnd, 10);
+			if (pEnd == pText) {
+				++pText;
+				continue;
+			}
+			highest_node = std::max(highest_node, static_cast<uint>(node));
+			pText = pEnd;
+		}
+		return highest_node + 1;
+#endif
+	}
+	std::vector<nuint> SharedMemoryManager::GetNumaDistribution(const SharedMemoryHolder& holder) {
+		std::vector<nuint> result;
+		if (!holder.m_block) { return result; }
+#ifndef __WINDOWS_PLATFORM__
+		constexpr nuint BATCH_PAGES = 1024;
+		nuint page_size = static_cast<nuint>(sysconf(_SC_PAGESIZE));
+		nuint page_count = (holder.m_mapped_size + page_size - 1) / page_size;
+		result.resize(SharedMemoryManager::GetNumaNodeCount());
+		unsigned char residency[BATCH_PAGES];
+		void* pages[BATCH_PAGES];
+		int status[BATCH_PAGES];
+		for (nuint first = 0; first < page_count; first += BATCH_PAGES) {
+			nuint count = std::min(BATCH_PAGES, page_count - first);
+			unsigned char* pBatch = (unsigned char*)holder.m_block + first * page_size;
+			// pages of the memory may be resident without being mapped in this process
+			if (mincore(pBatch, count * page_size, residency) != 0) { return {}; }
+			nuint resident_count{};
+			for (nuint i = 0; i < count; ++i) {
+				if (!(residency[i] & 1)) { continue; }
+				pages[resident_count] = pBatch + i * page_size;
+				// reading a resident page maps it without allocating, so move_pages can find it
+				(void)*(volatile unsigned char*)pages[resident_count];
+				++resident_count;
+			}
+			if (!resident_count) { continue; }
+			// without target nodes move_pages only reports the node of each page
+			if (syscall(SYS_move_pages, 0, resident_count, pages, nullptr, status, 0) != 0) {
+				if (errno != ENOSYS) { return {}; }
+				// a kernel without numa support has every page on node 0
+				std::fill_n(status, resident_count, 0);
+			}
+			for (nuint i = 0; i < resident_count; ++i) {
+				if (status[i] < 0) { continue; }
+				if (static_cast<nuint>(status[i]) >= result.size()) {
+					result.resize(static_cast<nuint>(status[i]) + 1);
+				}
+				result[status[i]] += page_size;
+			}
+		}
+#endif
+		return result;
+	}
+	nuint SharedMemoryManager::GetHugePageSize(PageMode mode, const std::string& hugetlbfs_mount) {
+#ifdef __WINDOWS_PLATFORM__
+		// large pages of windows require SeLockMemoryPrivilege and are not supported
+		return 0;
+#else
+		switch (mode) {
+		case PageMode::Transparent: {
+			// shm_open creates files in the tmpfs at /dev/shm, its huge= mount option decides whether huge pages are used
+			std::string content;
+			if (!UnixInfoParser::read_file("/proc/self/mounts", &content)) { return 0; }
+			// the last mount on /dev/shm hides the earlier ones
+			auto pos = content.rfind(" /dev/shm tmpfs ");
+			if (pos == std::string::npos) { return 0; }
+			std::string_view mount_options(content.data() + pos, content.find('\n', pos) - pos);
+			if (mount_options.find("huge=always") == std::string_view::npos &&
+				mount_options.find("huge=within_size") == std::string_view::npos &&
+				mount_options.find("huge=advise") == std::string_view::npos) {
+				return 0;
+			}
+			if (!UnixInfoParser::read_file("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", &content)) { return 0; }
+			return static_cast<nuint>(strtoull(content.c_str(), nullptr, 10));
+		}
+		case PageMode::HugeTlbFs: {
+			struct statfs fs_stat {};
+			if (statfs(hugetlbfs_mount.c_str(), &fs_stat) != 0 || fs_stat.f_type != HUGETLBFS_MAGIC) { return 0; }
+			return static_cast<nuint>(fs_stat.f_bsize);
+		}
+		default:
+			return 0;
+		}
+#endif
 	}
 };
@@ -1,5 +1,6 @@
 #pragma once
 #include "os_.hpp"
+#include "mem_copy.hpp"
 namespace cyh::os {
 
 	class SharedMemoryManager {
@@ -10,22 +11,124 @@ namespace cyh::os {
 		static void _MoveHolder(SharedMemoryHolder* pdst, SharedMemoryHolder* psrc);
 	public:
 
+		// Page backing of a shared memory
+		enum class PageMode : uint {
+			// Normal pages of the host os
+			Default,
+			// Ask for transparent huge pages with madvise(MADV_HUGEPAGE), requires /dev/shm mounted with huge=advise (or always, within_size)
+			Transparent,
+			// Back the memory with a file in a mounted hugetlbfs, requires reserved huge pages (vm.nr_hugepages)
+			HugeTlbFs
+		};
+		// Placement of the pages of a shared memory on NUMA nodes
+		enum class NumaPolicy : uint {
+			// On the node of the thread touching a page first
+			Default,
+			// Only on the nodes in numa_nodes
+			Bind,
+			// Spread page by page over the nodes in numa_nodes
+			Interleave,
+			// On the first node in numa_nodes, other nodes are used if it is full
+			Preferred
+		};
+		// Options used when creating or opening a shared memory
+		struct SharedMemoryOptions {
+			// Except PageMode::Default, the size of memory is rounded up to the huge page size
+			PageMode page_mode{ PageMode::Default };
+			// Fault in all pages while mapping so the first touch does not pay for page faults
+			bool prefault{};
+			// Hint the kernel that the pages will be accessed soon with madvise(MADV_WILLNEED)
+			bool will_need{};
+			// Mount point of hugetlbfs, only used by PageMode::HugeTlbFs
+			std::string hugetlbfs_mount{ "/dev/hugepages" };
+			// Creating only, the creator calls MarkReady after initializing the content, otherwise the memory is ready at once
+			bool defer_ready{};
+			// Opening only, wait up to this long for the creator to create the memory and make it ready, 0 fails at once
+			uint wait_ready_millis{};
+			// Creating only, set with mbind before the pages are faulted in, ignored on a single node host or if not supported
+			NumaPolicy numa_policy{ NumaPolicy::Default };
+			// Bit n selects node n
+			uint64_t numa_nodes{};
+			// Anonymous memory only, forbid changing the size after creating, then Grow fails
+			bool seal_size{};
+			// Anonymous memory only, forbid new writable mappings, so receivers can only map it read only
+			bool seal_future_write{};
+		};
+
+		// A shared memory created by this library, found by GetSharedMemoryList
+		struct SharedMemoryInfo {
+			// The name to open it
+			std::string name;
+			// Bytes of the memory including the segment header
+			nuint size;
+			// Bytes of the memory resident in physical memory
+			nuint resident_size;
+			uint creator_pid;
+			bool creator_alive;
+			bool is_ready;
+			// Count of processes mapping it now, processes whose maps can not be read are not counted
+			uint attached_processes;
+		};
+
 		// An object automatically managed the lifetime of shared memory
 		class SharedMemoryHolder final {
 			friend class SharedMemoryManager;
+#ifdef __WINDOWS_PLATFORM__
 			void* m_handle{};
+#else
+			// -1 if none, descriptor 0 is valid
+			void* m_handle{ (void*)intptr_t(-1) };
+#endif
 			void* m_block{};
 			nuint m_size{};
+			// bytes mapped from m_block, including the segment header
+			nuint m_mapped_size{};
+			// generation of the segment when m_size was read
+			uint64_t m_generation{};
+			// access flag of the mapping, used to map it again after growing
+			uint m_access{};
+			// options of the mapping, the huge page hint and the numa policy are set again after growing
+			SharedMemoryOptions m_options{};
+			// The memory is a file in hugetlbfs and fname is its path
+			bool m_is_file{};
+			// The memory is a memfd without name, m_handle is its descriptor in every holder
+			bool m_is_anonymous{};
 			std::string fname{};
 		public:
-			// The address mapped to the shared memory
+			// The address of the memory, it follows the segment header and is aligned to 64 bytes
 			void* data() const;
 			// The capacity of memory in bytes
 			nuint capacity() const;
+			// Mark the content initialized, and wake the processes waiting in OpenSharedMemory
+			void MarkReady();
+			bool is_ready() const;
+			// The process id of the creator
+			uint creator_pid() const;
+			// Grow the memory to at least byteSize bytes without moving its content, only the creator can grow it
+			// data() may change, so pointers into the memory must be taken again, offsets from data() stay valid
+			// Other holders keep their mapping until Refresh, the memory never shrinks
+			bool Grow(nuint byteSize);
+			// Remap the memory if it has grown since mapped, call it where no pointer into the memory is held
+			// Return false if the remapping failed, then the old mapping is still usable
+			bool Refresh();
+			// Indicate whether the memory has grown since mapped, cheap enough to poll
+			bool is_stale() const;
+			uint64_t generation() const;
+			// The descriptor of an anonymous memory, -1 for a named one
+			int native_handle() const;
+			// Copy size bytes from src into the memory at offset, large copies bypass the caches ( see MemoryCopy )
+			// Return false if the range is out of the memory or the memory is mapped read only
+			bool copy_in(nuint offset, const void* src, nuint size);
+			bool copy_in(nuint offset, const void* src, nuint size, const MemoryCopy::CopyOptions& options);
+			// Copy size bytes from the memory at offset into dst, return false if the range is out of the memory
+			bool copy_out(nuint offset, void* dst, nuint size) const;
+			bool copy_out(nuint offset, void* dst, nuint size, const MemoryCopy::CopyOptions& options) const;
 
 			template<class T>
 			T* get() const { return (T*)(this->data()); }
 
+			// An empty holder without shared memory
+			SharedMemoryHolder() = default;
 			SharedMemoryHolder(void* handle, void* block, const std::string& name, bool is_owner);
 			SharedMemoryHolder(const SharedMemoryHolder&) = delete;
 			SharedMemoryHolder& operator=(const SharedMemoryHolder&) = delete;
@@ -37,5 +140,35 @@ namespace cyh::os {
 		static uint ACCESS_READWRITE;		
 		static SharedMemoryHolder CreateSharedMemory(const std::string& name, nuint byteSize);
 		static SharedMemoryHolder OpenSharedMemory(uint accessFlag, const std::string& name);
+		// The capacity of created memory is at least byteSize, it is larger if the size is rounded up for huge pages
+		static SharedMemoryHolder CreateSharedMemory(const std::string& name, nuint byteSize, const SharedMemoryOptions& options);
+		// The page_mode and hugetlbfs_mount of options must match the ones used to create the memory
+		static SharedMemoryHolder OpenSharedMemory(uint accessFlag, const std::string& name, const SharedMemoryOptions& options);
+		// Create a memory without a name in the file system, which can not leak if the process crashes
+		// It is shared by SendSharedMemory, name is only shown in /proc/<pid>/fd, not supported on windows
+		static SharedMemoryHolder CreateAnonymousMemory(const std::string& name, nuint byteSize);
+		static SharedMemoryHolder CreateAnonymousMemory(const std::string& name, nuint byteSize, const SharedMemoryOptions& options);
+		// Map an anonymous memory from its descriptor, the holder takes the ownership of fd
+		static SharedMemoryHolder OpenAnonymousMemory(int fd, uint accessFlag);
+		static SharedMemoryHolder OpenAnonymousMemory(int fd, uint accessFlag, const SharedMemoryOptions& options);
+		// Send an anonymous memory to the process at the other end of a connected AF_UNIX socket, return false if failed
+		static bool SendSharedMemory(int socket, const SharedMemoryHolder& holder);
+		// Receive a memory sent by SendSharedMemory and map it, the holder is invalid if failed
+		static SharedMemoryHolder ReceiveSharedMemory(int socket, uint accessFlag);
+		static SharedMemoryHolder ReceiveSharedMemory(int socket, uint accessFlag, const SharedMemoryOptions& options);
+		// List the shared memories created by this library in directory, which is /dev/shm or a hugetlbfs mount
+		// Other files in the directory are skipped, empty on windows
+		static std::vector<SharedMemoryInfo> GetSharedMemoryList(const std::string& directory = "/dev/shm");
+		// Remove the shared memories whose creator is gone and which no process maps, return their names
+		// A process which opened it but does not map it yet can not be detected
+		static std::vector<std::string> RemoveOrphanedSharedMemory(const std::string& directory = "/dev/shm");
+		// Count of NUMA nodes of the host, 1 if it is not a NUMA host
+		static uint GetNumaNodeCount();
+		// Bytes of the memory resident on each node, indexed by node, pages not faulted in yet are not counted
+		// The resident pages are mapped into this process while counting them
+		// Empty if the query failed or is not supported
+		static std::vector<nuint> GetNumaDistribution(const SharedMemoryHolder& holder);
+		// Get the huge page size used by the mode, 0 if the mode is not supported on current host
+		static nuint GetHugePageSize(PageMode mode, const std::string& hugetlbfs_mount = "/dev/hugepages");
 	};
 };
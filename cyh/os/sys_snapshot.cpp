@@ -0,0 +1,254 @@
+#include "sys_snapshot.hpp"
+#include "os_internal.hpp"
+#include "proc_sampler.hpp"
+#include "res_mon.hpp"
+#include "shm_sync.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+namespace cyh::os {
+	static constexpr uint32_t SNAPSHOT_MAGIC = 0x50414E53; // "SNAP"
+	static constexpr uint32_t SNAPSHOT_VERSION = 1;
+	static constexpr nuint SNAPSHOT_ALIGNMENT = 64;
+
+	struct _snapshotHeader {
+		std::atomic<uint32_t> m_magic;
+		uint32_t m_version;
+		uint64_t m_snapshot_size;
+		// seqlock sequence, odd while the publisher writes, 0 before the first publish
+		alignas(SNAPSHOT_ALIGNMENT) std::atomic<uint64_t> m_sequence;
+		alignas(SNAPSHOT_ALIGNMENT) SystemSnapshot m_snapshot;
+	};
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "snapshot publishing requires lock free 64 bit atomics");
+
+	struct SnapshotPublisher::_samplerState {
+		ProcessSampler m_sampler;
+		ProcessTable m_table;
+		std::vector<nuint> m_order;
+		SystemSnapshot m_staging{};
+		uint64_t m_sample_no{};
+#ifndef __WINDOWS_PLATFORM__
+		_unixCpuSnapshot m_cpus[2];
+		nuint m_cpu_index{};
+		bool m_has_cpus{};
+		std::vector<_unixDiskInfo> m_disks;
+		std::vector<double> m_usages;
+		std::vector<double> m_state_usages;
+#endif
+	};
+
+	static nuint align_snapshot_size(nuint size, nuint alignment) {
+		return (size + alignment - 1) & ~(alignment - 1);
+	}
+	static _snapshotHeader* get_snapshot_header(void* data) {
+		auto address = reinterpret_cast<uintptr_t>(data);
+		return reinterpret_cast<_snapshotHeader*>(align_snapshot_size(address, SNAPSHOT_ALIGNMENT));
+	}
+	static uint64_t get_steady_nanos() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+	static void copy_snapshot_name(char* pDst, std::string_view name) {
+		nuint length = std::min(name.size(), SystemSnapshot::NAME_SIZE - 1);
+		memcpy(pDst, name.data(), length);
+		pDst[length] = '\0';
+	}
+
+	SnapshotPublisher::SnapshotPublisher() {}
+	SnapshotPublisher::~SnapshotPublisher() {
+		this->Stop();
+	}
+	bool SnapshotPublisher::Create(const std::string& name) {
+		if (this->m_header) { return false; }
+		SharedMemoryManager::SharedMemoryOptions options{};
+		options.defer_ready = true;
+		auto holder = SharedMemoryManager::CreateSharedMemory(name, sizeof(_snapshotHeader) + SNAPSHOT_ALIGNMENT, options);
+		if (!holder.data()) { return false; }
+		auto header = new (get_snapshot_header(holder.data())) _snapshotHeader{};
+		header->m_version = SNAPSHOT_VERSION;
+		header->m_snapshot_size = sizeof(SystemSnapshot);
+		header->m_magic.store(SNAPSHOT_MAGIC, std::memory_order_release);
+		holder.MarkReady();
+		this->m_holder = std::move(holder);
+		this->m_header = header;
+		this->m_state = std::make_unique<_samplerState>();
+		return true;
+	}
+	bool SnapshotPublisher::is_valid() const {
+		return this->m_header != nullptr;
+	}
+	void SnapshotPublisher::sample(SystemSnapshot* pSnapshot) {
+		auto& state = *this->m_state;
+		pSnapshot->sample_no = state.m_sample_no++;
+		pSnapshot->timestamp = get_steady_nanos();
+
+		// processors
+		nuint cpu_count{};
+#ifdef __WINDOWS_PLATFORM__
+		auto usages = ResourceMonitor::GetAllProcessorUsage();
+		cpu_count = std::min(usages.size(), SystemSnapshot::MAX_PROCESSORS);
+		std::copy_n(usages.data(), cpu_count, pSnapshot->processor_usages);
+		memset(pSnapshot->state_usages, 0, sizeof(pSnapshot->state_usages));
+#else
+		auto& previous = state.m_cpus[state.m_cpu_index];
+		auto& current = state.m_cpus[state.m_cpu_index ^ 1];
+		if (UnixInfoParser::read_cpus_snapshot(&current)) {
+			if (state.m_has_cpus) {
+				// the host may have more processors than the snapshot holds
+				state.m_usages.resize(current.size());
+				state.m_state_usages.resize(current.size() * SystemSnapshot::STATE_COUNT);
+				nuint count = UnixInfoParser::calculate_cpus_usage(&previous, &current, state.m_usages.data(), state.m_state_usages.data(), current.size());
+				cpu_count = std::min(count, SystemSnapshot::MAX_PROCESSORS);
+				std::copy_n(state.m_usages.data(), cpu_count, pSnapshot->processor_usages);
+				for (nuint s = 0; s < SystemSnapshot::STATE_COUNT; ++s) {
+					std::copy_n(state.m_state_usages.data() + s * count, cpu_count, pSnapshot->state_usages[s]);
+				}
+			}
+			state.m_cpu_index ^= 1;
+			state.m_has_cpus = true;
+		}
+#endif
+		pSnapshot->processor_count = static_cast<uint>(cpu_count);
+		double usage_sum = 0.0;
+		for (nuint i = 0; i < cpu_count; ++i) {
+			usage_sum += pSnapshot->processor_usages[i];
+		}
+		pSnapshot->processor_usage = cpu_count ? usage_sum / cpu_count : 0.0;
+
+		// memory
+		pSnapshot->memory = ResourceMonitor::GetMemoryStatus();
+
+		// disks
+		nuint disk_count{};
+#ifdef __WINDOWS_PLATFORM__
+		auto disks = ResourceMonitor::GetAllLogicDiskInfo();
+		disk_count = std::min(disks.size(), SystemSnapshot::MAX_DISKS);
+		for (nuint i = 0; i < disk_count; ++i) {
+			copy_snapshot_name(pSnapshot->disks[i].name, disks[i].mount_or_label);
+			pSnapshot->disks[i].io_time_percentage = disks[i].io_time_percentage;
+		}
+#else
+		auto disks = UnixInfoParser::read_disks_info();
+		if (disks.size() == state.m_disks.size()) {
+			disk_count = std::min(disks.size(), SystemSnapshot::MAX_DISKS);
+			for (nuint i = 0; i < disk_count; ++i) {
+				copy_snapshot_name(pSnapshot->disks[i].name, disks[i].device);
+				pSnapshot->disks[i].io_time_percentage = UnixInfoParser::calculate_disk_usage(&state.m_disks[i], &disks[i]);
+			}
+		}
+		state.m_disks = std::move(disks);
+#endif
+		pSnapshot->disk_count = static_cast<uint>(disk_count);
+
+		// processes sorted by cpu percentage
+		state.m_sampler.Sample(&state.m_table);
+		nuint process_count = state.m_table.size();
+		nuint top_count = std::min(process_count, SystemSnapshot::MAX_TOP_PROCESSES);
+		state.m_order.resize(process_count);
+		for (nuint i = 0; i < process_count; ++i) {
+			state.m_order[i] = i;
+		}
+		const double* pCpu = state.m_table.cpu_time_percentages();
+		std::partial_sort(state.m_order.begin(), state.m_order.begin() + top_count, state.m_order.end(), [pCpu](nuint lhs, nuint rhs) {
+			return pCpu[lhs] > pCpu[rhs];
+		});
+		for (nuint i = 0; i < top_count; ++i) {
+			auto view = state.m_table[state.m_order[i]];
+			auto& process = pSnapshot->top_processes[i];
+			process.pid = view.pid();
+			copy_snapshot_name(process.name, view.name());
+			process.memory = view.memory();
+			process.cpu_time_percentage = view.cpu_time_percentage();
+		}
+		pSnapshot->process_count = static_cast<uint>(process_count);
+		pSnapshot->top_process_count = static_cast<uint>(top_count);
+	}
+	void SnapshotPublisher::publish(const SystemSnapshot* pSnapshot) {
+		// only this publisher writes the sequence
+		uint64_t sequence = this->m_header->m_sequence.load(std::memory_order_relaxed);
+		this->m_header->m_sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(&this->m_header->m_snapshot, pSnapshot, sizeof(SystemSnapshot));
+		this->m_header->m_sequence.store(sequence + 2, std::memory_order_release);
+	}
+	bool SnapshotPublisher::PublishOnce() {
+		if (!this->m_header) { return false; }
+		// sample into the staging copy, the seqlock is only held for the copy
+		this->sample(&this->m_state->m_staging);
+		this->publish(&this->m_state->m_staging);
+		return true;
+	}
+	void SnapshotPublisher::run(uint interval_millis) {
+		std::unique_lock<std::mutex> lock(this->m_mutex);
+		while (!this->m_stopping) {
+			lock.unlock();
+			this->PublishOnce();
+			lock.lock();
+			this->m_stop_signal.wait_for(lock, std::chrono::milliseconds(interval_millis), [this]() { return this->m_stopping; });
+		}
+	}
+	bool SnapshotPublisher::Start(uint interval_millis) {
+		if (!this->m_header || this->m_thread.joinable()) { return false; }
+		this->m_stopping = false;
+		this->m_thread = std::thread(&SnapshotPublisher::run, this, interval_millis);
+		return true;
+	}
+	void SnapshotPublisher::Stop() {
+		if (!this->m_thread.joinable()) { return; }
+		{
+			std::lock_guard<std::mutex> lock(this->m_mutex);
+			this->m_stopping = true;
+		}
+		this->m_stop_signal.notify_all();
+		this->m_thread.join();
+	}
+
+	SnapshotReader::SnapshotReader(SharedMemoryManager::SharedMemoryHolder&& holder) : m_holder(std::move(holder)) {
+		if (!this->m_holder.data()) { return; }
+		if (this->m_holder.capacity() < sizeof(_snapshotHeader) + SNAPSHOT_ALIGNMENT) { return; }
+		auto header = get_snapshot_header(this->m_holder.data());
+		if (header->m_magic.load(std::memory_order_acquire) != SNAPSHOT_MAGIC || header->m_version != SNAPSHOT_VERSION) { return; }
+		if (header->m_snapshot_size != sizeof(SystemSnapshot)) { return; }
+		this->m_header = header;
+	}
+	SnapshotReader::SnapshotReader(SnapshotReader&& other) noexcept {
+		*this = std::move(other);
+	}
+	SnapshotReader& SnapshotReader::operator=(SnapshotReader&& other) noexcept {
+		if (this == &other) { return *this; }
+		this->m_holder = std::move(other.m_holder);
+		this->m_header = other.m_header;
+		other.m_header = nullptr;
+		return *this;
+	}
+	SnapshotReader SnapshotReader::Open(const std::string& name, uint wait_millis) {
+		SharedMemoryManager::SharedMemoryOptions options{};
+		options.wait_ready_millis = wait_millis;
+		return SnapshotReader(SharedMemoryManager::OpenSharedMemory(SharedMemoryManager::ACCESS_READONLY, name, options));
+	}
+	bool SnapshotReader::is_valid() const {
+		return this->m_header != nullptr;
+	}
+	bool SnapshotReader::begin_read(uint64_t* pSequence) const {
+		if (!this->m_header) { return false; }
+		// the sequence stays odd if the publisher died while publishing
+		if (!SharedSyncInternal::ReadSeqlockVersion(&this->m_header->m_sequence, pSequence)) { return false; }
+		return *pSequence != 0;
+	}
+	bool SnapshotReader::end_read(uint64_t sequence) const {
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return this->m_header->m_sequence.load(std::memory_order_relaxed) == sequence;
+	}
+	const SystemSnapshot* SnapshotReader::get_snapshot() const {
+		return &this->m_header->m_snapshot;
+	}
+	uint64_t SnapshotReader::sample_no() const {
+		if (!this->m_header) { return 0; }
+		return this->m_header->m_sequence.load(std::memory_order_acquire) / 2;
+	}
+	bool SnapshotReader::TryRead(SystemSnapshot* pSnapshot) const {
+		if (!pSnapshot) { return false; }
+		return this->Read([pSnapshot](const SystemSnapshot& snapshot) {
+			memcpy(pSnapshot, &snapshot, sizeof(SystemSnapshot));
+		});
+	}
+};
@@ -0,0 +1,126 @@
+#pragma once
+#include "shmem_mgr.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+namespace cyh::os {
+	// Fixed layout of the system state published in a shared memory, it contains no pointer
+	struct SystemSnapshot {
+		static constexpr nuint MAX_PROCESSORS = 256;
+		static constexpr nuint MAX_DISKS = 32;
+		static constexpr nuint MAX_TOP_PROCESSES = 64;
+		static constexpr nuint NAME_SIZE = 32;
+		static constexpr nuint STATE_COUNT = static_cast<nuint>(CpuState::Count);
+
+		struct DiskState {
+			// Truncated and terminated by '\0'
+			char name[NAME_SIZE];
+			double io_time_percentage;
+		};
+		struct ProcessState {
+			uint pid;
+			char name[NAME_SIZE];
+			nuint memory;
+			double cpu_time_percentage;
+		};
+
+		// Index of the sample, the usages of the first sample are not available
+		uint64_t sample_no;
+		// Nanoseconds of steady clock when the sample was taken
+		uint64_t timestamp;
+		// The counts below may be smaller than the host's if the arrays are full
+		uint processor_count;
+		uint disk_count;
+		uint top_process_count;
+		// Count of all processes on the host
+		uint process_count;
+		// Average usage of processors
+		double processor_usage;
+		double processor_usages[MAX_PROCESSORS];
+		// usage of state s of processor i is at [s][i]
+		double state_usages[STATE_COUNT][MAX_PROCESSORS];
+		MemoryStatus memory;
+		DiskState disks[MAX_DISKS];
+		// Sorted by cpu_time_percentage in descending order
+		ProcessState top_processes[MAX_TOP_PROCESSES];
+	};
+	static_assert(std::is_trivially_copyable_v<SystemSnapshot>, "SystemSnapshot is copied as bytes");
+
+	// Layout of the shared memory shared by the publisher and readers
+	struct _snapshotHeader;
+
+	// Samples the system with ResourceMonitor and ProcessSampler, then publishes a SystemSnapshot
+	// into a named shared memory under a seqlock, so readers in other processes never block the publisher
+	class SnapshotPublisher {
+		struct _samplerState;
+		SharedMemoryManager::SharedMemoryHolder m_holder;
+		_snapshotHeader* m_header{};
+		std::unique_ptr<_samplerState> m_state;
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_stop_signal;
+		bool m_stopping{};
+
+		// Fill the snapshot outside of the seqlock
+		void sample(SystemSnapshot* pSnapshot);
+		void publish(const SystemSnapshot* pSnapshot);
+		void run(uint interval_millis);
+	public:
+		SnapshotPublisher();
+		SnapshotPublisher(const SnapshotPublisher&) = delete;
+		SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+		~SnapshotPublisher();
+
+		// Create the shared memory, return false if failed
+		bool Create(const std::string& name);
+		bool is_valid() const;
+		// Sample and publish once on the calling thread, usages are computed against the previous call
+		bool PublishOnce();
+		// Publish every interval_millis on a background thread until Stop
+		bool Start(uint interval_millis = 1000u);
+		void Stop();
+	};
+
+	// Reads the snapshots of a SnapshotPublisher from a read only mapping, without system calls
+	class SnapshotReader {
+		SharedMemoryManager::SharedMemoryHolder m_holder;
+		const _snapshotHeader* m_header{};
+
+		SnapshotReader(SharedMemoryManager::SharedMemoryHolder&& holder);
+		// Begin a read, return false if nothing is published yet or the publisher died while publishing
+		bool begin_read(uint64_t* pSequence) const;
+		// Return true if no publish happened since begin_read
+		bool end_read(uint64_t sequence) const;
+		const SystemSnapshot* get_snapshot() const;
+	public:
+		// Wait up to wait_millis for the publisher to create it
+		static SnapshotReader Open(const std::string& name, uint wait_millis = 0);
+
+		SnapshotReader() = default;
+		SnapshotReader(const SnapshotReader&) = delete;
+		SnapshotReader& operator=(const SnapshotReader&) = delete;
+		SnapshotReader(SnapshotReader&& other) noexcept;
+		SnapshotReader& operator=(SnapshotReader&& other) noexcept;
+
+		bool is_valid() const;
+		// Count of samples published, cheap to poll for a new one
+		uint64_t sample_no() const;
+		// Copy the latest snapshot, return false if nothing is published yet
+		// or the publisher died while publishing ( waits SharedSync::SEQLOCK_TIMEOUT_MILLIS for it )
+		bool TryRead(SystemSnapshot* pSnapshot) const;
+		// Call fn(const SystemSnapshot&) on the snapshot in place and retry it until the snapshot was stable during the call, return false as TryRead
+		// fn should only copy the fields it needs, since it may see a snapshot being overwritten before a retry
+		template<class Fn>
+		bool Read(Fn&& fn) const {
+			uint64_t sequence{};
+			do {
+				if (!this->begin_read(&sequence)) { return false; }
+				fn(*this->get_snapshot());
+			} while (!this->end_read(sequence));
+			return true;
+		}
+	};
+};